@@ -0,0 +1,262 @@
+/**
+ * @brief Host benchmark of the ardebug output path
+ * Run with `pio run -e native -t exec` (or `-e native_flexbuffer`).
+ * Reports ns per call, bytes emitted per call and stack used by one call.
+ */
+
+#include <Arduino.h>
+#include <pthread.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <chrono>
+#include <new>
+#include "ardebug.h"
+
+#ifndef ARDEBUG_NATIVE
+#error "The benchmark only builds in the native environment"
+#endif
+
+#define ITERATIONS 200000
+#define BATCH 8  // calls between drains when ARDEBUG_ASYNC is defined
+#define STACK_SIZE (256 * 1024)
+
+// Counts what the sink would have sent
+class NullStream : public Stream {
+  public:
+    size_t bytes = 0;
+    size_t write(uint8_t) override { bytes++; return 1; }
+    size_t write(const uint8_t*, size_t size) override { bytes += size; return size; }
+    using Print::write;
+    int availableForWrite() override { return 4096; }
+    int available() override { return 0; }
+    int read() override { return -1; }
+    int peek() override { return -1; }
+};
+
+typedef void (*BenchFn)();
+
+static NullStream sink;
+static char message[512];
+static uint32_t counter __attribute__((unused)) = 0;  // not read once ARDEBUG_MIN_LEVEL removes AR_LOGI()
+static uint8_t stack[STACK_SIZE] __attribute__((aligned(64)));
+
+// every operator new is counted, so log calls that allocate show up
+static size_t allocations = 0;
+static size_t log_allocations = 0;  // in the cases timed by report()
+
+#ifndef PIO_UNIT_TESTING  // tests built with the example count their own
+void* operator new(size_t size) {
+  allocations++;
+  void* p = malloc(size);
+  if (p == nullptr) throw std::bad_alloc();
+  return p;
+}
+void* operator new[](size_t size) { return operator new(size); }
+void operator delete(void* p) noexcept { free(p); }
+void operator delete[](void* p) noexcept { free(p); }
+#endif
+
+static void setMessage(size_t len) {
+  memset(message, 'x', len);
+  message[len] = 0;
+}
+
+static void noop() {}
+static void logE() { AR_LOGE("%s", message); }
+static void logW() { AR_LOGW("%s", message); }
+static void logI() { AR_LOGI("%s", message); }
+static void logD() { AR_LOGD("%s", message); }
+static void logV() { AR_LOGV("%s", message); }
+static void logArgs() { AR_LOGI("value %d of %u at %s (%.2f)", counter++, 1000u, "bench", 1.5); }
+static void logPrintf() { ardprintf("%s\n", message); }
+static void logSampled() { AR_LOGV_SAMPLED(1000, "%s", message); }
+static void logEveryMs() { AR_LOGV_EVERY_MS(1000, "%s", message); }
+
+static double nsPerCall(BenchFn fn) {
+  double total = 0;
+  for (size_t i = 0; i < ITERATIONS; i += BATCH) {
+    auto start = std::chrono::steady_clock::now();
+    for (size_t j = 0; j < BATCH; j++) fn();
+    total += std::chrono::duration<double, std::nano>(
+        std::chrono::steady_clock::now() - start).count();
+    ardebugHandle();
+  }
+  return total / ITERATIONS;
+}
+
+static void* runOnce(void* param) {
+  (*(BenchFn*)param)();
+  return nullptr;
+}
+
+// runs fn once on a painted stack and returns the bytes it touched
+static size_t stackTouched(BenchFn fn) {
+  memset(stack, 0xA5, sizeof(stack));
+  pthread_attr_t attr;
+  pthread_attr_init(&attr);
+  pthread_attr_setstack(&attr, stack, sizeof(stack));
+  pthread_t thread;
+  pthread_create(&thread, &attr, runOnce, &fn);
+  pthread_join(thread, nullptr);
+  pthread_attr_destroy(&attr);
+  size_t untouched = 0;
+  while (untouched < sizeof(stack) && stack[untouched] == 0xA5) untouched++;
+  return sizeof(stack) - untouched;
+}
+
+static void report(const char* name, BenchFn fn) {
+  size_t stack_used = stackTouched(fn) - stackTouched(noop);
+  ardebugHandle();
+  sink.bytes = 0;
+  size_t allocated = allocations;
+  double ns = nsPerCall(fn);
+  allocated = allocations - allocated;
+  log_allocations += allocated;
+  printf("%-36s %10.1f %10.1f %8u %8.2f\n", name, ns, (double)sink.bytes / ITERATIONS,
+         (unsigned)stack_used, (double)allocated / ITERATIONS);
+}
+
+static void prefixCombinations() {
+  char name[64];
+  for (int mask = 0; mask < 8; mask++) {
+    ardebugTime(mask & 1);
+    ardebugLine(mask & 2);
+    ardebugFunc(mask & 4);
+    snprintf(name, sizeof(name), "prefix time=%d line=%d func=%d",
+             (mask & 1) != 0, (mask & 2) != 0, (mask & 4) != 0);
+    report(name, logI);
+  }
+  ardebugTime(true);
+  ardebugLine(true);
+  ardebugFunc(true);
+}
+
+// telnet command round trip over a loopback socket
+static void commandRoundTrip() {
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  addr.sin_port = htons(ARDEBUG_TELNET_PORT);
+  if (fd < 0 || connect(fd, (sockaddr*)&addr, sizeof(addr)) < 0) {
+    printf("%-36s %10s\n", "telnet command 'l'", "n/a");
+    if (fd >= 0) close(fd);
+    return;
+  }
+  while (!ardebug::DebugContext::get().isConnected()) ardebugHandle();
+  char buffer[2048];
+  recv(fd, buffer, sizeof(buffer), MSG_DONTWAIT);  // help text
+  const int commands = 2000;
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < commands; i++) {
+    send(fd, "l\r", 2, 0);
+    bool done = false;
+    while (!done) {
+      ardebugHandle();
+      ssize_t n = recv(fd, buffer, sizeof(buffer), MSG_DONTWAIT);
+      done = n > 0 && buffer[n - 1] == '\n';
+    }
+  }
+  double ns = std::chrono::duration<double, std::nano>(
+      std::chrono::steady_clock::now() - start).count() / commands;
+  printf("%-36s %10.1f\n", "telnet command 'l' round trip", ns);
+  close(fd);
+}
+
+// log lines streamed to a telnet client over a loopback socket, with the
+// send() calls they took
+static void telnetLines() {
+  while (ardebug::DebugContext::get().isConnected()) ardebugHandle();  // the 'l' client
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  addr.sin_port = htons(ARDEBUG_TELNET_PORT);
+  if (fd < 0 || connect(fd, (sockaddr*)&addr, sizeof(addr)) < 0) {
+    printf("%-36s %10s\n", "telnet lines, 32 chars", "n/a");
+    if (fd >= 0) close(fd);
+    return;
+  }
+  while (!ardebug::DebugContext::get().isConnected()) ardebugHandle();
+  char buffer[8192];
+  ardebugHandle();
+  while (recv(fd, buffer, sizeof(buffer), MSG_DONTWAIT) > 0) {}  // help text
+  setMessage(32);
+  const int lines = 50000;
+  uint32_t sends = WiFiClient::sends;
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < lines; i++) {
+    logI();
+    if (i % BATCH == 0) {
+      ardebugHandle();
+      while (recv(fd, buffer, sizeof(buffer), MSG_DONTWAIT) > 0) {}
+    }
+  }
+  auto end = std::chrono::steady_clock::now();
+  double ns = std::chrono::duration<double, std::nano>(end - start).count() / lines;
+  while (std::chrono::steady_clock::now() < end + std::chrono::milliseconds(50)) {
+    ardebugHandle();  // the last segment, sent on its deadline
+    while (recv(fd, buffer, sizeof(buffer), MSG_DONTWAIT) > 0) {}
+  }
+  sends = WiFiClient::sends - sends;
+  printf("%-36s %10.1f %10.1f lines/s, %.1f lines per send()\n", "telnet lines, 32 chars",
+         ns, 1e9 / ns, (double)lines / (sends > 0 ? sends : 1));
+  close(fd);
+}
+
+void setup() {
+  ardebugBegin(&sink, "benchmark", nullptr);
+  ardebugSetLevel(ARDEBUG_V);
+  printf("ardebug %s benchmark: ARDEBUG_BUFFER_SIZE=%d", ARDEBUG_VERSION, ARDEBUG_BUFFER_SIZE);
+#if defined(ARDEBUG_FLEXBUFFER)
+  printf(" ARDEBUG_FLEXBUFFER");
+#endif
+#if defined(ARDEBUG_NO_HEAP)
+  printf(" ARDEBUG_NO_HEAP");
+#endif
+#if defined(ARDEBUG_ASYNC)
+  printf(" ARDEBUG_ASYNC");
+#endif
+#if defined(ARDEBUG_DEFERRED)
+  printf(" ARDEBUG_DEFERRED");
+#endif
+#if defined(ARDEBUG_COALESCE)
+  printf(" ARDEBUG_COALESCE");
+#endif
+  printf("\n%-36s %10s %10s %8s %8s\n", "case", "ns/call", "bytes/call", "stack", "allocs");
+  setMessage(32);
+  report("level E, 32 chars", logE);
+  report("level W, 32 chars", logW);
+  report("level I, 32 chars", logI);
+  report("level D, 32 chars", logD);
+  report("level V, 32 chars", logV);
+  ardebugSetLevel(ARDEBUG_I);
+  report("level V filtered out", logV);
+  ardebugSetLevel(ARDEBUG_V);
+  report("level V sampled 1 in 1000", logSampled);
+  report("level V every 1000 ms", logEveryMs);
+  report("mixed arguments", logArgs);
+  prefixCombinations();
+  const size_t sizes[] = {16, 64, 128, 256, 400};
+  for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+    char name[64];
+    setMessage(sizes[i]);
+    snprintf(name, sizeof(name), "message %u chars", (unsigned)sizes[i]);
+    report(name, logI);
+  }
+  setMessage(32);
+  report("ardprintf, 32 chars", logPrintf);
+  commandRoundTrip();
+  telnetLines();
+#if defined(ARDEBUG_NO_HEAP)
+  if (log_allocations > 0) {
+    printf("FAILED: %u heap allocations in log calls with ARDEBUG_NO_HEAP\n",
+           (unsigned)log_allocations);
+    exit(1);
+  }
+#endif
+  exit(0);
+}
+
+void loop() {}
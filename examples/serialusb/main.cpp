@@ -6,7 +6,7 @@
 
 #include <Arduino.h>
 #include "ardebug.h"
-#if defined(ESP32) || defined(ESP8266)
+#if defined(ESP32) || defined(ESP8266) || defined(ARDEBUG_NATIVE)
 #include "esp_log.h"
 #endif
 
@@ -18,7 +18,6 @@
 uint32_t last_tick = 0;
 uint32_t runtime_s = 0;
 const char* TAG = "TestTag";
-const char* AR_TAG = "[TestTag]";
 
 // Function example to show a different function name
 void foo();
@@ -32,15 +31,15 @@ void setup() {
   digitalWrite(LED_BUILTIN, LOW);
   Serial.print("\r\n>>> Starting with log_level: ");
   Serial.println(ardebugGetLevel());
-#if defined(ESP32) || defined(ESP8266)
+#if defined(ESP32) || defined(ESP8266) || defined(ARDEBUG_NATIVE)
   ESP_LOGI(TAG, "This is a %s message for comparison.", "esp_log");
 #endif
   AR_LOGI("This is a %s log", "ardebug");
-  AR_LOGI("%s ardebug log with a esp_log style tag", AR_TAG);
+  AR_LOGI_TAG(TAG, "This is an ardebug log with an esp_log style tag");
   AR_LOGI("This is a super long message to test what happens if your message"
       " is way too long and might create memory issues"
       " or some other highly undesirable behaviour like who knows what!!!");
-  AR_LOGI("This shows how to escape to get %%GPS instead of %GPS");
+  AR_LOGI("This shows how to escape %% to get %%GPS");
 }
 
 void loop() {
@@ -19,7 +19,6 @@
 uint32_t last_tick = 0;
 uint32_t runtime_s = 0;
 const char* TAG = "TestTag";
-const char* AR_TAG = "[TestTag]";
 
 #define WIFI_ENABLED
 #define HOSTNAME "testmicro"
@@ -47,7 +46,7 @@ void setup() {
   ESP_LOGI(TAG, "This is a %s message for comparison.", "esp_log");
 #endif
   AR_LOGI("This is a %s log", "ardebug");
-  AR_LOGI("%s ardebug log with a esp_log style tag", AR_TAG);
+  AR_LOGI_TAG(TAG, "This is an ardebug log with an esp_log style tag");
 }
 
 void loop() {
@@ -66,6 +65,7 @@ void loop() {
       AR_LOGI("This is a message of debug level INFO (%d)", ARDEBUG_I);
       AR_LOGW("This is a message of debug level WARNING (%d)", ARDEBUG_W);
       AR_LOGE("This is a message of debug level ERROR (%d)", ARDEBUG_E);
+      AR_LOGV_TAG(TAG, "Tagged VERBOSE, shown after telnet 'tag TestTag v'");
       foo();   // test function with tag
 #ifndef ARDEBUG_DISABLED
       uint8_t old_level = ardebugGetLevel();
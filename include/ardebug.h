@@ -9,7 +9,25 @@
 #define ARDEBUG_W 1
 #define ARDEBUG_E 0
 
+// What a full sink output queue does with the next line
+#define ARDEBUG_DROP_OLDEST 0
+#define ARDEBUG_DROP_NEWEST 1
+#define ARDEBUG_BLOCK 2  // wait up to ARDEBUG_QUEUE_BLOCK_MS, then drop it
+
+#ifndef ARDEBUG_TELNET_PORT
 #define ARDEBUG_TELNET_PORT 23
+#endif
+#ifndef ARDEBUG_TELNET_CLIENTS
+#define ARDEBUG_TELNET_CLIENTS 3  // concurrent telnet sessions
+#endif
+
+// Compile-time threshold, calls with a higher (more verbose) level are removed
+#ifndef ARDEBUG_MIN_LEVEL
+#define ARDEBUG_MIN_LEVEL ARDEBUG_V
+#endif
+#if ARDEBUG_MIN_LEVEL < ARDEBUG_E || ARDEBUG_MIN_LEVEL > ARDEBUG_V
+#error "ARDEBUG_MIN_LEVEL must be between ARDEBUG_E and ARDEBUG_V"
+#endif
 
 #ifndef ARDEBUG_DISABLED
 // #if defined(ARDEBUG_ENABLE)
@@ -69,47 +87,478 @@
 #error "ARDEBUG_BUFFER_SIZE must be at least 32 bytes"
 #endif
 
+// With ARDEBUG_FLEXBUFFER a longer line is formatted again in a larger buffer,
+// from the heap unless ARDEBUG_NO_HEAP, then from one static arena
+#if defined(ARDEBUG_FLEXBUFFER) && defined(ARDEBUG_NO_HEAP)
+#ifndef ARDEBUG_FLEXBUFFER_ARENA
+#define ARDEBUG_FLEXBUFFER_ARENA 1024  // bytes, longer lines are truncated
+#endif
+#if ARDEBUG_FLEXBUFFER_ARENA < ARDEBUG_BUFFER_SIZE
+#error "ARDEBUG_FLEXBUFFER_ARENA must be at least ARDEBUG_BUFFER_SIZE"
+#endif
+#endif
+
+// Line buffer: room for a color code, the text and the reset code
+#ifdef BOARD_LOW_MEMORY
+#define ARDEBUG_COLOR_HEAD 0
+#define ARDEBUG_COLOR_TAIL 0
+#else
+#define ARDEBUG_COLOR_HEAD ARD_COLORSIZE
+#define ARDEBUG_COLOR_TAIL 4  // ARD_COLOR_RESET
+#endif
+#define ARDEBUG_LINE_SIZE (ARDEBUG_COLOR_HEAD + ARDEBUG_BUFFER_SIZE + ARDEBUG_COLOR_TAIL)
+
 // Buffer for telnet command input
-#define ARDEBUG_CMD_BUFFER 8  // max size of telnet command 7 chars
+#define ARDEBUG_CMD_BUFFER 24  // max size of telnet command 23 chars, "tag <name> <level>"
+
+// Tags of AR_LOGx_TAG() calls, each with its own level
+#ifndef ARDEBUG_MAX_TAGS
+#ifdef BOARD_LOW_MEMORY
+#define ARDEBUG_MAX_TAGS 4
+#else
+#define ARDEBUG_MAX_TAGS 16  // including the shared slot of tags beyond the table
+#endif
+#endif
+#ifndef ARDEBUG_TAG_SIZE
+#define ARDEBUG_TAG_SIZE 16  // longer tags are cut
+#endif
+#if ARDEBUG_MAX_TAGS < 2 || ARDEBUG_MAX_TAGS > 254
+#error "ARDEBUG_MAX_TAGS must be between 2 and 254"
+#endif
+#define ARDEBUG_TAG_NEW 0xFF  // call site whose tag is not yet looked up
+
+#ifndef ARDEBUG_MAX_SINKS
+#ifdef BOARD_LOW_MEMORY
+#define ARDEBUG_MAX_SINKS 2
+#else
+#define ARDEBUG_MAX_SINKS 6  // Serial, telnet, file and user sinks
+#endif
+#endif
+
+// Deferred output: log calls queue raw arguments, drain() formats them
+#if defined(ARDEBUG_DEFERRED)
+#ifndef ARDEBUG_ASYNC
+#define ARDEBUG_ASYNC
+#endif
+#ifndef ARDEBUG_DEFERRED_ARGS_SIZE
+#define ARDEBUG_DEFERRED_ARGS_SIZE 64  // packed argument bytes per call
+#endif
+#ifndef ARDEBUG_DEFERRED_SITE_CACHE
+#define ARDEBUG_DEFERRED_SITE_CACHE 64  // call sites remembered by binary output
+#endif
+#endif // ARDEBUG_DEFERRED
+
+// Asynchronous output: log calls queue records, drain() writes the sinks.
+// On a multi-core board each core logs through its own staging ring, so the
+// cores never wait on each other or a sink. Without it log calls write the
+// sinks themselves, one line at a time under a mutex.
+#if defined(ARDEBUG_ASYNC)
+#ifdef BOARD_LOW_MEMORY
+#error "ARDEBUG_ASYNC is not supported on low memory boards"
+#endif
+#if defined(ARDEBUG_FLEXBUFFER)
+#error "ARDEBUG_FLEXBUFFER cannot be combined with ARDEBUG_ASYNC, whose slots hold ARDEBUG_BUFFER_SIZE bytes"
+#endif
+#ifndef ARDEBUG_ASYNC_SLOTS
+#define ARDEBUG_ASYNC_SLOTS 16  // power of 2 per core, each slot ~ARDEBUG_BUFFER_SIZE
+#endif
+#ifndef ARDEBUG_ASYNC_DRAIN_MS
+#define ARDEBUG_ASYNC_DRAIN_MS 10  // max latency of the drain task
+#endif
+#if defined(BOARD_MULTI_CORE) && !defined(ARDEBUG_ASYNC_NO_TASK)
+#define ARDEBUG_ASYNC_TASK  // drain in a FreeRTOS task, else in handle()
+#ifndef ARDEBUG_ASYNC_TASK_STACK
+#define ARDEBUG_ASYNC_TASK_STACK 3072
+#endif
+#ifndef ARDEBUG_ASYNC_TASK_PRIORITY
+#define ARDEBUG_ASYNC_TASK_PRIORITY 1
+#endif
+#ifndef ARDEBUG_ASYNC_TASK_CORE
+#define ARDEBUG_ASYNC_TASK_CORE tskNO_AFFINITY
+#endif
+#endif // ARDEBUG_ASYNC_TASK
+#endif // ARDEBUG_ASYNC
+
+// Log file on boards with a filesystem, opened by begin() when given a name
+#if defined(BOARD_FS) && !defined(ARDEBUG_FILE_DISABLED)
+#define ARDEBUG_FILE
+#ifndef ARDEBUG_FILE_BLOCK_SIZE
+#define ARDEBUG_FILE_BLOCK_SIZE 512  // flash page / SD sector
+#endif
+#ifndef ARDEBUG_FILE_FLUSH_MS
+#define ARDEBUG_FILE_FLUSH_MS 5000  // max age of an unwritten partial block
+#endif
+#ifndef ARDEBUG_FILE_MAX_SIZE
+#define ARDEBUG_FILE_MAX_SIZE (64 * 1024)  // rotate beyond this size
+#endif
+#ifndef ARDEBUG_FILE_COUNT
+#define ARDEBUG_FILE_COUNT 3  // rotated files kept as <name>.1 .. <name>.N
+#endif
+#ifndef ARDEBUG_FILE_PATH_SIZE
+#define ARDEBUG_FILE_PATH_SIZE 32
+#endif
+#if ARDEBUG_FILE_COUNT < 1 || ARDEBUG_FILE_COUNT > 9
+#error "ARDEBUG_FILE_COUNT must be between 1 and 9"
+#endif
+#endif // ARDEBUG_FILE
+
+// Per-sink output queues so a slow Serial or telnet peer never blocks a log call
+#if !defined(BOARD_LOW_MEMORY) && !defined(ARDEBUG_QUEUE_DISABLED)
+#define ARDEBUG_QUEUE
+#ifndef ARDEBUG_QUEUE_SIZE
+#define ARDEBUG_QUEUE_SIZE 1024  // power of 2, bytes per sink
+#endif
+#ifndef ARDEBUG_QUEUE_POLICY
+#define ARDEBUG_QUEUE_POLICY ARDEBUG_DROP_OLDEST
+#endif
+#ifndef ARDEBUG_QUEUE_BLOCK_MS
+#define ARDEBUG_QUEUE_BLOCK_MS 20
+#endif
+#if ARDEBUG_QUEUE_SIZE < 256 || (ARDEBUG_QUEUE_SIZE & (ARDEBUG_QUEUE_SIZE - 1)) != 0
+#error "ARDEBUG_QUEUE_SIZE must be a power of 2 of at least 256"
+#endif
+#endif // ARDEBUG_QUEUE
+
+#if defined(BOARD_WIFI) && !defined(ARDEBUG_COALESCE_SIZE)
+#define ARDEBUG_COALESCE_SIZE 1436  // bytes per telnet segment, the lwIP TCP MSS
+#endif
+
+// Telnet lines gathered into one TCP segment, sent when full, after a deadline or on W/E
+#if defined(BOARD_WIFI) && !defined(ARDEBUG_COALESCE_DISABLED)
+#define ARDEBUG_COALESCE
+#ifndef ARDEBUG_COALESCE_MS
+#define ARDEBUG_COALESCE_MS 20  // longest a line waits for more
+#endif
+#if ARDEBUG_COALESCE_SIZE < 64 || ARDEBUG_COALESCE_SIZE > 65535
+#error "ARDEBUG_COALESCE_SIZE must be between 64 and 65535"
+#endif
+#endif // ARDEBUG_COALESCE
+
+// Recent output kept in RAM and replayed to telnet clients that connect later
+#if defined(ARDEBUG_BACKLOG)
+#ifndef BOARD_WIFI
+#error "ARDEBUG_BACKLOG is only supported on boards with WiFi"
+#endif
+#ifndef ARDEBUG_BACKLOG_SIZE
+#define ARDEBUG_BACKLOG_SIZE 2048  // power of 2, bytes of output kept
+#endif
+#ifndef ARDEBUG_BACKLOG_CHUNK
+#define ARDEBUG_BACKLOG_CHUNK 512  // bytes replayed to a client per handle()
+#endif
+#if ARDEBUG_BACKLOG_SIZE < 256 || (ARDEBUG_BACKLOG_SIZE & (ARDEBUG_BACKLOG_SIZE - 1)) != 0
+#error "ARDEBUG_BACKLOG_SIZE must be a power of 2 of at least 256"
+#endif
+#endif // ARDEBUG_BACKLOG
+
+// Interrupt-safe log calls: AR_LOG_ISR() stores a few words, the drain step formats them
+#if defined(ARDEBUG_ISR)
+#ifdef BOARD_LOW_MEMORY
+#error "ARDEBUG_ISR is not supported on low memory boards"
+#endif
+#ifndef ARDEBUG_ISR_SLOTS
+#define ARDEBUG_ISR_SLOTS 32  // power of 2, ~40 bytes each
+#endif
+#ifndef ARDEBUG_ISR_ARGS
+#define ARDEBUG_ISR_ARGS 4  // 32-bit integer arguments per call
+#endif
+#if ARDEBUG_ISR_ARGS < 1 || ARDEBUG_ISR_ARGS > 8
+#error "ARDEBUG_ISR_ARGS must be between 1 and 8"
+#endif
+#endif // ARDEBUG_ISR
+
+// Flood control: per call site rate limits and collapsed repeats, off until configured
+#if !defined(BOARD_LOW_MEMORY) && !defined(ARDEBUG_RATE_DISABLED)
+#define ARDEBUG_RATE
+#ifndef ARDEBUG_RATE_SITES
+#define ARDEBUG_RATE_SITES 32  // power of 2, 16 bytes each
+#endif
+#ifndef ARDEBUG_RATE_LIMIT
+#define ARDEBUG_RATE_LIMIT 0  // lines per second per call site, 0 is no limit
+#endif
+#ifndef ARDEBUG_RATE_BURST
+#define ARDEBUG_RATE_BURST 5  // lines a call site may log back to back
+#endif
+#ifndef ARDEBUG_RATE_REPORT_MS
+#define ARDEBUG_RATE_REPORT_MS 1000  // how often suppressed lines are counted in the output
+#endif
+#ifndef ARDEBUG_COLLAPSE_REPEATS
+#define ARDEBUG_COLLAPSE_REPEATS 0  // 1 to collapse identical consecutive lines
+#endif
+#if ARDEBUG_RATE_SITES < 2 || (ARDEBUG_RATE_SITES & (ARDEBUG_RATE_SITES - 1)) != 0
+#error "ARDEBUG_RATE_SITES must be a power of 2"
+#endif
+#endif // ARDEBUG_RATE
+
+// Scoped profiler: AR_PROFILE_SCOPE() durations in per-scope histograms
+#if defined(ARDEBUG_PROFILE)
+#ifdef BOARD_LOW_MEMORY
+#error "ARDEBUG_PROFILE is not supported on low memory boards"
+#endif
+#ifndef ARDEBUG_PROFILE_SCOPES
+#define ARDEBUG_PROFILE_SCOPES 16  // ~110 bytes each
+#endif
+#if ARDEBUG_PROFILE_SCOPES < 1 || ARDEBUG_PROFILE_SCOPES > 254
+#error "ARDEBUG_PROFILE_SCOPES must be between 1 and 254"
+#endif
+#endif // ARDEBUG_PROFILE
+
+// Lines and bytes per level and per sink, truncations, drops and log call durations
+#if !defined(BOARD_LOW_MEMORY) && !defined(ARDEBUG_STATS_DISABLED)
+#define ARDEBUG_STATS
+#endif
+
+// Trace events recorded into a ring and written as Chrome Trace Event JSON
+#if defined(ARDEBUG_TRACE)
+#ifdef BOARD_LOW_MEMORY
+#error "ARDEBUG_TRACE is not supported on low memory boards"
+#endif
+#ifndef ARDEBUG_TRACE_SLOTS
+#define ARDEBUG_TRACE_SLOTS 256  // power of 2, 24 bytes each
+#endif
+#endif // ARDEBUG_TRACE
+
+// esp_log output of ESP-IDF components written to the sinks, hooked by begin()
+#if defined(ARDEBUG_ESP_LOG)
+#if !defined(ESP32) && !defined(ARDEBUG_NATIVE)
+#error "ARDEBUG_ESP_LOG is only supported on ESP32"
+#endif
+#ifndef ARDEBUG_ESP_LOG_TAG_CACHE
+#define ARDEBUG_ESP_LOG_TAG_CACHE 16  // esp_log tag pointers mapped to tag IDs
+#endif
+#endif // ARDEBUG_ESP_LOG
+
+// Recent output kept in memory that survives a reset, dumped by begin()
+#if defined(ARDEBUG_HISTORY)
+#ifndef BOARD_NOINIT
+#error "ARDEBUG_HISTORY is not supported on this board"
+#endif
+#ifndef ARDEBUG_HISTORY_SIZE
+#define ARDEBUG_HISTORY_SIZE 2048  // power of 2, bytes of output kept
+#endif
+#if ARDEBUG_HISTORY_SIZE < 256 || (ARDEBUG_HISTORY_SIZE & (ARDEBUG_HISTORY_SIZE - 1)) != 0
+#error "ARDEBUG_HISTORY_SIZE must be a power of 2 of at least 256"
+#endif
+#endif // ARDEBUG_HISTORY
+
+// Log calls formatted from their argument types, checked against the format at compile time
+#if defined(ARDEBUG_TYPED) && defined(ARDEBUG_DEFERRED)
+#error "ARDEBUG_TYPED and ARDEBUG_DEFERRED cannot be combined"
+#endif
+
+// Call sites and format strings kept in flash, copied to the stack for one log call
+#if defined(BOARD_PROGMEM) && !defined(ARDEBUG_PROGMEM_DISABLED)
+#define ARDEBUG_PROGMEM
+#if defined(ARDEBUG_ASYNC) || defined(ARDEBUG_ISR) || defined(ARDEBUG_RATE)
+#error "ARDEBUG_PROGMEM call sites cannot be queued or rate limited"
+#endif
+#endif // ARDEBUG_PROGMEM
+
+#if !defined(BOARD_LOW_MEMORY)
+#include <atomic>
+#endif
+#include "ardebug_line.h"
+#include "ardebug_sink.h"
+#if defined(ARDEBUG_DEFERRED)
+#include "ardebug_deferred.h"
+#endif
+#if defined(ARDEBUG_FILE)
+#include "ardebug_file.h"
+#endif
+#if defined(ARDEBUG_HISTORY)
+#include "ardebug_history.h"
+#endif
+#if defined(ARDEBUG_QUEUE)
+#include "ardebug_queue.h"
+#endif
+#if defined(ARDEBUG_ISR)
+#include "ardebug_isr.h"
+#endif
+#if defined(ARDEBUG_RATE)
+#include "ardebug_rate.h"
+#endif
+#if defined(ARDEBUG_PROFILE) || defined(ARDEBUG_STATS)
+#include "ardebug_profile.h"  // also the histogram of the statistics
+#endif
+#if defined(ARDEBUG_TRACE)
+#include "ardebug_trace.h"
+#endif
+#if defined(ARDEBUG_TYPED) || defined(ARDEBUG_ISR)
+#include "ardebug_format.h"  // also the format check of the ISR calls
+#endif
+#if defined(ARDEBUG_BACKLOG)
+#include "ardebug_backlog.h"
+#endif
+#if defined(ARDEBUG_STATS)
+#include "ardebug_stats.h"
+#endif
 
 namespace ardebug {
 
-struct DebugMessage {
+#if defined(BOARD_WIFI) && !defined(ARDEBUG_WIFI_DISABLED)
+struct TelnetSession;
+#endif
+
+// Runtime configuration read by log calls on any core while another task changes it
+#if defined(BOARD_LOW_MEMORY)
+typedef volatile uint8_t ConfigByte;  // single core, byte access is atomic
+#else
+typedef std::atomic<uint8_t> ConfigByte;
+#endif
+
+/**
+ * @brief Static description of a logging call site.
+ * Each macro expansion emits one as a constant-initialized static, so a log
+ * call passes a single pointer and the address is a stable call site ID.
+*/
+struct CallSite {
   uint8_t level;
-  uint32_t millis;
-  char filename[ARDEBUG_FILENAME_SIZE];
-  uint32_t lineno;
-  char func[ARDEBUG_FUNCNAME_SIZE];
-  char message[ARDEBUG_BUFFER_SIZE];
+  const char* file;  // basename only
+  uint32_t line;
+  const char* func;
+  const char* fmt;
+  const uint8_t* tag;  // tag ID of an AR_LOGx_TAG() call, else nullptr
 };
 
+constexpr const char* fileBasename(const char* path, const char* last) {
+  return *path == 0 ? last :
+      fileBasename(path + 1, (*path == '/' || *path == '\\') ? path + 1 : last);
+}
+
+/** @brief Compile-time basename of a path such as __FILE__ */
+constexpr const char* fileBasename(const char* path) {
+  return fileBasename(path, path);
+}
+
+/** @brief Compile-time offset of the basename in a path */
+constexpr size_t fileBasenameOffset(const char* path) {
+  return fileBasename(path) - path;
+}
+
 /**
  * @brief A debug logging context that allows USB or Telnet monitoring
 */
 class DebugContext {
   private:
-    uint8_t log_level_ = ARDEBUG_I;
+    // prefix fields, read once per line so a line never mixes two settings
+    enum : uint8_t {
+      SHOW_MILLIS = 0x01,
+      SHOW_LINE = 0x02,
+      SHOW_FUNC = 0x04,
+      SHOW_CORE = 0x08,
+      SHOW_COLOR = 0x10,
+    };
+    static ConfigByte log_level_;  // most verbose level of any sink, tested inline by the macros
+    static ConfigByte tag_gate_[ARDEBUG_MAX_TAGS];  // per tag: its own level, else log_level_
+    ConfigByte base_level_{ARDEBUG_I};  // Serial, file and new telnet sessions
+    ConfigByte format_{SHOW_MILLIS | SHOW_LINE | SHOW_FUNC | SHOW_CORE | SHOW_COLOR};
+    ConfigByte output_active_{0};  // some sink (or the history or backlog) takes output
     boolean low_memory_ = false;
-    boolean serial_enabled_ = false;
-    Stream* serial_ = nullptr;
+    Sink* sinks_[ARDEBUG_MAX_SINKS] = {nullptr};
+    uint8_t sink_count_ = 0;
     boolean telnet_enabled_ = false;
     boolean telnet_listening_ = false;
     boolean file_enabled_ = false;
-    boolean show_millis_ = true;
-    boolean show_line_ = true;
-    boolean show_func_ = true;
-    boolean show_core_ = true;
-    boolean show_color_ = true;
+    void setFormat(uint8_t flag, boolean show);
 #if defined(BOARD_WIFI) && !defined(ARDEBUG_WIFI_DISABLED)
     char hostname[32] = {0};
     char password_[21] = {0};
-    boolean password_ok_ = false;
-    uint8_t password_attempt_ = 0;
-    char telnet_cmd_[ARDEBUG_CMD_BUFFER] = {0};
+    size_t reply(TelnetSession& session, const Message& msg);
+#if defined(ARDEBUG_TYPED)
+    template <typename... Args>
+    size_t reply(TelnetSession& session, const char* fmt, const Args&... args) {
+      const FormatArg list[] = {formatArg(args)..., FormatArg()};
+      return reply(session, TypedMessage(fmt, list));
+    }
+    template <typename... Args>
+    size_t reply(TelnetSession& session, const __FlashStringHelper* fmt, const Args&... args) {
+      const FormatArg list[] = {formatArg(args)..., FormatArg()};
+      return reply(session, TypedMessage((const char*)fmt, list, true));
+    }
+#else
+    size_t reply(TelnetSession& session, const char* fmt, ...);
+    size_t reply(TelnetSession& session, const __FlashStringHelper* fmt, ...);
+#endif
+    void showHelp(TelnetSession& session);
+    void processCommand(TelnetSession& session);
+    void tagCommand(TelnetSession& session, const char* args);
+#if defined(ARDEBUG_PROFILE)
+    void profileCommand(TelnetSession& session, const char* args);
+#endif
+#if defined(ARDEBUG_STATS)
+    void statsCommand(TelnetSession& session, const char* args);
+#endif
+#if defined(ARDEBUG_TRACE)
+    TelnetSession* trace_session_ = nullptr;  // streaming the trace
+    void traceCommand(TelnetSession& session);
+    void pumpTrace();
+#endif
+    void onConnect(TelnetSession& session);
+    void disconnect(TelnetSession& session);
 #endif // BOARD_WIFI
-    void showHelp();
-    void processCommand();
-    void onConnect();
+#if defined(ARDEBUG_ASYNC)
+    uint32_t async_reported_drops_ = 0;
+#endif
+#if defined(ARDEBUG_ISR)
+    uint32_t isr_reported_drops_ = 0;
+    void emitIsr();
+    void emitIsr(const IsrRecord& rec);
+    void noteIsrDrops();
+#endif
+#if defined(ARDEBUG_FILE)
+    fs::FS* file_system_ = nullptr;
+#endif
+#if defined(ARDEBUG_RATE)
+    ConfigByte collapse_{ARDEBUG_COLLAPSE_REPEATS};
+    const CallSite* repeat_site_ = nullptr;  // site and hash of the last line written
+    uint32_t repeat_hash_ = 0;
+    int8_t repeat_level_ = -1;
+    uint32_t repeat_count_ = 0;  // identical lines since, not written
+    uint32_t repeat_since_ = 0;
+    uint32_t rate_reported_ = 0;
+    bool ratePass(const CallSite* site);
+    bool collapse(const LogRecord& record);
+    void emitRepeats();
+    void emitSuppressed();
+#endif
+    void pollSinks();
+#if defined(ARDEBUG_ESP_LOG)
+    static int espLogHook(const char* fmt, va_list args);
+    int espLog(const char* fmt, va_list args);
+#endif
+#if defined(ARDEBUG_HISTORY)
+    boolean history_enabled_ = false;
+    void replayHistory();
+#endif
+#if defined(ARDEBUG_DEFERRED)
+    ConfigByte binary_output_{0};
+    size_t enqueueDeferred(const CallSite* site, const uint8_t* args, size_t len);
+    void emitDeferred(const CallSite* site, uint32_t ms, uint8_t core,
+                      const uint8_t* args, size_t args_len);
+    void emitFrames(const CallSite* site, uint32_t ms, uint8_t core,
+                    const uint8_t* args, size_t args_len);
+#endif
+    void appendPrefix(LineBuilder& line, uint8_t format, const CallSite* site,
+                      uint32_t ms, uint8_t core);
+    size_t formatLine(LineBuilder& line, const CallSite* site, const Message& msg,
+                      uint32_t ms, uint8_t core);
+    size_t output(const CallSite* site, const Message& msg);
+    void emit(const LogRecord& record);
+    void emitRaw(const uint8_t* data, size_t len, int8_t level);
+    void notice(LineBuilder& note, int8_t level = -1);
+    
+    static inline boolean siteEnabled(const CallSite* site) {
+      return site->level <= (site->tag ? tag_gate_[*site->tag] : log_level_);
+    }
+#if defined(ARDEBUG_PROGMEM)
+    static constexpr bool flash_sites_ = true;  // call sites and their strings are PROGMEM
+    // a call site in flash, copied for one log call
+    static inline const CallSite* loadSite(const CallSite* site, CallSite& copy) {
+      memcpy_P(&copy, site, sizeof(copy));
+      return &copy;
+    }
+#else
+    static constexpr bool flash_sites_ = false;
+#endif
     
     DebugContext() {}   // private for singleton
 
@@ -133,21 +582,156 @@ class DebugContext {
     void handle();
     void disconnect();
 
+    /** @brief Register an output, up to ARDEBUG_MAX_SINKS including the built-in ones */
+    bool addSink(Sink* sink);
+    void removeSink(Sink* sink);
+    /** @brief Recompute the inline level after a sink's level changed */
+    void updateLogLevel();
+
     size_t dprintf(const char* fmt, ...);
-    size_t debugf(uint8_t level,
-                  const char* caller,
-                  const char* filename,
-                  uint32_t lineno,
-                  const char* fmt, ...);
-
-    uint8_t logLevel() { return log_level_; }
-    void setLogLevel(uint8_t level) { if (level <= ARDEBUG_V) log_level_ = level; }
-    void enableSerial(boolean enable) { serial_enabled_ = enable; }  // redundant?
-    void showTime(boolean show) { if (!low_memory_) show_millis_ = show; }
-    void showLine(boolean show) { if (!low_memory_) show_line_ = show; }
-    void showFunc(boolean show) { if (!low_memory_) show_func_ = show; }
-    void showCore(boolean show) { if (!low_memory_) show_core_ = show; }
-    void showColors(boolean show) { if (!low_memory_) show_color_ = show; }
+#if defined(ARDEBUG_PROGMEM)
+    /** @brief dprintf() of a format in flash, F("...") */
+    size_t dprintf(const __FlashStringHelper* fmt, ...);
+#endif
+    size_t debugf(const CallSite* site, ...);
+    size_t drain(size_t max_records = 0);
+#if defined(ARDEBUG_ASYNC)
+    uint32_t asyncDropped();
+    uint32_t asyncOverflows();
+#endif
+#if defined(ARDEBUG_DEFERRED)
+    /**
+     * @brief Log a call site with its raw arguments, formatted later by drain().
+    */
+    template <typename... Args>
+    size_t debugd(const CallSite* site, Args... args) {
+      if (!siteEnabled(site)) return 0;
+#if defined(ARDEBUG_RATE)
+      if (!ratePass(site)) return 0;
+#endif
+      uint8_t packed[ARDEBUG_DEFERRED_ARGS_SIZE];
+      ArgPacker packer(packed, sizeof(packed));
+      packArgs(packer, args...);
+      return enqueueDeferred(site, packed, packer.length());
+    }
+    /** @brief Send deferred records as binary frames for tools/ardecode.py */
+    void setBinaryOutput(boolean enable);
+#endif
+#if defined(ARDEBUG_TYPED)
+    /**
+     * @brief Log a call site with typed arguments, see ARDEBUG_FORMAT_CHECK().
+    */
+    template <typename... Args>
+    size_t debugt(const CallSite* site, const Args&... args) {
+#if defined(ARDEBUG_PROGMEM)
+      CallSite copy;
+      site = loadSite(site, copy);
+#endif
+      if (!siteEnabled(site)) return 0;
+#if defined(ARDEBUG_RATE)
+      if (!ratePass(site)) return 0;
+#endif
+      const FormatArg list[] = {formatArg(args)..., FormatArg()};
+      return output(site, TypedMessage(site->fmt, list, flash_sites_));
+    }
+    /** @brief ardprintf() with typed arguments */
+    template <typename... Args>
+    size_t dprintt(const char* fmt, const Args&... args) {
+      const FormatArg list[] = {formatArg(args)..., FormatArg()};
+      return output(nullptr, TypedMessage(fmt, list));
+    }
+#if defined(ARDEBUG_PROGMEM)
+    template <typename... Args>
+    size_t dprintt(const __FlashStringHelper* fmt, const Args&... args) {
+      const FormatArg list[] = {formatArg(args)..., FormatArg()};
+      return output(nullptr, TypedMessage((const char*)fmt, list, true));
+    }
+#endif
+#endif
+#if defined(ARDEBUG_QUEUE)
+    /**
+     * @brief What Serial and telnet queues do when they are full.
+     * @param policy ARDEBUG_DROP_OLDEST, ARDEBUG_DROP_NEWEST or ARDEBUG_BLOCK
+     * @param block_ms Longest wait for room with ARDEBUG_BLOCK
+    */
+    void setQueuePolicy(uint8_t policy, uint32_t block_ms = ARDEBUG_QUEUE_BLOCK_MS);
+    /** @brief Lines dropped by the Serial and telnet queues since begin() */
+    uint32_t droppedLines();
+#endif
+#if defined(ARDEBUG_COALESCE)
+    /** @brief Telnet segments sent since startup, `lines` gets the lines they carried */
+    uint32_t telnetSegments(uint32_t* lines = nullptr);
+#endif
+#if defined(ARDEBUG_STATS)
+    /** @brief The counters since startup or resetStats(), per sink see Sink::offeredLines() */
+    void stats(DebugStats& out);
+    /** @brief Durations of the log calls that were formatted, in us */
+    const ProfileHistogram& callLatency() const;
+    void resetStats();
+#endif
+#if defined(ARDEBUG_RATE)
+    /**
+     * @brief Limit every call site to `per_sec` lines per second, with bursts of `burst`.
+     * Lines over the limit are dropped and counted in the output every
+     * ARDEBUG_RATE_REPORT_MS. `per_sec` 0 removes the limit.
+    */
+    void setRateLimit(uint16_t per_sec, uint16_t burst = ARDEBUG_RATE_BURST);
+    /** @brief Limit the call sites of one level, see setRateLimit() */
+    void setLevelRateLimit(uint8_t level, uint16_t per_sec, uint16_t burst = ARDEBUG_RATE_BURST);
+    /** @brief Write identical consecutive lines of a call site once, then "last message repeated N times" */
+    void collapseRepeats(boolean enable) { collapse_ = enable ? 1 : 0; }
+    /** @brief Lines dropped by the rate limits since startup */
+    uint32_t suppressedLines();
+#endif
+#if defined(ARDEBUG_PROFILE)
+    /** @brief Write count, min, p50, p99 and max of each profiled scope to the sinks */
+    void reportProfiles();
+    /** @brief Clear the durations of every profiled scope */
+    void resetProfiles();
+#endif
+#if defined(ARDEBUG_TRACE)
+    /**
+     * @brief Write the trace events held in the ring as a Chrome Trace Event JSON array.
+     * The events are taken from the ring, so each is written once.
+     * @return The number of events written, 0 while a telnet client streams them
+    */
+    size_t writeTrace(Print& out);
+#endif
+#if defined(ARDEBUG_FILE)
+    /** @brief Filesystem for the log file, set before begin() (default LittleFS) */
+    void setFileSystem(fs::FS* fs) { file_system_ = fs; }
+    /** @brief Write any buffered lines to the log file now. */
+    void flushFile();
+#endif
+
+    /** @brief Cheap runtime level check used by the macros before get(). */
+    static inline boolean enabled(uint8_t level) { return level <= log_level_; }
+    /** @brief Level check of a tagged call site, `id` caches the tag's ID. */
+    static inline boolean tagEnabled(uint8_t level, uint8_t& id, const char* tag) {
+      if (id == ARDEBUG_TAG_NEW) id = internTag(tag);
+      return level <= tag_gate_[id];
+    }
+    /** @brief The ID of a tag, added to the table if it is new. */
+    static uint8_t internTag(const char* tag);
+    /** @brief Name of a tag ID, nullptr for the slot shared by tags beyond the table */
+    const char* tagName(uint8_t id);
+    /**
+     * @brief Give a tag its own level, checked instead of the global one.
+     * Each output still applies its own level to the tag's lines.
+     * @param level ARDEBUG_E..ARDEBUG_V, or -1 to follow the other levels again
+    */
+    bool setTagLevel(const char* tag, int8_t level);
+    /** @brief A tag's own level, -1 if it has none */
+    int8_t tagLevel(const char* tag);
+    uint8_t logLevel() { return base_level_; }
+    /** @brief Level of Serial, the log file and telnet sessions opened later. */
+    void setLogLevel(uint8_t level);
+    void enableSerial(boolean enable);
+    void showTime(boolean show) { setFormat(SHOW_MILLIS, show); }
+    void showLine(boolean show) { setFormat(SHOW_LINE, show); }
+    void showFunc(boolean show) { setFormat(SHOW_FUNC, show); }
+    void showCore(boolean show) { setFormat(SHOW_CORE, show); }
+    void showColors(boolean show) { setFormat(SHOW_COLOR, show); }
     uint32_t getFreeMemory();
 
 };
@@ -155,18 +739,108 @@ class DebugContext {
 } // namespace ardebug
 
 // Macros
-#define ardebugV(fmt, ...) \
-    ardebug::DebugContext::get().debugf(ARDEBUG_V, __func__, __FILENAME__, __LINE__, fmt, ##__VA_ARGS__)
-#define ardebugD(fmt, ...) \
-    ardebug::DebugContext::get().debugf(ARDEBUG_D, __func__, __FILENAME__, __LINE__, fmt, ##__VA_ARGS__)
-#define ardebugI(fmt, ...) \
-    ardebug::DebugContext::get().debugf(ARDEBUG_I, __func__, __FILENAME__, __LINE__, fmt, ##__VA_ARGS__)
-#define ardebugW(fmt, ...) \
-    ardebug::DebugContext::get().debugf(ARDEBUG_W, __func__, __FILENAME__, __LINE__, fmt, ##__VA_ARGS__)
-#define ardebugE(fmt, ...) \
-    ardebug::DebugContext::get().debugf(ARDEBUG_E, __func__, __FILENAME__, __LINE__, fmt, ##__VA_ARGS__)
-
-#define ardprintf(fmt, ...) ardebug::DebugContext::get().dprintf(fmt, ##__VA_ARGS__)
+// The level is checked before the arguments are evaluated
+#if defined(ARDEBUG_PROGMEM)
+// __func__ cannot be placed in flash, so function names are left out
+#define ARDEBUG_FLASH_SITE(lvl, fmt, tagptr) \
+    static const char ardebug_fmt_[] PROGMEM = fmt; \
+    static const char ardebug_file_[] PROGMEM = __FILE__; \
+    static const ardebug::CallSite ardebug_site_ PROGMEM = \
+        {lvl, ardebug_file_ + ardebug::fileBasenameOffset(__FILE__), __LINE__, nullptr, \
+         ardebug_fmt_, tagptr}
+#define ARDEBUG_SITE(lvl, fmt) ARDEBUG_FLASH_SITE(lvl, fmt, nullptr)
+#define ARDEBUG_TAG_SITE(lvl, fmt, tagid) ARDEBUG_FLASH_SITE(lvl, fmt, &tagid)
+#else
+#define ARDEBUG_SITE(lvl, fmt) \
+    static const ardebug::CallSite ardebug_site_ = \
+        {lvl, ardebug::fileBasename(__FILE__), __LINE__, __func__, fmt, nullptr}
+#define ARDEBUG_TAG_SITE(lvl, fmt, tagid) \
+    static const ardebug::CallSite ardebug_site_ = \
+        {lvl, ardebug::fileBasename(__FILE__), __LINE__, __func__, fmt, &tagid}
+#endif // ARDEBUG_PROGMEM
+#if defined(ARDEBUG_DEFERRED)
+#define ARDEBUG_LOG(lvl, fmt, ...) do { \
+    if (ardebug::DebugContext::enabled(lvl)) { \
+      ARDEBUG_SITE(lvl, fmt); \
+      ardebug::DebugContext::get().debugd(&ardebug_site_, ##__VA_ARGS__); \
+    } \
+  } while (0)
+#define ARDEBUG_LOG_TAG(lvl, tag, fmt, ...) do { \
+    static uint8_t ardebug_tag_ = ARDEBUG_TAG_NEW; \
+    if (ardebug::DebugContext::tagEnabled(lvl, ardebug_tag_, tag)) { \
+      ARDEBUG_TAG_SITE(lvl, fmt, ardebug_tag_); \
+      ardebug::DebugContext::get().debugd(&ardebug_site_, ##__VA_ARGS__); \
+    } \
+  } while (0)
+#define ardebugBinary(bool) ardebug::DebugContext::get().setBinaryOutput(bool)
+#elif defined(ARDEBUG_TYPED)
+#define ARDEBUG_LOG(lvl, fmt, ...) do { \
+    ARDEBUG_FORMAT_CHECK(fmt, ##__VA_ARGS__); \
+    if (ardebug::DebugContext::enabled(lvl)) { \
+      ARDEBUG_SITE(lvl, fmt); \
+      ardebug::DebugContext::get().debugt(&ardebug_site_, ##__VA_ARGS__); \
+    } \
+  } while (0)
+#define ARDEBUG_LOG_TAG(lvl, tag, fmt, ...) do { \
+    ARDEBUG_FORMAT_CHECK(fmt, ##__VA_ARGS__); \
+    static uint8_t ardebug_tag_ = ARDEBUG_TAG_NEW; \
+    if (ardebug::DebugContext::tagEnabled(lvl, ardebug_tag_, tag)) { \
+      ARDEBUG_TAG_SITE(lvl, fmt, ardebug_tag_); \
+      ardebug::DebugContext::get().debugt(&ardebug_site_, ##__VA_ARGS__); \
+    } \
+  } while (0)
+#define ardebugBinary(bool)
+#else
+#define ARDEBUG_LOG(lvl, fmt, ...) do { \
+    if (ardebug::DebugContext::enabled(lvl)) { \
+      ARDEBUG_SITE(lvl, fmt); \
+      ardebug::DebugContext::get().debugf(&ardebug_site_, ##__VA_ARGS__); \
+    } \
+  } while (0)
+#define ARDEBUG_LOG_TAG(lvl, tag, fmt, ...) do { \
+    static uint8_t ardebug_tag_ = ARDEBUG_TAG_NEW; \
+    if (ardebug::DebugContext::tagEnabled(lvl, ardebug_tag_, tag)) { \
+      ARDEBUG_TAG_SITE(lvl, fmt, ardebug_tag_); \
+      ardebug::DebugContext::get().debugf(&ardebug_site_, ##__VA_ARGS__); \
+    } \
+  } while (0)
+#define ardebugBinary(bool)
+#endif // ARDEBUG_DEFERRED
+
+// Levels above ARDEBUG_MIN_LEVEL are removed at compile time
+#if ARDEBUG_MIN_LEVEL >= ARDEBUG_V
+#define ardebugV(fmt, ...) ARDEBUG_LOG(ARDEBUG_V, fmt, ##__VA_ARGS__)
+#else
+#define ardebugV(...) do {} while (0)
+#endif
+#if ARDEBUG_MIN_LEVEL >= ARDEBUG_D
+#define ardebugD(fmt, ...) ARDEBUG_LOG(ARDEBUG_D, fmt, ##__VA_ARGS__)
+#else
+#define ardebugD(...) do {} while (0)
+#endif
+#if ARDEBUG_MIN_LEVEL >= ARDEBUG_I
+#define ardebugI(fmt, ...) ARDEBUG_LOG(ARDEBUG_I, fmt, ##__VA_ARGS__)
+#else
+#define ardebugI(...) do {} while (0)
+#endif
+#if ARDEBUG_MIN_LEVEL >= ARDEBUG_W
+#define ardebugW(fmt, ...) ARDEBUG_LOG(ARDEBUG_W, fmt, ##__VA_ARGS__)
+#else
+#define ardebugW(...) do {} while (0)
+#endif
+#define ardebugE(fmt, ...) ARDEBUG_LOG(ARDEBUG_E, fmt, ##__VA_ARGS__)
+
+#if defined(ARDEBUG_PROGMEM)
+#define ARDEBUG_FMT(fmt) F(fmt)
+#else
+#define ARDEBUG_FMT(fmt) fmt
+#endif
+#if defined(ARDEBUG_TYPED)
+#define ardprintf(fmt, ...) (ARDEBUG_FORMAT_CHECK(fmt, ##__VA_ARGS__), \
+    ardebug::DebugContext::get().dprintt(ARDEBUG_FMT(fmt), ##__VA_ARGS__))
+#else
+#define ardprintf(fmt, ...) ardebug::DebugContext::get().dprintf(ARDEBUG_FMT(fmt), ##__VA_ARGS__)
+#endif
 
 // With newline
 #define ardebugVln(fmt, ...) ardebugV(fmt "\n", ##__VA_ARGS__)
@@ -182,6 +856,91 @@ class DebugContext {
 #define AR_LOGW(fmt, ...) ardebugWln(fmt, ##__VA_ARGS__)
 #define AR_LOGE(fmt, ...) ardebugEln(fmt, ##__VA_ARGS__)
 
+// ESP-IDF like, with a TAG whose level can be set on its own
+#if ARDEBUG_MIN_LEVEL >= ARDEBUG_V
+#define AR_LOGV_TAG(tag, fmt, ...) ARDEBUG_LOG_TAG(ARDEBUG_V, tag, fmt "\n", ##__VA_ARGS__)
+#else
+#define AR_LOGV_TAG(...) do {} while (0)
+#endif
+#if ARDEBUG_MIN_LEVEL >= ARDEBUG_D
+#define AR_LOGD_TAG(tag, fmt, ...) ARDEBUG_LOG_TAG(ARDEBUG_D, tag, fmt "\n", ##__VA_ARGS__)
+#else
+#define AR_LOGD_TAG(...) do {} while (0)
+#endif
+#if ARDEBUG_MIN_LEVEL >= ARDEBUG_I
+#define AR_LOGI_TAG(tag, fmt, ...) ARDEBUG_LOG_TAG(ARDEBUG_I, tag, fmt "\n", ##__VA_ARGS__)
+#else
+#define AR_LOGI_TAG(...) do {} while (0)
+#endif
+#if ARDEBUG_MIN_LEVEL >= ARDEBUG_W
+#define AR_LOGW_TAG(tag, fmt, ...) ARDEBUG_LOG_TAG(ARDEBUG_W, tag, fmt "\n", ##__VA_ARGS__)
+#else
+#define AR_LOGW_TAG(...) do {} while (0)
+#endif
+#define AR_LOGE_TAG(tag, fmt, ...) ARDEBUG_LOG_TAG(ARDEBUG_E, tag, fmt "\n", ##__VA_ARGS__)
+
+// Hot paths: every n-th call, or at most one call per ms milliseconds, of a
+// site is logged. _EVERY_MS lines end with the number of calls skipped since
+// the last one, if any. A skipped call is not formatted: it costs an
+// increment and a compare (plus millis() for _EVERY_MS). The counters are
+// not atomic, so calls from several tasks may be sampled slightly off.
+#define ARDEBUG_LOG_SAMPLED(lvl, n, fmt, ...) do { \
+    static uint32_t ardebug_calls_ = 0; \
+    if (ardebug::DebugContext::enabled(lvl) && ++ardebug_calls_ >= (uint32_t)(n)) { \
+      ardebug_calls_ = 0; \
+      ARDEBUG_LOG(lvl, fmt "\n", ##__VA_ARGS__); \
+    } \
+  } while (0)
+#define ARDEBUG_LOG_EVERY_MS(lvl, ms, fmt, ...) do { \
+    static uint32_t ardebug_last_ = 0; \
+    static uint32_t ardebug_skipped_ = UINT32_MAX;  /* nothing logged yet */ \
+    if (ardebug::DebugContext::enabled(lvl)) { \
+      uint32_t ardebug_now_ = millis(); \
+      if (ardebug_skipped_ == UINT32_MAX || ardebug_now_ - ardebug_last_ >= (uint32_t)(ms)) { \
+        unsigned long ardebug_count_ = ardebug_skipped_ == UINT32_MAX ? 0 : ardebug_skipped_; \
+        ardebug_skipped_ = 0; \
+        ardebug_last_ = ardebug_now_; \
+        if (ardebug_count_ == 0) { \
+          ARDEBUG_LOG(lvl, fmt "\n", ##__VA_ARGS__); \
+        } else { \
+          ARDEBUG_LOG(lvl, fmt " (%lu skipped)\n", ##__VA_ARGS__, ardebug_count_); \
+        } \
+      } else { \
+        ardebug_skipped_++; \
+      } \
+    } \
+  } while (0)
+#if ARDEBUG_MIN_LEVEL >= ARDEBUG_V
+#define AR_LOGV_SAMPLED(n, fmt, ...) ARDEBUG_LOG_SAMPLED(ARDEBUG_V, n, fmt, ##__VA_ARGS__)
+#define AR_LOGV_EVERY_MS(ms, fmt, ...) ARDEBUG_LOG_EVERY_MS(ARDEBUG_V, ms, fmt, ##__VA_ARGS__)
+#else
+#define AR_LOGV_SAMPLED(...) do {} while (0)
+#define AR_LOGV_EVERY_MS(...) do {} while (0)
+#endif
+#if ARDEBUG_MIN_LEVEL >= ARDEBUG_D
+#define AR_LOGD_SAMPLED(n, fmt, ...) ARDEBUG_LOG_SAMPLED(ARDEBUG_D, n, fmt, ##__VA_ARGS__)
+#define AR_LOGD_EVERY_MS(ms, fmt, ...) ARDEBUG_LOG_EVERY_MS(ARDEBUG_D, ms, fmt, ##__VA_ARGS__)
+#else
+#define AR_LOGD_SAMPLED(...) do {} while (0)
+#define AR_LOGD_EVERY_MS(...) do {} while (0)
+#endif
+#if ARDEBUG_MIN_LEVEL >= ARDEBUG_I
+#define AR_LOGI_SAMPLED(n, fmt, ...) ARDEBUG_LOG_SAMPLED(ARDEBUG_I, n, fmt, ##__VA_ARGS__)
+#define AR_LOGI_EVERY_MS(ms, fmt, ...) ARDEBUG_LOG_EVERY_MS(ARDEBUG_I, ms, fmt, ##__VA_ARGS__)
+#else
+#define AR_LOGI_SAMPLED(...) do {} while (0)
+#define AR_LOGI_EVERY_MS(...) do {} while (0)
+#endif
+#if ARDEBUG_MIN_LEVEL >= ARDEBUG_W
+#define AR_LOGW_SAMPLED(n, fmt, ...) ARDEBUG_LOG_SAMPLED(ARDEBUG_W, n, fmt, ##__VA_ARGS__)
+#define AR_LOGW_EVERY_MS(ms, fmt, ...) ARDEBUG_LOG_EVERY_MS(ARDEBUG_W, ms, fmt, ##__VA_ARGS__)
+#else
+#define AR_LOGW_SAMPLED(...) do {} while (0)
+#define AR_LOGW_EVERY_MS(...) do {} while (0)
+#endif
+#define AR_LOGE_SAMPLED(n, fmt, ...) ARDEBUG_LOG_SAMPLED(ARDEBUG_E, n, fmt, ##__VA_ARGS__)
+#define AR_LOGE_EVERY_MS(ms, fmt, ...) ARDEBUG_LOG_EVERY_MS(ARDEBUG_E, ms, fmt, ##__VA_ARGS__)
+
 // RemoteDebug like
 #define debugV(fmt, ...) ardebugVln(fmt, ##__VA_ARGS__)
 #define debugD(fmt, ...) ardebugDln(fmt, ##__VA_ARGS__)
@@ -189,6 +948,76 @@ class DebugContext {
 #define debugW(fmt, ...) ardebugWln(fmt, ##__VA_ARGS__)
 #define debugE(fmt, ...) ardebugEln(fmt, ##__VA_ARGS__)
 
+// From interrupt handlers: up to ARDEBUG_ISR_ARGS integer arguments for
+// %d/%i/%u/%o/%x/%X/%c conversions without l or ll (checked at compile time),
+// formatted later by ardebugHandle() or the drain task
+#if defined(ARDEBUG_ISR)
+#define AR_LOG_ISR(lvl, fmt, ...) do { \
+    ARDEBUG_FORMAT_WORDS_CHECK(fmt, ##__VA_ARGS__); \
+    if (ardebug::DebugContext::enabled(lvl)) { \
+      ARDEBUG_SITE(lvl, fmt "\n"); \
+      ardebug::logIsr(&ardebug_site_, ##__VA_ARGS__); \
+    } \
+  } while (0)
+#else
+#define AR_LOG_ISR(...) do {} while (0)
+#endif
+#if ARDEBUG_MIN_LEVEL >= ARDEBUG_V
+#define AR_LOGV_ISR(fmt, ...) AR_LOG_ISR(ARDEBUG_V, fmt, ##__VA_ARGS__)
+#else
+#define AR_LOGV_ISR(...) do {} while (0)
+#endif
+#if ARDEBUG_MIN_LEVEL >= ARDEBUG_D
+#define AR_LOGD_ISR(fmt, ...) AR_LOG_ISR(ARDEBUG_D, fmt, ##__VA_ARGS__)
+#else
+#define AR_LOGD_ISR(...) do {} while (0)
+#endif
+#if ARDEBUG_MIN_LEVEL >= ARDEBUG_I
+#define AR_LOGI_ISR(fmt, ...) AR_LOG_ISR(ARDEBUG_I, fmt, ##__VA_ARGS__)
+#else
+#define AR_LOGI_ISR(...) do {} while (0)
+#endif
+#if ARDEBUG_MIN_LEVEL >= ARDEBUG_W
+#define AR_LOGW_ISR(fmt, ...) AR_LOG_ISR(ARDEBUG_W, fmt, ##__VA_ARGS__)
+#else
+#define AR_LOGW_ISR(...) do {} while (0)
+#endif
+#define AR_LOGE_ISR(fmt, ...) AR_LOG_ISR(ARDEBUG_E, fmt, ##__VA_ARGS__)
+
+#define ARDEBUG_CONCAT_(a, b) a##b
+#define ARDEBUG_CONCAT(a, b) ARDEBUG_CONCAT_(a, b)
+
+// Times the rest of the enclosing block, in microseconds, as scope `name`
+#if defined(ARDEBUG_PROFILE)
+#define AR_PROFILE_SCOPE(name) \
+    static uint8_t ARDEBUG_CONCAT(ardebug_profile_id_, __LINE__) = ARDEBUG_PROFILE_NEW; \
+    ardebug::ProfileScope ARDEBUG_CONCAT(ardebug_profile_, __LINE__)( \
+        ARDEBUG_CONCAT(ardebug_profile_id_, __LINE__), name)
+#define ardebugProfileReport() ardebug::DebugContext::get().reportProfiles()
+#define ardebugProfileReset() ardebug::DebugContext::get().resetProfiles()
+#else
+#define AR_PROFILE_SCOPE(name) do {} while (0)
+#define ardebugProfileReport()
+#define ardebugProfileReset()
+#endif
+
+// Trace events for Perfetto (ui.perfetto.dev), from tasks or interrupt handlers
+#if defined(ARDEBUG_TRACE)
+#define AR_TRACE_BEGIN(name) ardebug::traceEvent('B', name)
+#define AR_TRACE_END(name) ardebug::traceEvent('E', name)
+#define AR_TRACE_INSTANT(name) ardebug::traceEvent('i', name)
+#define AR_TRACE_COUNTER(name, value) ardebug::traceEvent('C', name, value)
+#define AR_TRACE_SCOPE(name) ardebug::TraceScope ARDEBUG_CONCAT(ardebug_trace_, __LINE__)(name)
+#define ardebugTrace(printptr) ardebug::DebugContext::get().writeTrace(*(printptr))
+#else
+#define AR_TRACE_BEGIN(name) do {} while (0)
+#define AR_TRACE_END(name) do {} while (0)
+#define AR_TRACE_INSTANT(name) do {} while (0)
+#define AR_TRACE_COUNTER(name, value) do {} while (0)
+#define AR_TRACE_SCOPE(name) do {} while (0)
+#define ardebugTrace(printptr) 0
+#endif
+
 #define ardebugBegin(serialptr, hostnameptr, filenameptr) \
     ardebug::DebugContext::get().begin(serialptr, hostnameptr, filenameptr)
 #define ardebugHandle() ardebug::DebugContext::get().handle()
@@ -196,8 +1025,32 @@ class DebugContext {
 #define ardebugSetLevel(lvl) ardebug::DebugContext::get().setLogLevel(lvl)
 #define ardebugTime(bool) ardebug::DebugContext::get().showTime(bool)
 #define ardebugLine(bool) ardebug::DebugContext::get().showLine(bool)
-#define ardebugFunc(bool) ardebug::DebugContext::get().showFunction(bool)
+#define ardebugFunc(bool) ardebug::DebugContext::get().showFunc(bool)
 #define ardebugCore(bool) ardebug::DebugContext::get().showCore(bool)
+#define ardebugAddSink(sinkptr) ardebug::DebugContext::get().addSink(sinkptr)
+#define ardebugTagLevel(tag, lvl) ardebug::DebugContext::get().setTagLevel(tag, lvl)
+#if defined(ARDEBUG_QUEUE)
+#define ardebugQueuePolicy(policy) ardebug::DebugContext::get().setQueuePolicy(policy)
+#else
+#define ardebugQueuePolicy(policy)
+#endif
+#if defined(ARDEBUG_RATE)
+#define ardebugRateLimit(per_sec, burst) ardebug::DebugContext::get().setRateLimit(per_sec, burst)
+#define ardebugLevelRateLimit(lvl, per_sec, burst) \
+    ardebug::DebugContext::get().setLevelRateLimit(lvl, per_sec, burst)
+#define ardebugCollapseRepeats(bool) ardebug::DebugContext::get().collapseRepeats(bool)
+#else
+#define ardebugRateLimit(per_sec, burst)
+#define ardebugLevelRateLimit(lvl, per_sec, burst)
+#define ardebugCollapseRepeats(bool)
+#endif
+#if defined(ARDEBUG_FILE)
+#define ardebugFileSystem(fsptr) ardebug::DebugContext::get().setFileSystem(fsptr)
+#define ardebugFlush() ardebug::DebugContext::get().flushFile()
+#else
+#define ardebugFileSystem(fsptr)
+#define ardebugFlush()
+#endif
 
 #else  // ARDEBUG_DISABLED
 
@@ -221,6 +1074,41 @@ class DebugContext {
 #define AR_LOGW(...)
 #define AR_LOGE(...)
 
+#define AR_LOGV_TAG(...)
+#define AR_LOGD_TAG(...)
+#define AR_LOGI_TAG(...)
+#define AR_LOGW_TAG(...)
+#define AR_LOGE_TAG(...)
+
+#define AR_LOGV_SAMPLED(...)
+#define AR_LOGD_SAMPLED(...)
+#define AR_LOGI_SAMPLED(...)
+#define AR_LOGW_SAMPLED(...)
+#define AR_LOGE_SAMPLED(...)
+#define AR_LOGV_EVERY_MS(...)
+#define AR_LOGD_EVERY_MS(...)
+#define AR_LOGI_EVERY_MS(...)
+#define AR_LOGW_EVERY_MS(...)
+#define AR_LOGE_EVERY_MS(...)
+
+#define AR_LOG_ISR(...)
+#define AR_LOGV_ISR(...)
+#define AR_LOGD_ISR(...)
+#define AR_LOGI_ISR(...)
+#define AR_LOGW_ISR(...)
+#define AR_LOGE_ISR(...)
+
+#define AR_PROFILE_SCOPE(...)
+#define ardebugProfileReport()
+#define ardebugProfileReset()
+
+#define AR_TRACE_BEGIN(...)
+#define AR_TRACE_END(...)
+#define AR_TRACE_INSTANT(...)
+#define AR_TRACE_COUNTER(...)
+#define AR_TRACE_SCOPE(...)
+#define ardebugTrace(...) 0
+
 #define debugV(...)
 #define debugD(...)
 #define debugI(...)
@@ -235,6 +1123,15 @@ class DebugContext {
 #define ardebugLine(...)
 #define ardebugFunc(...)
 #define ardebugCore(...)
+#define ardebugBinary(...)
+#define ardebugFileSystem(...)
+#define ardebugFlush()
+#define ardebugQueuePolicy(...)
+#define ardebugRateLimit(...)
+#define ardebugLevelRateLimit(...)
+#define ardebugCollapseRepeats(...)
+#define ardebugAddSink(...)
+#define ardebugTagLevel(...)
 
 #endif  // ARDEBUG_DISABLED
 
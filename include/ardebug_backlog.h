@@ -0,0 +1,56 @@
+/**
+ * @brief Recent output kept for telnet clients that connect later
+*/
+
+#ifndef ARDEBUG_BACKLOG_H
+#define ARDEBUG_BACKLOG_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Longest record kept, longer output is cut to this
+#define ARDEBUG_BACKLOG_RECORD (ARDEBUG_BACKLOG_SIZE / 4)
+
+namespace ardebug {
+
+/**
+ * @brief A ring of the most recent output records, each with its level.
+ *
+ * Each record is a 3-byte header (length, level and raw flag) and the bytes
+ * written to the sinks. The oldest whole records make room for new ones, so
+ * readers keep their own position and resume at `begin()` once theirs is gone.
+ * Positions count bytes since startup. Not locked: it is written and read
+ * with the sinks.
+*/
+class Backlog {
+  private:
+    uint8_t buffer_[ARDEBUG_BACKLOG_SIZE];
+    uint32_t begin_ = 0;  // position of the oldest record
+    uint32_t end_ = 0;  // free-running write position
+    uint16_t records_ = 0;
+
+    uint8_t at(uint32_t pos) const { return buffer_[pos & (ARDEBUG_BACKLOG_SIZE - 1)]; }
+    uint16_t recordLength(uint32_t pos) const { return at(pos) | (at(pos + 1) << 8); }
+
+  public:
+    /** @brief Keep one record of `level` (-1 for any level), `raw` if not a log line. */
+    void append(int8_t level, bool raw, const uint8_t* data, size_t len);
+    void clear();
+    /**
+     * @brief Copy the record at `pos`, at least ARDEBUG_BACKLOG_RECORD bytes of `out`.
+     * @return The position of the next record
+    */
+    uint32_t read(uint32_t pos, int8_t* level, bool* raw, uint8_t* out, size_t* len) const;
+
+    uint32_t begin() const { return begin_; }
+    uint32_t end() const { return end_; }
+    /** @brief True if the record at `pos` has been overwritten. */
+    bool lost(uint32_t pos) const { return (int32_t)(pos - begin_) < 0; }
+    /** @brief Bytes held, at most ARDEBUG_BACKLOG_SIZE. */
+    size_t size() const { return end_ - begin_; }
+    uint16_t records() const { return records_; }
+};
+
+} // namespace ardebug
+
+#endif // ARDEBUG_BACKLOG_H
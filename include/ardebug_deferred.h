@@ -0,0 +1,122 @@
+/**
+ * @brief Deferred logging: capture raw arguments now, format them later
+*/
+
+#ifndef ARDEBUG_DEFERRED_H
+#define ARDEBUG_DEFERRED_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+namespace ardebug {
+
+struct CallSite;
+
+// Argument type tags in a packed argument buffer
+#define ARDEBUG_ARG_I32 'i'
+#define ARDEBUG_ARG_I64 'l'
+#define ARDEBUG_ARG_F64 'f'
+#define ARDEBUG_ARG_STR 's'  // followed by a length byte, not terminated
+#define ARDEBUG_ARG_PTR 'p'
+
+// Binary wire frames: ARDEBUG_FRAME_START, type, length (uint16 LE), payload
+#define ARDEBUG_FRAME_START 0x1E
+#define ARDEBUG_FRAME_SITE 'S'    // id, level, line, file\0 func\0 fmt\0
+#define ARDEBUG_FRAME_RECORD 'R'  // id, millis, core, packed arguments
+#define ARDEBUG_FRAME_HEADER 4
+
+/**
+ * @brief Copies printf arguments into a tagged byte buffer.
+ * Strings are copied (the pointer may not outlive the call), everything
+ * else is stored at its promoted size. Arguments that do not fit are
+ * dropped and flagged as truncated.
+*/
+class ArgPacker {
+  private:
+    uint8_t* buffer_;
+    size_t size_;
+    size_t len_ = 0;
+    bool truncated_ = false;
+
+    void put(char tag, const void* value, size_t size) {
+      if (len_ + 1 + size > size_) {
+        truncated_ = true;
+        return;
+      }
+      buffer_[len_++] = (uint8_t)tag;
+      memcpy(buffer_ + len_, value, size);
+      len_ += size;
+    }
+
+    template <typename T>
+    void addInteger(T v) {
+      if (sizeof(T) <= sizeof(int32_t)) {
+        int32_t x = (int32_t)v;
+        put(ARDEBUG_ARG_I32, &x, sizeof(x));
+      } else {
+        int64_t x = (int64_t)v;
+        put(ARDEBUG_ARG_I64, &x, sizeof(x));
+      }
+    }
+
+  public:
+    ArgPacker(uint8_t* buffer, size_t size) : buffer_(buffer), size_(size) {}
+
+    void add(int v) { addInteger(v); }
+    void add(unsigned int v) { addInteger(v); }
+    void add(long v) { addInteger(v); }
+    void add(unsigned long v) { addInteger(v); }
+    void add(long long v) { addInteger(v); }
+    void add(unsigned long long v) { addInteger(v); }
+    void add(double v) { put(ARDEBUG_ARG_F64, &v, sizeof(v)); }
+    void add(const void* v) { uint64_t x = (uintptr_t)v; put(ARDEBUG_ARG_PTR, &x, sizeof(x)); }
+    void add(const char* v) {
+      if (v == nullptr) v = "(null)";
+      size_t n = strlen(v);
+      if (n > 255) n = 255;
+      if (len_ + 2 > size_) {
+        truncated_ = true;
+        return;
+      }
+      if (len_ + 2 + n > size_) {
+        n = size_ - len_ - 2;
+        truncated_ = true;
+      }
+      buffer_[len_++] = ARDEBUG_ARG_STR;
+      buffer_[len_++] = (uint8_t)n;
+      memcpy(buffer_ + len_, v, n);
+      len_ += n;
+    }
+
+    size_t length() const { return len_; }
+    bool truncated() const { return truncated_; }
+};
+
+inline void packArgs(ArgPacker&) {}
+
+template <typename T, typename... Args>
+inline void packArgs(ArgPacker& packer, T first, Args... rest) {
+  packer.add(first);
+  packArgs(packer, rest...);
+}
+
+/**
+ * @brief Format a printf-style string from packed arguments.
+ * Each conversion is rendered on its own using the stored argument type,
+ * so length modifiers in the format string are not trusted.
+ * @return The number of characters written, excluding the terminator
+*/
+size_t formatPacked(char* out, size_t size, const char* fmt,
+                    const uint8_t* args, size_t args_len);
+
+/** @brief Encode the dictionary frame describing a call site. */
+size_t encodeSiteFrame(uint8_t* out, size_t size, uint32_t id, const CallSite* site);
+
+/** @brief Encode a deferred record as a binary frame. */
+size_t encodeRecordFrame(uint8_t* out, size_t size, uint32_t id, uint32_t ms,
+                         uint8_t core, const uint8_t* args, size_t args_len);
+
+} // namespace ardebug
+
+#endif // ARDEBUG_DEFERRED_H
@@ -0,0 +1,59 @@
+/**
+ * @brief Buffered, rotating log file output
+*/
+
+#ifndef ARDEBUG_FILE_H
+#define ARDEBUG_FILE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace ardebug {
+
+/**
+ * @brief Writes log lines to a file in whole blocks.
+ *
+ * Lines are collected in a block-sized buffer and written when the block is
+ * full, when ARDEBUG_FILE_FLUSH_MS has passed since the last write, or
+ * immediately for an ERROR line, so a flash page or SD sector is not
+ * reprogrammed per line. A block ends on a multiple of
+ * ARDEBUG_FILE_BLOCK_SIZE in the file, so after an existing file or a
+ * partial write the next block is shorter and the ones after it line up. When the file would exceed ARDEBUG_FILE_MAX_SIZE it
+ * is renamed to `<path>.1` (older files shift up to `<path>.<ARDEBUG_FILE_COUNT>`
+ * and the oldest is removed) and a new file is started.
+*/
+class FileSink : public Sink {
+  private:
+    fs::FS* fs_ = nullptr;
+    fs::File file_;
+    char path_[ARDEBUG_FILE_PATH_SIZE] = {0};
+    uint8_t block_[ARDEBUG_FILE_BLOCK_SIZE];
+    size_t used_ = 0;
+    uint32_t size_ = 0;
+    uint32_t last_write_ = 0;
+    uint32_t rotations_ = 0;
+
+    bool open();
+    void rotate();
+    void writeBlock();
+    void append(const char* text, size_t len, int8_t level);
+
+  public:
+    bool begin(fs::FS& fs, const char* path);
+    void end();
+    void write(const LogRecord& record) override;
+    void writeRaw(const uint8_t* data, size_t len, int8_t level) override;
+    /** @brief Write a partly filled block once it is old enough. */
+    void poll() override;
+    int8_t maxLevel() override { return file_ ? (int8_t)level_ : -1; }
+    const char* name() const override { return "file"; }
+    void flush();
+
+    bool isOpen() { return (bool)file_; }
+    uint32_t size() const { return size_ + used_; }
+    uint32_t rotations() const { return rotations_; }
+};
+
+} // namespace ardebug
+
+#endif // ARDEBUG_FILE_H
@@ -0,0 +1,255 @@
+/**
+ * @brief Type-checked formatting of log calls without printf
+*/
+
+#ifndef ARDEBUG_FORMAT_H
+#define ARDEBUG_FORMAT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace ardebug {
+
+// Argument kinds, as checked against the conversions of a format string
+#define ARDEBUG_FORMAT_NONE 0  // not supported
+#define ARDEBUG_FORMAT_INT 1
+#define ARDEBUG_FORMAT_UINT 2
+#define ARDEBUG_FORMAT_INT64 3
+#define ARDEBUG_FORMAT_UINT64 4
+#define ARDEBUG_FORMAT_FLOAT 5
+#define ARDEBUG_FORMAT_STR 6
+#define ARDEBUG_FORMAT_PTR 7
+
+/** @brief One parsed conversion, "%-08.3f" */
+struct FormatSpec {
+  char conv;
+  bool left;  // '-'
+  bool zero;  // '0'
+  char sign;  // '+', ' ' or 0
+  bool alt;  // '#'
+  uint8_t width;
+  int8_t precision;  // -1 if not given
+};
+
+struct FormatArg;
+
+/** @brief Appends one argument, linked in only for the types a sketch logs */
+typedef void (*FormatFn)(LineBuilder& line, const FormatSpec& spec, const FormatArg& arg);
+
+/** @brief A log call argument with the function that writes it */
+struct FormatArg {
+  FormatFn fn;  // nullptr ends the list
+  union {
+    int32_t i;
+    uint32_t u;
+    int64_t ll;
+    uint64_t ull;
+    double f;
+    const char* s;
+    const void* p;
+  };
+};
+
+void formatSigned(LineBuilder& line, const FormatSpec& spec, const FormatArg& arg);
+void formatUnsigned(LineBuilder& line, const FormatSpec& spec, const FormatArg& arg);
+void formatSigned64(LineBuilder& line, const FormatSpec& spec, const FormatArg& arg);
+void formatUnsigned64(LineBuilder& line, const FormatSpec& spec, const FormatArg& arg);
+void formatFloat(LineBuilder& line, const FormatSpec& spec, const FormatArg& arg);
+void formatString(LineBuilder& line, const FormatSpec& spec, const FormatArg& arg);
+void formatPointer(LineBuilder& line, const FormatSpec& spec, const FormatArg& arg);
+
+/** @brief Write `fmt` with the arguments of a list ended by an entry without `fn`. */
+void formatArgs(LineBuilder& line, const char* fmt, const FormatArg* args, bool flash = false);
+
+// Argument kind of a type, without <type_traits> (not available on AVR)
+template <typename T, bool is_signed>
+struct FormatInteger {
+  static constexpr uint8_t value = sizeof(T) > 4 ?
+      (is_signed ? ARDEBUG_FORMAT_INT64 : ARDEBUG_FORMAT_UINT64) :
+      (is_signed ? ARDEBUG_FORMAT_INT : ARDEBUG_FORMAT_UINT);
+};
+template <typename T>
+struct FormatKind {
+  static constexpr uint8_t value = __is_enum(T) ? ARDEBUG_FORMAT_INT : ARDEBUG_FORMAT_NONE;
+};
+template <typename T> struct FormatKind<const T> : FormatKind<T> {};
+template <typename T> struct FormatKind<volatile T> : FormatKind<T> {};
+template <typename T> struct FormatKind<const volatile T> : FormatKind<T> {};
+template <> struct FormatKind<bool> : FormatInteger<bool, false> {};
+template <> struct FormatKind<char> : FormatInteger<char, ((char)-1 < 0)> {};
+template <> struct FormatKind<signed char> : FormatInteger<signed char, true> {};
+template <> struct FormatKind<unsigned char> : FormatInteger<unsigned char, false> {};
+template <> struct FormatKind<short> : FormatInteger<short, true> {};
+template <> struct FormatKind<unsigned short> : FormatInteger<unsigned short, false> {};
+template <> struct FormatKind<int> : FormatInteger<int, true> {};
+template <> struct FormatKind<unsigned int> : FormatInteger<unsigned int, false> {};
+template <> struct FormatKind<long> : FormatInteger<long, true> {};
+template <> struct FormatKind<unsigned long> : FormatInteger<unsigned long, false> {};
+template <> struct FormatKind<long long> : FormatInteger<long long, true> {};
+template <> struct FormatKind<unsigned long long> : FormatInteger<unsigned long long, false> {};
+template <> struct FormatKind<float> { static constexpr uint8_t value = ARDEBUG_FORMAT_FLOAT; };
+template <> struct FormatKind<double> { static constexpr uint8_t value = ARDEBUG_FORMAT_FLOAT; };
+template <> struct FormatKind<char*> { static constexpr uint8_t value = ARDEBUG_FORMAT_STR; };
+template <> struct FormatKind<const char*> { static constexpr uint8_t value = ARDEBUG_FORMAT_STR; };
+template <size_t N> struct FormatKind<char[N]> { static constexpr uint8_t value = ARDEBUG_FORMAT_STR; };
+template <> struct FormatKind<String> { static constexpr uint8_t value = ARDEBUG_FORMAT_STR; };
+template <typename T> struct FormatKind<T*> { static constexpr uint8_t value = ARDEBUG_FORMAT_PTR; };
+template <> struct FormatKind<decltype(nullptr)> { static constexpr uint8_t value = ARDEBUG_FORMAT_PTR; };
+
+// Compile-time walk of a format string literal, see ARDEBUG_FORMAT_CHECK()
+constexpr bool formatIn(char c, const char* set) {
+  return *set != 0 && (*set == c || formatIn(c, set + 1));
+}
+
+// past flags, width, precision and length modifiers, to the conversion
+constexpr const char* formatConversion(const char* f) {
+  return *f != 0 && formatIn(*f, "-+ #0123456789.hlLzjt") ? formatConversion(f + 1) : f;
+}
+
+/** @brief The next conversion character, or the terminator if there is none */
+constexpr const char* formatNext(const char* f) {
+  return *f == 0 ? f :
+      *f != '%' ? formatNext(f + 1) :
+      f[1] == '%' ? formatNext(f + 2) :
+      formatConversion(f + 1);
+}
+
+constexpr bool formatAccepts(uint8_t kind, char conv) {
+  return formatIn(conv, "diuoxX") ? kind >= ARDEBUG_FORMAT_INT && kind <= ARDEBUG_FORMAT_UINT64 :
+      conv == 'c' ? kind == ARDEBUG_FORMAT_INT || kind == ARDEBUG_FORMAT_UINT :
+      formatIn(conv, "fFeEgG") ? kind == ARDEBUG_FORMAT_FLOAT :
+      conv == 's' ? kind == ARDEBUG_FORMAT_STR :
+      conv == 'p' ? kind == ARDEBUG_FORMAT_PTR || kind == ARDEBUG_FORMAT_STR :
+      false;
+}
+
+template <typename... T>
+struct FormatTypes {};
+
+/** @brief The argument types of a call, for decltype() only */
+template <typename... T>
+FormatTypes<T...> formatTypes(const T&...);
+
+constexpr bool formatMatches(const char* f, FormatTypes<>) {
+  return *formatNext(f) == 0;
+}
+
+/** @brief True if each conversion of `f` takes the next argument type, and none is left */
+template <typename T, typename... Rest>
+constexpr bool formatMatches(const char* f, FormatTypes<T, Rest...>) {
+  return *formatNext(f) != 0 && formatAccepts(FormatKind<T>::value, *formatNext(f)) &&
+      formatMatches(formatNext(f) + 1, FormatTypes<Rest...>());
+}
+
+// ISR log calls keep 32-bit words: integer conversions, no l, ll or other long length
+constexpr bool formatWordSpec(const char* f, const char* conv) {
+  return f == conv ? formatAccepts(ARDEBUG_FORMAT_UINT, *conv) :
+      !formatIn(*f, "lLjzt") && formatWordSpec(f + 1, conv);
+}
+
+/** @brief True if `f` has `count` conversions and each takes one 32-bit word */
+constexpr bool formatWords(const char* f, size_t count) {
+  return *formatNext(f) == 0 ? count == 0 :
+      *f != '%' || f[1] == '%' ? formatWords(*f == '%' ? f + 2 : f + 1, count) :
+      count > 0 && formatWordSpec(f + 1, formatNext(f)) &&
+          formatWords(formatNext(f) + 1, count - 1);
+}
+
+template <typename... T>
+constexpr size_t formatCount(FormatTypes<T...>) { return sizeof...(T); }
+
+template <bool matches>
+struct FormatCheck {
+  static_assert(matches, "The format string does not match the arguments of this log call");
+};
+
+template <bool matches>
+struct FormatWordsCheck {
+  static_assert(matches, "ISR log calls take %d, %i, %u, %o, %x, %X or %c without l or ll, "
+                "one integer argument each");
+};
+
+template <uint8_t kind>
+struct FormatTag {};
+
+template <typename T>
+FormatArg formatArg(const T& value, FormatTag<ARDEBUG_FORMAT_INT>) {
+  FormatArg arg;
+  arg.fn = formatSigned;
+  arg.i = (int32_t)value;
+  return arg;
+}
+template <typename T>
+FormatArg formatArg(const T& value, FormatTag<ARDEBUG_FORMAT_UINT>) {
+  FormatArg arg;
+  arg.fn = formatUnsigned;
+  arg.u = (uint32_t)value;
+  return arg;
+}
+template <typename T>
+FormatArg formatArg(const T& value, FormatTag<ARDEBUG_FORMAT_INT64>) {
+  FormatArg arg;
+  arg.fn = formatSigned64;
+  arg.ll = (int64_t)value;
+  return arg;
+}
+template <typename T>
+FormatArg formatArg(const T& value, FormatTag<ARDEBUG_FORMAT_UINT64>) {
+  FormatArg arg;
+  arg.fn = formatUnsigned64;
+  arg.ull = (uint64_t)value;
+  return arg;
+}
+template <typename T>
+FormatArg formatArg(const T& value, FormatTag<ARDEBUG_FORMAT_FLOAT>) {
+  FormatArg arg;
+  arg.fn = formatFloat;
+  arg.f = (double)value;
+  return arg;
+}
+inline const char* formatText(const char* str) { return str; }
+inline const char* formatText(const String& str) { return str.c_str(); }
+template <typename T>
+FormatArg formatArg(const T& value, FormatTag<ARDEBUG_FORMAT_STR>) {
+  FormatArg arg;
+  arg.fn = formatString;
+  arg.s = formatText(value);
+  return arg;
+}
+template <typename T>
+FormatArg formatArg(const T& value, FormatTag<ARDEBUG_FORMAT_PTR>) {
+  FormatArg arg;
+  arg.fn = formatPointer;
+  arg.p = (const void*)value;
+  return arg;
+}
+
+template <typename T>
+inline FormatArg formatArg(const T& value) {
+  return formatArg(value, FormatTag<FormatKind<T>::value>());
+}
+
+/** @brief A message formatted from typed arguments */
+class TypedMessage : public Message {
+  private:
+    const FormatArg* args_;
+
+  public:
+    TypedMessage(const char* format, const FormatArg* args, bool in_flash = false)
+        : Message(format, in_flash), args_(args) {}
+    void appendTo(LineBuilder& line) const override { formatArgs(line, fmt, args_, flash); }
+};
+
+} // namespace ardebug
+
+// Compile error unless the literal `fmt` matches the argument types
+#define ARDEBUG_FORMAT_CHECK(fmt, ...) \
+    (void)sizeof(ardebug::FormatCheck<ardebug::formatMatches(fmt, \
+        decltype(ardebug::formatTypes(__VA_ARGS__))())>)
+
+// Compile error unless each conversion of `fmt` takes one of the 32-bit words of AR_LOG_ISR()
+#define ARDEBUG_FORMAT_WORDS_CHECK(fmt, ...) \
+    (void)sizeof(ardebug::FormatWordsCheck<ardebug::formatWords(fmt, \
+        ardebug::formatCount(decltype(ardebug::formatTypes(__VA_ARGS__))()))>)
+
+#endif // ARDEBUG_FORMAT_H
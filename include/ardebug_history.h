@@ -0,0 +1,59 @@
+/**
+ * @brief Log history kept in memory that survives a reset
+*/
+
+#ifndef ARDEBUG_HISTORY_H
+#define ARDEBUG_HISTORY_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace ardebug {
+
+/**
+ * @brief Layout of the history region.
+ * Lives in memory that a reset does not clear, so it is never constructed:
+ * the header is checked on boot and the region reset if it does not match.
+*/
+struct HistoryRegion {
+  uint32_t magic;
+  uint32_t size;
+  uint32_t written;  // total bytes appended, the ring position is modulo size
+  uint32_t check;    // magic ^ size ^ written
+  char data[ARDEBUG_HISTORY_SIZE];
+};
+
+/**
+ * @brief A circular byte log of the most recent output lines.
+ *
+ * `append()` is a reservation with one atomic add and a memcpy, so it is
+ * cheap enough to call for every line and safe from several tasks. The
+ * check word is kept in step with an atomic xor of the old and new length;
+ * a reset in between leaves it invalid and the history is discarded.
+*/
+class History {
+  private:
+    HistoryRegion* region_;
+
+  public:
+    explicit History(HistoryRegion& region) : region_(&region) {}
+
+    /** @brief True if the region holds history from before the reset. */
+    bool valid() const;
+    void reset();
+    void append(const char* text, size_t len);
+    /** @brief Number of bytes held, at most ARDEBUG_HISTORY_SIZE. */
+    size_t available() const;
+    /** @brief True if older output has been overwritten. */
+    bool wrapped() const { return region_->written > ARDEBUG_HISTORY_SIZE; }
+    /**
+     * @brief Copy held bytes, oldest first.
+     * @param offset Position from the oldest byte held
+     * @return The number of bytes copied
+    */
+    size_t copy(size_t offset, char* out, size_t len) const;
+};
+
+} // namespace ardebug
+
+#endif // ARDEBUG_HISTORY_H
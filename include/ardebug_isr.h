@@ -0,0 +1,50 @@
+/**
+ * @brief Interrupt-safe logging: capture a few words now, format them later
+*/
+
+#ifndef ARDEBUG_ISR_H
+#define ARDEBUG_ISR_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <type_traits>
+#include "ardebug_ring.h"
+
+namespace ardebug {
+
+struct CallSite;
+
+/** @brief What an interrupt handler's log call leaves for the drain step */
+struct IsrRecord {
+  const CallSite* site;
+  uint32_t stamp;  // micros()
+  uint32_t millis;
+  uint8_t core;
+  uint8_t count;  // argument words used
+  uint32_t args[ARDEBUG_ISR_ARGS];
+};
+
+/** @brief Records of interrupt handlers, the oldest overwritten when full */
+template <size_t N>
+using IsrRing = OverwriteRing<IsrRecord, N>;
+
+/** @brief Store one record from an interrupt handler, see AR_LOG_ISR(). */
+void captureIsr(const CallSite* site, const uint32_t* words, uint8_t count);
+
+template <typename T>
+inline __attribute__((always_inline)) uint32_t isrWord(T value) {
+  static_assert(std::is_integral<T>::value || std::is_enum<T>::value,
+                "ISR log arguments must be integers");
+  return (uint32_t)value;
+}
+
+template <typename... Args>
+inline __attribute__((always_inline)) void logIsr(const CallSite* site, Args... args) {
+  static_assert(sizeof...(Args) <= ARDEBUG_ISR_ARGS, "Too many arguments for an ISR log call");
+  const uint32_t words[] = {isrWord(args)..., 0};
+  captureIsr(site, words, (uint8_t)sizeof...(Args));
+}
+
+} // namespace ardebug
+
+#endif // ARDEBUG_ISR_H
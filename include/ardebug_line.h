@@ -0,0 +1,86 @@
+/**
+ * @brief Single-pass builder for an output line
+*/
+
+#ifndef ARDEBUG_LINE_H
+#define ARDEBUG_LINE_H
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Space reserved around the text for a color code and the reset code
+#ifndef ARDEBUG_COLOR_HEAD
+#define ARDEBUG_COLOR_HEAD 0
+#endif
+#ifndef ARDEBUG_COLOR_TAIL
+#define ARDEBUG_COLOR_TAIL 0
+#endif
+
+namespace ardebug {
+
+/**
+ * @brief Appends the parts of a log line into one buffer, exactly once.
+ *
+ * Room for an ANSI color code is reserved in front of the text and for the
+ * reset code behind it, so the colored and plain forms of the line are two
+ * views of the same buffer and no sink has to copy or reformat it.
+ * Text that does not fit is dropped and the line marked as truncated.
+*/
+class LineBuilder {
+  private:
+    char* buffer_;
+    size_t size_;
+    size_t len_ = 0;
+    size_t required_ = 0;  // length the text would have had without truncation
+
+    char* text_() const { return buffer_ + ARDEBUG_COLOR_HEAD; }
+    size_t capacity() const { return size_ - ARDEBUG_COLOR_HEAD - ARDEBUG_COLOR_TAIL - 1; }
+
+  public:
+    /** @brief Start an empty line in a buffer of `size` bytes. */
+    LineBuilder(char* buffer, size_t size);
+    /** @brief Wrap a buffer that already holds a line of `len` characters. */
+    LineBuilder(char* buffer, size_t size, size_t len);
+
+    void append(char c);
+    void append(const char* str);
+    void append(const char* str, size_t len);
+    /** @brief Decimal, right-aligned with spaces to `width` characters. */
+    void appendUnsigned(uint32_t value, uint8_t width = 0);
+    void appendf(const char* fmt, ...);
+    void vappendf(const char* fmt, va_list args);
+#if defined(ARDEBUG_PROGMEM)
+    /** @brief append() and vappendf() of strings in flash */
+    void append_P(const char* str);
+    void append_P(const char* str, size_t len);
+    void vappendf_P(const char* fmt, va_list args);
+#endif
+    /** @brief Free space for an external formatter, followed by `advance()`. */
+    char* tail() { return text_() + len_; }
+    size_t room() const { return capacity() - len_ + 1; }
+    void advance(size_t written, size_t required);
+    /** @brief Mark a truncated line with "..." and keep a final newline if `lf`. */
+    void finish(bool lf);
+
+    const char* text() const { return text_(); }
+    size_t length() const { return len_; }
+    bool truncated() const { return required_ > len_; }
+    /** @brief Length needed to hold the untruncated text. */
+    size_t required() const { return required_; }
+    /** @brief The line wrapped in `color` and a reset code, in place. */
+    const char* colored(const char* color, size_t* len);
+};
+
+/** @brief The text of a log call, written into a line as often as the line is formatted */
+class Message {
+  public:
+    const char* fmt;
+    bool flash;  // fmt is PROGMEM, only on boards with ARDEBUG_PROGMEM
+    explicit Message(const char* format, bool in_flash = false) : fmt(format), flash(in_flash) {}
+    virtual void appendTo(LineBuilder& line) const = 0;
+};
+
+} // namespace ardebug
+
+#endif // ARDEBUG_LINE_H
@@ -0,0 +1,109 @@
+/**
+ * @brief Scoped timing of code sections into fixed log2 histograms
+*/
+
+#ifndef ARDEBUG_PROFILE_H
+#define ARDEBUG_PROFILE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+
+#define ARDEBUG_PROFILE_BUCKETS 24  // bucket i holds [2^i, 2^(i+1)) us, the last one the rest
+#define ARDEBUG_PROFILE_NEW 0xFF  // scope whose name is not yet looked up
+
+namespace ardebug {
+
+/**
+ * @brief Durations of one scope, recorded from any task without a lock.
+ * Each duration costs a count-leading-zeros and two atomic adds, plus a
+ * compare-and-swap when it is a new minimum or maximum. Percentiles are
+ * interpolated within a power of 2 bucket.
+*/
+class ProfileHistogram {
+  private:
+    std::atomic<uint32_t> count_;
+    std::atomic<uint32_t> min_;
+    std::atomic<uint32_t> max_;
+    std::atomic<uint32_t> buckets_[ARDEBUG_PROFILE_BUCKETS];
+
+  public:
+    ProfileHistogram() { reset(); }
+    ProfileHistogram(const ProfileHistogram&) = delete;
+    void operator=(const ProfileHistogram&) = delete;
+
+    void record(uint32_t us) {
+      uint8_t bucket = us == 0 ? 0 : 31 - __builtin_clz(us);
+      if (bucket >= ARDEBUG_PROFILE_BUCKETS) bucket = ARDEBUG_PROFILE_BUCKETS - 1;
+      buckets_[bucket].fetch_add(1, std::memory_order_relaxed);
+      count_.fetch_add(1, std::memory_order_relaxed);
+      uint32_t min = min_.load(std::memory_order_relaxed);
+      while (us < min && !min_.compare_exchange_weak(min, us, std::memory_order_relaxed)) {}
+      uint32_t max = max_.load(std::memory_order_relaxed);
+      while (us > max && !max_.compare_exchange_weak(max, us, std::memory_order_relaxed)) {}
+    }
+
+    void reset() {
+      count_.store(0, std::memory_order_relaxed);
+      min_.store(UINT32_MAX, std::memory_order_relaxed);
+      max_.store(0, std::memory_order_relaxed);
+      for (std::atomic<uint32_t>& bucket : buckets_) bucket.store(0, std::memory_order_relaxed);
+    }
+
+    uint32_t count() const { return count_.load(std::memory_order_relaxed); }
+    uint32_t min() const { return count() > 0 ? min_.load(std::memory_order_relaxed) : 0; }
+    uint32_t max() const { return max_.load(std::memory_order_relaxed); }
+
+    /** @brief Estimated duration below which `permille` of the durations are */
+    uint32_t percentile(uint16_t permille) const {
+      uint32_t counts[ARDEBUG_PROFILE_BUCKETS];
+      uint32_t total = 0;
+      for (uint8_t i = 0; i < ARDEBUG_PROFILE_BUCKETS; i++) {
+        counts[i] = buckets_[i].load(std::memory_order_relaxed);
+        total += counts[i];
+      }
+      if (total == 0) return 0;
+      uint32_t rank = (uint32_t)(((uint64_t)total * permille + 999) / 1000);
+      if (rank == 0) rank = 1;
+      uint32_t below = 0;
+      uint32_t value = max();
+      for (uint8_t i = 0; i < ARDEBUG_PROFILE_BUCKETS; i++) {
+        if (below + counts[i] >= rank) {
+          uint32_t low = i == 0 ? 0 : (uint32_t)1 << i;
+          uint32_t high = i == ARDEBUG_PROFILE_BUCKETS - 1 ? max() : ((uint32_t)2 << i) - 1;
+          value = low + (uint32_t)((uint64_t)(high - low) * (rank - below) / counts[i]);
+          break;
+        }
+        below += counts[i];
+      }
+      if (value < min()) value = min();
+      if (value > max()) value = max();
+      return value;
+    }
+};
+
+/** @brief The ID of a profiled scope, added to the table if it is new */
+uint8_t profileScope(const char* name);
+/** @brief Record a duration of a scope, ignored if the table was full */
+void profileRecord(uint8_t id, uint32_t us);
+
+/** @brief Times its own lifetime, see AR_PROFILE_SCOPE() */
+class ProfileScope {
+  private:
+    uint8_t id_;
+    uint32_t start_;
+
+  public:
+    ProfileScope(uint8_t& id, const char* name) {
+      if (id == ARDEBUG_PROFILE_NEW) id = profileScope(name);
+      id_ = id;
+      start_ = micros();
+    }
+    ~ProfileScope() { profileRecord(id_, micros() - start_); }
+    ProfileScope(const ProfileScope&) = delete;
+    void operator=(const ProfileScope&) = delete;
+};
+
+} // namespace ardebug
+
+#endif // ARDEBUG_PROFILE_H
@@ -0,0 +1,69 @@
+/**
+ * @brief Bounded output queue that keeps a slow sink from blocking the caller
+*/
+
+#ifndef ARDEBUG_QUEUE_H
+#define ARDEBUG_QUEUE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace ardebug {
+
+/**
+ * @brief Lines waiting for one sink, written as fast as the sink takes them.
+ *
+ * Each line is a record (2-byte length + bytes) in a byte ring, so a full
+ * queue drops whole lines and never splits one. `pump()` writes no more
+ * than the sink reports free, so `write()` on the sink does not wait.
+ * A sink that has never reported free space (the Print default of 0) is
+ * written unconditionally. Lost lines are counted and announced in the
+ * queue itself as "[ardebug] N lines dropped".
+*/
+class OutputQueue {
+  public:
+    /** @brief Free space of a sink in bytes, <= 0 if it cannot take any */
+    typedef int (*SpaceFn)(Print& out);
+
+  private:
+    uint8_t buffer_[ARDEBUG_QUEUE_SIZE];
+    uint32_t head_ = 0;  // free-running write position
+    uint32_t tail_ = 0;  // start of the oldest record
+    uint16_t sent_ = 0;  // bytes of the oldest record already written
+    boolean gated_ = false;  // the sink has reported free space at least once
+    uint32_t dropped_ = 0;
+    uint32_t reported_ = 0;
+    uint32_t gap_ = 0;  // oldest lines dropped ahead of the queued ones, not yet reported
+    uint32_t note_count_ = 0;  // lines reported by the note being written
+    uint8_t note_sent_ = 0;  // bytes of that note already written
+
+    size_t free() const { return ARDEBUG_QUEUE_SIZE - (head_ - tail_); }
+    uint16_t recordLength(uint32_t pos) const;
+    bool dropOldest(size_t needed);
+    bool push(const uint8_t* data, size_t len);
+    bool pushNote();
+
+  public:
+    /**
+     * @brief Queue one line and write what the sink can take now.
+     * @param policy ARDEBUG_DROP_OLDEST, ARDEBUG_DROP_NEWEST or ARDEBUG_BLOCK
+     * @param block_ms Longest wait for room with ARDEBUG_BLOCK
+     * @return false if the line was dropped
+    */
+    bool write(Print& out, SpaceFn space, const uint8_t* data, size_t len,
+               uint8_t policy, uint32_t block_ms);
+    /** @brief Write queued lines while the sink has room. */
+    size_t pump(Print& out, SpaceFn space);
+    /** @brief Discard queued lines, e.g. for a new connection. */
+    void clear();
+
+    size_t size() const { return head_ - tail_; }
+    /** @brief Nothing queued and no drop to report, so output may bypass the queue */
+    bool idle() const { return tail_ == head_ && dropped_ == reported_; }
+    /** @brief Lines dropped since startup */
+    uint32_t dropped() const { return dropped_; }
+};
+
+} // namespace ardebug
+
+#endif // ARDEBUG_QUEUE_H
@@ -0,0 +1,108 @@
+/**
+ * @brief Per call site token buckets that keep one log call from flooding the output
+*/
+
+#ifndef ARDEBUG_RATE_H
+#define ARDEBUG_RATE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+
+namespace ardebug {
+
+struct CallSite;
+
+/**
+ * @brief Token buckets of the busiest call sites, in a table indexed by address.
+ *
+ * A call site's address picks its entry, so the check is a few loads, an
+ * add and a compare, without a search or a lock. Tokens are kept in
+ * thousandths of a line and refilled by `per_sec` per elapsed millisecond.
+ * A site that finds another in its entry takes it over with a full bucket;
+ * lines the other site had suppressed are still counted. Two cores logging
+ * from the same site at once may lose a refill or a count, never a line
+ * the bucket allowed.
+*/
+template <size_t N>
+class RateTable {
+  static_assert(N >= 2 && (N & (N - 1)) == 0, "RateTable size must be a power of 2");
+
+  private:
+    struct Entry {
+      std::atomic<const CallSite*> site;
+      std::atomic<uint32_t> tokens;  // 1000 per line
+      std::atomic<uint32_t> stamp;  // millis() of the last refill
+      std::atomic<uint32_t> suppressed;  // since the last report
+    };
+    Entry entries_[N];
+    std::atomic<uint32_t> orphaned_;  // suppressed by sites that lost their entry
+    std::atomic<uint32_t> total_;
+
+  public:
+    RateTable() : orphaned_(0), total_(0) {
+      for (size_t i = 0; i < N; i++) {
+        entries_[i].site.store(nullptr, std::memory_order_relaxed);
+        entries_[i].tokens.store(0, std::memory_order_relaxed);
+        entries_[i].stamp.store(0, std::memory_order_relaxed);
+        entries_[i].suppressed.store(0, std::memory_order_relaxed);
+      }
+    }
+    RateTable(const RateTable&) = delete;
+    void operator=(const RateTable&) = delete;
+
+    /**
+     * @brief Take a token for one line of `site`.
+     * @param per_sec Lines per second the bucket refills, at least 1
+     * @param burst Lines allowed back to back, at least 1
+     * @return false if the line is to be suppressed
+    */
+    bool pass(const CallSite* site, uint32_t now, uint16_t per_sec, uint16_t burst) {
+      Entry& entry = entries_[((uintptr_t)site >> 2) & (N - 1)];
+      uint32_t full = (uint32_t)burst * 1000;
+      if (entry.site.load(std::memory_order_relaxed) != site) {
+        uint32_t lost = entry.suppressed.exchange(0, std::memory_order_relaxed);
+        if (lost > 0) orphaned_.fetch_add(lost, std::memory_order_relaxed);
+        entry.site.store(site, std::memory_order_relaxed);
+        entry.stamp.store(now, std::memory_order_relaxed);
+        entry.tokens.store(full - 1000, std::memory_order_relaxed);
+        return true;
+      }
+      uint32_t elapsed = now - entry.stamp.load(std::memory_order_relaxed);
+      if (elapsed > full / per_sec) elapsed = full / per_sec + 1;  // refills to full, no overflow
+      uint32_t tokens = entry.tokens.load(std::memory_order_relaxed) + elapsed * per_sec;
+      if (tokens > full) tokens = full;
+      entry.stamp.store(now, std::memory_order_relaxed);
+      if (tokens < 1000) {
+        entry.tokens.store(tokens, std::memory_order_relaxed);
+        entry.suppressed.fetch_add(1, std::memory_order_relaxed);
+        total_.fetch_add(1, std::memory_order_relaxed);
+        return false;
+      }
+      entry.tokens.store(tokens - 1000, std::memory_order_relaxed);
+      return true;
+    }
+
+    /**
+     * @brief Pass each site's lines suppressed since the last report to `fn(site, count)`.
+     * The count of sites that lost their entry is passed with a nullptr site.
+    */
+    template <typename F>
+    void report(F fn) {
+      for (Entry& entry : entries_) {
+        if (entry.suppressed.load(std::memory_order_relaxed) == 0) continue;
+        const CallSite* site = entry.site.load(std::memory_order_relaxed);
+        uint32_t count = entry.suppressed.exchange(0, std::memory_order_relaxed);
+        if (count > 0) fn(site, count);
+      }
+      uint32_t orphaned = orphaned_.exchange(0, std::memory_order_relaxed);
+      if (orphaned > 0) fn(nullptr, orphaned);
+    }
+
+    /** @brief Lines suppressed since startup */
+    uint32_t suppressed() const { return total_.load(std::memory_order_relaxed); }
+};
+
+} // namespace ardebug
+
+#endif // ARDEBUG_RATE_H
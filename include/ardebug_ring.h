@@ -0,0 +1,186 @@
+/**
+ * @brief Lock-free bounded rings that decouple log calls from sink I/O
+*/
+
+#ifndef ARDEBUG_RING_H
+#define ARDEBUG_RING_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <atomic>
+
+namespace ardebug {
+
+/**
+ * @brief A bounded multi-producer/single-consumer ring of fixed-size slots.
+ *
+ * Producers reserve a slot with a compare-and-swap on the write index and
+ * publish it through a per-slot sequence number (D. Vyukov's bounded queue),
+ * so a log call never blocks and never waits on a sink. The consumer is the
+ * drain step, which peeks the oldest published slot and releases it after
+ * the sinks have been written.
+ *
+ * Slots are filled in place: `claim()` hands out the slot and `publish()`
+ * makes it visible, which avoids a second copy of the record.
+*/
+template <typename T, size_t N>
+class LogRing {
+  static_assert(N >= 2 && (N & (N - 1)) == 0, "LogRing size must be a power of 2");
+
+  private:
+    struct Slot {
+      std::atomic<size_t> seq;
+      T item;
+    };
+    Slot slots_[N];
+    std::atomic<size_t> head_;
+    std::atomic<size_t> tail_;
+    std::atomic<uint32_t> dropped_;
+    std::atomic<uint32_t> overflows_;
+    std::atomic<bool> overflowing_;
+
+  public:
+    LogRing() : head_(0), tail_(0), dropped_(0), overflows_(0), overflowing_(false) {
+      for (size_t i = 0; i < N; i++) slots_[i].seq.store(i, std::memory_order_relaxed);
+    }
+    LogRing(const LogRing&) = delete;
+    void operator=(const LogRing&) = delete;
+
+    /**
+     * @brief Reserve the next free slot for writing.
+     * @param ticket Set to the value to pass to `publish()`
+     * @return The slot to fill, or nullptr if the ring is full (counted as a drop)
+    */
+    T* claim(size_t* ticket) {
+      size_t pos = head_.load(std::memory_order_relaxed);
+      for (;;) {
+        Slot* slot = &slots_[pos & (N - 1)];
+        size_t seq = slot->seq.load(std::memory_order_acquire);
+        intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+        if (diff == 0) {
+          if (head_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+            *ticket = pos;
+            return &slot->item;
+          }
+        } else if (diff < 0) {
+          dropped_.fetch_add(1, std::memory_order_relaxed);
+          if (!overflowing_.exchange(true, std::memory_order_relaxed))
+            overflows_.fetch_add(1, std::memory_order_relaxed);
+          return nullptr;
+        } else {
+          pos = head_.load(std::memory_order_relaxed);
+        }
+      }
+    }
+
+    /** @brief Make a claimed slot visible to the consumer. */
+    void publish(size_t ticket) {
+      slots_[ticket & (N - 1)].seq.store(ticket + 1, std::memory_order_release);
+    }
+
+    /** @brief The oldest published slot, or nullptr if none is ready. */
+    T* peek() {
+      size_t pos = tail_.load(std::memory_order_relaxed);
+      Slot* slot = &slots_[pos & (N - 1)];
+      if (slot->seq.load(std::memory_order_acquire) != pos + 1) return nullptr;
+      return &slot->item;
+    }
+
+    /** @brief Return the slot obtained by `peek()` to the producers. */
+    void release() {
+      size_t pos = tail_.load(std::memory_order_relaxed);
+      slots_[pos & (N - 1)].seq.store(pos + N, std::memory_order_release);
+      tail_.store(pos + 1, std::memory_order_relaxed);
+      overflowing_.store(false, std::memory_order_relaxed);
+    }
+
+    /** @brief Approximate number of claimed slots. */
+    size_t size() const {
+      return head_.load(std::memory_order_relaxed) - tail_.load(std::memory_order_relaxed);
+    }
+    static constexpr size_t capacity() { return N; }
+    /** @brief Records rejected because the ring was full. */
+    uint32_t dropped() const { return dropped_.load(std::memory_order_relaxed); }
+    /** @brief Number of times the ring filled up (one per overflow episode). */
+    uint32_t overflows() const { return overflows_.load(std::memory_order_relaxed); }
+};
+
+/**
+ * @brief A bounded ring that tasks and interrupt handlers write without waiting.
+ *
+ * A writer takes the next position with one atomic add, so it never loops
+ * or waits, even when an interrupt of higher priority or the other core
+ * writes at the same time. Each slot carries a sequence number that is odd
+ * while the slot is written, so the reader can tell a finished slot from
+ * one still being written or overwritten. When the reader falls more than
+ * N records behind, the oldest are overwritten and counted as dropped.
+*/
+template <typename T, size_t N>
+class OverwriteRing {
+  static_assert(N >= 2 && (N & (N - 1)) == 0, "OverwriteRing size must be a power of 2");
+
+  private:
+    struct Slot {
+      std::atomic<uint32_t> seq;
+      T record;
+    };
+    Slot slots_[N];
+    std::atomic<uint32_t> head_;
+    uint32_t tail_ = 0;  // reader only
+    uint32_t dropped_ = 0;
+
+  public:
+    OverwriteRing() : head_(0) {
+      for (size_t i = 0; i < N; i++) slots_[i].seq.store(0, std::memory_order_relaxed);
+    }
+    OverwriteRing(const OverwriteRing&) = delete;
+    void operator=(const OverwriteRing&) = delete;
+
+    /** @brief Reserve a slot for a record, written in place then published. */
+    inline __attribute__((always_inline)) T* claim(uint32_t* ticket) {
+      uint32_t pos = head_.fetch_add(1, std::memory_order_relaxed);
+      Slot& slot = slots_[pos & (N - 1)];
+      slot.seq.store(2 * pos + 1, std::memory_order_relaxed);
+      std::atomic_thread_fence(std::memory_order_release);
+      *ticket = pos;
+      return &slot.record;
+    }
+
+    inline __attribute__((always_inline)) void publish(uint32_t ticket) {
+      slots_[ticket & (N - 1)].seq.store(2 * ticket + 2, std::memory_order_release);
+    }
+
+    /**
+     * @brief Copy out the oldest finished record.
+     * @return false if there is none, or the oldest is still being written
+    */
+    bool pop(T& record) {
+      for (;;) {
+        uint32_t head = head_.load(std::memory_order_acquire);
+        if (head == tail_) return false;
+        if (head - tail_ > N) {  // lapped by the writers
+          dropped_ += head - tail_ - N;
+          tail_ = head - N;
+        }
+        Slot& slot = slots_[tail_ & (N - 1)];
+        uint32_t seq = slot.seq.load(std::memory_order_acquire);
+        if (seq != 2 * tail_ + 2) {
+          if ((int32_t)(seq - (2 * tail_ + 2)) < 0) return false;  // not written yet
+          continue;  // overwritten, skip ahead
+        }
+        memcpy(&record, &slot.record, sizeof(record));
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (slot.seq.load(std::memory_order_relaxed) != seq) continue;  // overwritten while copied
+        tail_++;
+        return true;
+      }
+    }
+
+    /** @brief Records overwritten before they were read. */
+    uint32_t dropped() const { return dropped_; }
+};
+
+} // namespace ardebug
+
+#endif // ARDEBUG_RING_H
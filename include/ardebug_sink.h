@@ -0,0 +1,72 @@
+/**
+ * @brief Log records and the interface of an output sink
+*/
+
+#ifndef ARDEBUG_SINK_H
+#define ARDEBUG_SINK_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace ardebug {
+
+struct CallSite;
+
+/**
+ * @brief One log line as handed to the sinks.
+ * The fields travel with the standard formatted line, so a sink can write
+ * the line as is or lay out its own from the fields and the message span.
+*/
+struct LogRecord {
+  int8_t level;  // ARDEBUG_E..ARDEBUG_V, -1 for ardprintf() output and notices
+  uint32_t millis;
+  uint8_t core;
+  const CallSite* site;  // nullptr for ardprintf() output and notices, strings PROGMEM on AVR
+  LineBuilder* line;  // the standard line, prefix and message
+  size_t message;  // offset of the message in the line
+
+  const char* text() const { return line->text(); }
+  size_t length() const { return line->length(); }
+  const char* messageText() const { return line->text() + message; }
+  size_t messageLength() const { return line->length() - message; }
+  /** @brief The line wrapped in `color` and a reset code, in place */
+  const char* colored(const char* color, size_t* len) const { return line->colored(color, len); }
+};
+
+/**
+ * @brief An output registered with DebugContext::addSink().
+ * Records are passed only if their level is at or below `maxLevel()`.
+*/
+class Sink {
+  protected:
+    uint8_t level_ = ARDEBUG_I;
+#if defined(ARDEBUG_STATS)
+    uint32_t offered_lines_ = 0;  // passed to write(), before a queue may drop them
+    uint32_t offered_bytes_ = 0;
+    friend class DebugContext;
+#endif
+
+  public:
+    virtual ~Sink() {}
+    virtual void write(const LogRecord& record) = 0;
+    /** @brief Bytes that are not a log line (binary frames, history), ignored by default */
+    virtual void writeRaw(const uint8_t* /* data */, size_t /* len */, int8_t /* level */) {}
+    /** @brief Periodic work, from handle() or the drain step */
+    virtual void poll() {}
+    /** @brief Most verbose level written now, -1 while there is nowhere to write */
+    virtual int8_t maxLevel() { return level_; }
+    uint8_t level() const { return level_; }
+    /** @brief Call DebugContext::updateLogLevel() after changing a registered sink */
+    virtual void setLevel(uint8_t level) { level_ = level; }
+    /** @brief Shown in the telnet `stats` output */
+    virtual const char* name() const { return "sink"; }
+#if defined(ARDEBUG_STATS)
+    /** @brief Lines and bytes passed to the sink, including any its queue dropped */
+    uint32_t offeredLines() const { return offered_lines_; }
+    uint32_t offeredBytes() const { return offered_bytes_; }
+#endif
+};
+
+} // namespace ardebug
+
+#endif // ARDEBUG_SINK_H
@@ -0,0 +1,24 @@
+/**
+ * @brief Counters of what the library wrote, for logging budgets
+*/
+
+#ifndef ARDEBUG_STATS_H
+#define ARDEBUG_STATS_H
+
+#include <stdint.h>
+
+#define ARDEBUG_STATS_LEVELS (ARDEBUG_V + 2)  // the last one for output without a level
+
+namespace ardebug {
+
+/** @brief A copy of the counters, see DebugContext::stats() */
+struct DebugStats {
+  uint32_t lines[ARDEBUG_STATS_LEVELS];  // per level, ardprintf() output and notices last
+  uint32_t bytes[ARDEBUG_STATS_LEVELS];  // including raw output such as binary frames
+  uint32_t truncated;  // lines cut at the buffer (or arena) size
+  uint32_t dropped;  // lines lost to full queues and rings
+};
+
+} // namespace ardebug
+
+#endif // ARDEBUG_STATS_H
@@ -0,0 +1,41 @@
+/**
+ * @brief Timeline events for Chrome Trace / Perfetto, kept in a binary ring
+*/
+
+#ifndef ARDEBUG_TRACE_H
+#define ARDEBUG_TRACE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "ardebug_ring.h"
+
+namespace ardebug {
+
+/** @brief One trace event, turned into Trace Event JSON when it is read */
+struct TraceEvent {
+  const char* name;  // string literal
+  uint32_t stamp;  // micros()
+  uint32_t task;  // track on the core, 0 for interrupt handlers
+  int32_t value;  // counter events
+  char phase;  // 'B'egin, 'E'nd, 'i'nstant or 'C'ounter
+  uint8_t core;
+};
+
+/** @brief Record an event, from a task or an interrupt handler, see AR_TRACE_BEGIN() */
+void traceEvent(char phase, const char* name, int32_t value = 0);
+
+/** @brief A begin event now and the matching end event when it goes out of scope */
+class TraceScope {
+  private:
+    const char* name_;
+
+  public:
+    explicit TraceScope(const char* name) : name_(name) { traceEvent('B', name); }
+    ~TraceScope() { traceEvent('E', name_); }
+    TraceScope(const TraceScope&) = delete;
+    void operator=(const TraceScope&) = delete;
+};
+
+} // namespace ardebug
+
+#endif // ARDEBUG_TRACE_H
@@ -7,10 +7,15 @@
 
 #if defined(ESP32) || defined(ESP8266)
 #define BOARD_WIFI
+#define BOARD_FS
+#define BOARD_ISR_ATTR IRAM_ATTR  // code run by interrupt handlers
+#include <FS.h>
 #include <DNSServer.h>
 // #include <Print.h>
 #if defined(ESP32)
 #define BOARD_MULTI_CORE
+#define BOARD_CORES portNUM_PROCESSORS
+#define BOARD_NOINIT RTC_NOINIT_ATTR  // RTC slow memory, kept over a reset
 #include <WiFi.h>
 #include <ESPmDNS.h>
 #else
@@ -18,8 +23,24 @@
 #include <ESP8266mDNS.h>
 extern "C" { bool system_update_cpu_freq(uint8_t freq); }
 #endif
+#elif defined(ARDEBUG_NATIVE)  // host build, see native/
+#define BOARD_WIFI
+#define BOARD_FS
+#define BOARD_NOINIT  // static memory, kept until the process exits
+#include <WiFi.h>
+#include <FS.h>
 #else
 #define BOARD_LOW_MEMORY
+#if defined(__AVR__)
+#define BOARD_PROGMEM  // constant data is copied to RAM unless it is PROGMEM
+#endif
+#endif
+
+#ifndef BOARD_CORES
+#define BOARD_CORES 1
+#endif
+#ifndef BOARD_ISR_ATTR
+#define BOARD_ISR_ATTR
 #endif
 
 #endif
\ No newline at end of file
@@ -0,0 +1,36 @@
+#include <chrono>
+#include <thread>
+#include "Arduino.h"
+#include "FS.h"
+
+HardwareSerial Serial;
+fs::FS HostFS(".");
+
+static const std::chrono::steady_clock::time_point start_ =
+    std::chrono::steady_clock::now();
+
+unsigned long millis() {
+  return std::chrono::duration_cast<std::chrono::milliseconds>(
+      std::chrono::steady_clock::now() - start_).count();
+}
+
+unsigned long micros() {
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+      std::chrono::steady_clock::now() - start_).count();
+}
+
+void delay(unsigned long ms) {
+  std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+void yield() { std::this_thread::yield(); }
+
+// the unit tests under test/ have their own
+#ifndef PIO_UNIT_TESTING
+int main() {
+  setup();
+  for (;;) {
+    loop();
+  }
+}
+#endif
@@ -0,0 +1,107 @@
+/**
+ * @brief Minimal Arduino core stand-ins for the native (host) build
+*/
+
+#ifndef ARDUINO_NATIVE_H
+#define ARDUINO_NATIVE_H
+
+#include <ctype.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+
+typedef bool boolean;
+
+#define LOW 0
+#define HIGH 1
+#define INPUT 0
+#define OUTPUT 1
+#define LED_BUILTIN 2
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void yield();
+inline void pinMode(uint8_t, uint8_t) {}
+inline void digitalWrite(uint8_t, uint8_t) {}
+inline int digitalRead(uint8_t) { return LOW; }
+
+inline bool isPrintable(int c) { return isprint(c) != 0; }
+
+// flash is ordinary memory on the host
+#define PROGMEM
+#define PSTR(s) (s)
+class __FlashStringHelper;
+#define F(s) (reinterpret_cast<const __FlashStringHelper*>(PSTR(s)))
+#define pgm_read_byte(p) (*(const uint8_t*)(p))
+#define memcpy_P memcpy
+#define strlen_P strlen
+#define vsnprintf_P vsnprintf
+
+class String {
+  private:
+    std::string s_;
+  public:
+    String(const char* str = "") : s_(str ? str : "") {}
+    bool concat(const char* str) { s_ += str; return true; }
+    bool concat(const String& str) { s_ += str.s_; return true; }
+    bool concat(uint32_t n) { s_ += std::to_string(n); return true; }
+    const char* c_str() const { return s_.c_str(); }
+    unsigned int length() const { return s_.length(); }
+};
+
+class Print {
+  public:
+    virtual ~Print() {}
+    virtual size_t write(uint8_t c) = 0;
+    virtual size_t write(const uint8_t* buffer, size_t size) {
+      size_t n = 0;
+      while (size--) n += write(*buffer++);
+      return n;
+    }
+    size_t write(const char* buffer, size_t size) {
+      return write((const uint8_t*)buffer, size);
+    }
+    virtual int availableForWrite() { return 0; }
+    virtual void flush() {}
+    size_t print(const char* str) { return write(str, strlen(str)); }
+    size_t print(const String& str) { return print(str.c_str()); }
+    size_t print(long n) { return print(std::to_string(n).c_str()); }
+    size_t println(const char* str = "") { return print(str) + print("\r\n"); }
+    size_t println(const String& str) { return println(str.c_str()); }
+    size_t println(long n) { return print(n) + print("\r\n"); }
+};
+
+class Stream : public Print {
+  public:
+    virtual int available() = 0;
+    virtual int read() = 0;
+    virtual int peek() = 0;
+};
+
+/** @brief Serial is stdout/stdin of the host process */
+class HardwareSerial : public Stream {
+  public:
+    void begin(unsigned long) {}
+    size_t write(uint8_t c) override { return fwrite(&c, 1, 1, stdout); }
+    size_t write(const uint8_t* buffer, size_t size) override {
+      return fwrite(buffer, 1, size, stdout);
+    }
+    using Print::write;
+    int availableForWrite() override { return 4096; }
+    void flush() override { fflush(stdout); }
+    int available() override { return 0; }
+    int read() override { return -1; }
+    int peek() override { return -1; }
+};
+
+extern HardwareSerial Serial;
+
+// sketch entry points, called by main() in Arduino.cpp
+void setup();
+void loop();
+
+#endif // ARDUINO_NATIVE_H
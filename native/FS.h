@@ -0,0 +1,65 @@
+/**
+ * @brief fs::FS stand-in for the native (host) build, backed by stdio
+*/
+
+#ifndef FS_NATIVE_H
+#define FS_NATIVE_H
+
+#include <memory>
+#include <string>
+#include "Arduino.h"
+
+namespace fs {
+
+class File {
+  private:
+    std::shared_ptr<FILE> file_;
+
+  public:
+    File() {}
+    explicit File(FILE* file) : file_(file, fclose) {}
+    operator bool() const { return (bool)file_; }
+    size_t write(const uint8_t* buffer, size_t size) {
+      return file_ ? fwrite(buffer, 1, size, file_.get()) : 0;
+    }
+    size_t size() {
+      if (!file_) return 0;
+      long pos = ftell(file_.get());
+      fseek(file_.get(), 0, SEEK_END);
+      long end = ftell(file_.get());
+      fseek(file_.get(), pos, SEEK_SET);
+      return end > 0 ? (size_t)end : 0;
+    }
+    void flush() { if (file_) fflush(file_.get()); }
+    void close() { file_.reset(); }
+};
+
+/** @brief Paths are relative to a host directory */
+class FS {
+  private:
+    std::string root_;
+    std::string path(const char* p) const { return root_ + (*p == '/' ? "" : "/") + p; }
+
+  public:
+    explicit FS(const char* root) : root_(root) {}
+    File open(const char* p, const char* mode = "r") {
+      FILE* f = fopen(path(p).c_str(), mode);
+      return f ? File(f) : File();
+    }
+    bool exists(const char* p) {
+      FILE* f = fopen(path(p).c_str(), "r");
+      if (f) fclose(f);
+      return f != nullptr;
+    }
+    bool remove(const char* p) { return ::remove(path(p).c_str()) == 0; }
+    bool rename(const char* from, const char* to) {
+      return ::rename(path(from).c_str(), path(to).c_str()) == 0;
+    }
+};
+
+} // namespace fs
+
+/** @brief The current working directory */
+extern fs::FS HostFS;
+
+#endif // FS_NATIVE_H
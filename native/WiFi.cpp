@@ -0,0 +1,116 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include "WiFi.h"
+
+WiFiClass WiFi;
+
+WiFiClient::Socket::~Socket() {
+  if (fd >= 0) close(fd);
+}
+
+WiFiClient::WiFiClient(int fd) : socket_(new Socket(fd)) {
+  fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+}
+
+uint8_t WiFiClient::connected() {
+  if (!socket_ || socket_->fd < 0) return 0;
+  char c;
+  ssize_t n = recv(socket_->fd, &c, 1, MSG_PEEK | MSG_DONTWAIT);
+  if (n == 0) return 0;
+  if (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK) return 0;
+  return 1;
+}
+
+int WiFiClient::available() {
+  if (!socket_ || socket_->fd < 0) return 0;
+  int n = 0;
+  if (ioctl(socket_->fd, FIONREAD, &n) < 0) return 0;
+  return n;
+}
+
+int WiFiClient::read() {
+  unsigned char c;
+  if (!socket_ || socket_->fd < 0) return -1;
+  return recv(socket_->fd, &c, 1, MSG_DONTWAIT) == 1 ? c : -1;
+}
+
+int WiFiClient::peek() {
+  unsigned char c;
+  if (!socket_ || socket_->fd < 0) return -1;
+  return recv(socket_->fd, &c, 1, MSG_PEEK | MSG_DONTWAIT) == 1 ? c : -1;
+}
+
+uint32_t WiFiClient::sends = 0;
+
+size_t WiFiClient::write(const uint8_t* buffer, size_t size) {
+  if (!socket_ || socket_->fd < 0) return 0;
+  sends++;
+  ssize_t n = send(socket_->fd, buffer, size, MSG_NOSIGNAL | MSG_DONTWAIT);
+  return n > 0 ? (size_t)n : 0;
+}
+
+int WiFiClient::availableForWrite() {
+  if (!socket_ || socket_->fd < 0) return 0;
+  int size = 0;
+  int queued = 0;
+  socklen_t len = sizeof(size);
+  if (getsockopt(socket_->fd, SOL_SOCKET, SO_SNDBUF, &size, &len) < 0) return 0;
+  if (ioctl(socket_->fd, TIOCOUTQ, &queued) < 0) return 0;
+  return size > queued ? size - queued : 0;
+}
+
+int WiFiClient::setNoDelay(bool nodelay) {
+  if (!socket_ || socket_->fd < 0) return -1;
+  int flag = nodelay ? 1 : 0;
+  return setsockopt(socket_->fd, IPPROTO_TCP, TCP_NODELAY, &flag, sizeof(flag));
+}
+
+void WiFiClient::stop() {
+  if (socket_ && socket_->fd >= 0) {
+    close(socket_->fd);
+    socket_->fd = -1;
+  }
+  socket_.reset();
+}
+
+void WiFiServer::begin() {
+  if (fd_ >= 0) return;
+  fd_ = socket(AF_INET, SOCK_STREAM, 0);
+  if (fd_ < 0) return;
+  int on = 1;
+  setsockopt(fd_, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+  sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  addr.sin_port = htons(port_);
+  if (bind(fd_, (sockaddr*)&addr, sizeof(addr)) < 0 || listen(fd_, 4) < 0) {
+    close(fd_);
+    fd_ = -1;
+    return;
+  }
+  fcntl(fd_, F_SETFL, fcntl(fd_, F_GETFL, 0) | O_NONBLOCK);
+}
+
+void WiFiServer::stop() {
+  if (pending_ >= 0) close(pending_);
+  if (fd_ >= 0) close(fd_);
+  pending_ = -1;
+  fd_ = -1;
+}
+
+bool WiFiServer::hasClient() {
+  if (pending_ < 0 && fd_ >= 0) pending_ = accept(fd_, nullptr, nullptr);
+  return pending_ >= 0;
+}
+
+WiFiClient WiFiServer::available() {
+  if (!hasClient()) return WiFiClient();
+  int fd = pending_;
+  pending_ = -1;
+  return WiFiClient(fd);
+}
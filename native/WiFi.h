@@ -0,0 +1,73 @@
+/**
+ * @brief WiFi stand-ins for the native (host) build, backed by TCP sockets
+*/
+
+#ifndef WIFI_NATIVE_H
+#define WIFI_NATIVE_H
+
+#include <memory>
+#include "Arduino.h"
+
+class IPAddress {
+  public:
+    String toString() const { return String("127.0.0.1"); }
+    uint8_t operator[](int index) const { return index == 0 ? 127 : index == 3 ? 1 : 0; }
+};
+
+class WiFiClass {
+  public:
+    bool isConnected() { return true; }
+    IPAddress localIP() { return IPAddress(); }
+    String macAddress() { return String("00:00:00:00:00:00"); }
+    uint8_t* macAddress(uint8_t* mac) { memset(mac, 0, 6); return mac; }
+    bool hostname(const String&) { return true; }
+};
+
+extern WiFiClass WiFi;
+
+/** @brief A non-blocking TCP connection, shared by copies like the ESP32 client */
+class WiFiClient : public Stream {
+  private:
+    struct Socket {
+      int fd;
+      explicit Socket(int fd) : fd(fd) {}
+      ~Socket();
+    };
+    std::shared_ptr<Socket> socket_;
+
+  public:
+    WiFiClient() {}
+    explicit WiFiClient(int fd);
+    uint8_t connected();
+    operator bool() { return connected(); }
+    int available() override;
+    int read() override;
+    int peek() override;
+    size_t write(uint8_t c) override { return write(&c, 1); }
+    size_t write(const uint8_t* buffer, size_t size) override;
+    using Print::write;
+    /** @brief Free space in the socket send buffer */
+    int availableForWrite() override;
+    int setNoDelay(bool nodelay);
+    void stop();
+    /** @brief send() calls of all clients, counted for the benchmark */
+    static uint32_t sends;
+};
+
+/** @brief Listens on the loopback interface */
+class WiFiServer {
+  private:
+    uint16_t port_;
+    int fd_ = -1;
+    int pending_ = -1;
+
+  public:
+    WiFiServer(uint16_t port = 23, uint8_t /* max_clients */ = 4) : port_(port) {}
+    ~WiFiServer() { stop(); }
+    void begin();
+    void stop();
+    bool hasClient();
+    WiFiClient available();
+};
+
+#endif // WIFI_NATIVE_H
@@ -0,0 +1,37 @@
+#include <stdio.h>
+#include <map>
+#include <string>
+#include "Arduino.h"
+#include "esp_log.h"
+
+static vprintf_like_t log_vprintf = vprintf;
+static esp_log_level_t default_level = (esp_log_level_t)CONFIG_LOG_DEFAULT_LEVEL;
+static std::map<std::string, esp_log_level_t> tag_levels;
+
+vprintf_like_t esp_log_set_vprintf(vprintf_like_t func) {
+  vprintf_like_t previous = log_vprintf;
+  log_vprintf = func;
+  return previous;
+}
+
+void esp_log_level_set(const char* tag, esp_log_level_t level) {
+  if (strcmp(tag, "*") == 0) {
+    default_level = level;
+    tag_levels.clear();
+  } else {
+    tag_levels[tag] = level;
+  }
+}
+
+uint32_t esp_log_timestamp() {
+  return (uint32_t)millis();
+}
+
+void esp_log_write(esp_log_level_t level, const char* tag, const char* format, ...) {
+  std::map<std::string, esp_log_level_t>::const_iterator it = tag_levels.find(tag);
+  if (level > (it != tag_levels.end() ? it->second : default_level)) return;
+  va_list args;
+  va_start(args, format);
+  log_vprintf(format, args);
+  va_end(args);
+}
@@ -0,0 +1,63 @@
+/**
+ * @brief ESP-IDF logging stand-ins for the native (host) build
+ *
+ * ESP_LOGx() pass the same format and arguments to the installed vprintf
+ * function as ESP-IDF: "<color>L (%u) %s: <format><reset>\n", the
+ * timestamp, the tag, then the caller's arguments. Colors are added with
+ * CONFIG_LOG_COLORS=1 as in sdkconfig.
+*/
+
+#ifndef ESP_LOG_NATIVE_H
+#define ESP_LOG_NATIVE_H
+
+#include <stdarg.h>
+#include <stdint.h>
+
+#ifndef CONFIG_LOG_DEFAULT_LEVEL
+#define CONFIG_LOG_DEFAULT_LEVEL 3  // ESP_LOG_INFO
+#endif
+
+typedef enum {
+  ESP_LOG_NONE,
+  ESP_LOG_ERROR,
+  ESP_LOG_WARN,
+  ESP_LOG_INFO,
+  ESP_LOG_DEBUG,
+  ESP_LOG_VERBOSE
+} esp_log_level_t;
+
+typedef int (*vprintf_like_t)(const char*, va_list);
+
+/** @brief Install the function that writes log output, returns the previous one */
+vprintf_like_t esp_log_set_vprintf(vprintf_like_t func);
+/** @brief Level of a tag, or of every tag for "*" */
+void esp_log_level_set(const char* tag, esp_log_level_t level);
+uint32_t esp_log_timestamp();
+void esp_log_write(esp_log_level_t level, const char* tag, const char* format, ...);
+
+#if defined(CONFIG_LOG_COLORS) && CONFIG_LOG_COLORS
+#define LOG_COLOR(COLOR) "\033[0;" COLOR "m"
+#define LOG_RESET_COLOR "\033[0m"
+#define LOG_COLOR_E LOG_COLOR("31")
+#define LOG_COLOR_W LOG_COLOR("33")
+#define LOG_COLOR_I LOG_COLOR("32")
+#else
+#define LOG_RESET_COLOR
+#define LOG_COLOR_E
+#define LOG_COLOR_W
+#define LOG_COLOR_I
+#endif
+#define LOG_COLOR_D
+#define LOG_COLOR_V
+
+#define LOG_FORMAT(letter, format) LOG_COLOR_ ## letter #letter " (%u) %s: " format LOG_RESET_COLOR "\n"
+
+#define ESP_LOG_LEVEL(level, letter, tag, format, ...) \
+    esp_log_write(level, tag, LOG_FORMAT(letter, format), esp_log_timestamp(), tag, ##__VA_ARGS__)
+#define ESP_LOGE(tag, format, ...) ESP_LOG_LEVEL(ESP_LOG_ERROR, E, tag, format, ##__VA_ARGS__)
+#define ESP_LOGW(tag, format, ...) ESP_LOG_LEVEL(ESP_LOG_WARN, W, tag, format, ##__VA_ARGS__)
+#define ESP_LOGI(tag, format, ...) ESP_LOG_LEVEL(ESP_LOG_INFO, I, tag, format, ##__VA_ARGS__)
+#define ESP_LOGD(tag, format, ...) ESP_LOG_LEVEL(ESP_LOG_DEBUG, D, tag, format, ##__VA_ARGS__)
+#define ESP_LOGV(tag, format, ...) ESP_LOG_LEVEL(ESP_LOG_VERBOSE, V, tag, format, ##__VA_ARGS__)
+
+#endif // ESP_LOG_NATIVE_H
@@ -3,210 +3,1510 @@
 #ifndef ARDEBUG_DISABLED
 // #if defined(ARDEBUG_ENABLE)
 
+#if defined(ARDEBUG_ASYNC)
+#include "ardebug_ring.h"
+#endif
+#if defined(BOARD_WIFI)
+#include "ardebug_format.h"  // checks the formats of the telnet replies
+#endif
+#if defined(ARDEBUG_FILE) && !defined(ARDEBUG_NATIVE)
+#include <LittleFS.h>
+#endif
+#if defined(ARDEBUG_HISTORY) && defined(ESP32)
+#include <esp_system.h>
+#endif
+#if defined(ARDEBUG_QUEUE) && defined(ESP32) && defined(BOARD_WIFI)
+#include <lwip/sockets.h>
+#endif
+#if defined(ARDEBUG_ESP_LOG)
+#include <esp_log.h>
+#endif
+
 namespace ardebug {
 
+#if defined(BOARD_MULTI_CORE)
+// Held while the sinks are written or reconfigured: by the drain task,
+// handle() and configuration calls, and without ARDEBUG_ASYNC by log calls.
+// Queued log calls only touch their own core's staging ring.
+static SemaphoreHandle_t sink_mutex = nullptr;
+
+class SinkLock {
+  public:
+    SinkLock() { if (sink_mutex) xSemaphoreTakeRecursive(sink_mutex, portMAX_DELAY); }
+    ~SinkLock() { if (sink_mutex) xSemaphoreGiveRecursive(sink_mutex); }
+};
+#else
+class SinkLock {
+  public:
+    SinkLock() {}
+};
+#endif // BOARD_MULTI_CORE
+
+#if defined(ARDEBUG_FLEXBUFFER) && defined(ARDEBUG_NO_HEAP)
+static char flex_arena[ARDEBUG_FLEXBUFFER_ARENA];
+static boolean flex_arena_busy = false;  // a sink that logs gets the truncated line
+#endif
+
+#if defined(ARDEBUG_QUEUE)
+static ConfigByte queue_policy{ARDEBUG_QUEUE_POLICY};
+static std::atomic<uint32_t> queue_block_ms{ARDEBUG_QUEUE_BLOCK_MS};
+
+static int streamSpace(Print& out) {
+  return out.availableForWrite();
+}
+#endif
+
+/** @brief Serial/USB output */
+class SerialSink : public Sink {
+  public:
+    Stream* stream = nullptr;
+    boolean enabled = false;
+#if defined(ARDEBUG_QUEUE)
+    OutputQueue queue;
+#endif
+
+    void write(const LogRecord& record) override {
+      writeRaw((const uint8_t*)record.text(), record.length(), record.level);
+    }
+    void writeRaw(const uint8_t* data, size_t len, int8_t level) override {
+      (void)level;
+#if defined(ARDEBUG_QUEUE)
+      queue.write(*stream, streamSpace, data, len, queue_policy, queue_block_ms);
+#else
+      stream->write(data, len);
+#endif
+    }
+    void poll() override {
+#if defined(ARDEBUG_QUEUE)
+      if (stream) queue.pump(*stream, streamSpace);
+#endif
+    }
+    int8_t maxLevel() override { return enabled && stream ? (int8_t)level_ : -1; }
+    const char* name() const override { return "serial"; }
+};
+
+static SerialSink serial_sink;
+
 #if defined(BOARD_WIFI) // && !defined(ARDEBUG_WIFI_DISABLED)
-static WiFiServer server(ARDEBUG_TELNET_PORT, 1);  // @suppress("Abstract class cannot be instantiated")
-static WiFiClient client;
+static WiFiServer server(ARDEBUG_TELNET_PORT, ARDEBUG_TELNET_CLIENTS);  // @suppress("Abstract class cannot be instantiated")
+
+/** @brief A telnet connection with its own level, color and command state */
+struct TelnetSession {
+  WiFiClient client;
+  uint8_t level;
+  boolean color;
+  boolean password_ok;
+  boolean tracing;  // takes trace JSON instead of log lines
+  uint8_t password_attempt;
+  char cmd[ARDEBUG_CMD_BUFFER];
+#if defined(ARDEBUG_QUEUE)
+  OutputQueue queue;
+#endif
+#if defined(ARDEBUG_COALESCE)
+  uint8_t segment[ARDEBUG_COALESCE_SIZE];  // lines not sent yet
+  uint16_t segment_len;
+  uint16_t segment_lines;
+  uint32_t segment_since;  // millis() of the oldest line
 #endif
+#if defined(ARDEBUG_BACKLOG)
+  boolean replaying;  // sending the backlog, which also holds the live lines meanwhile
+  uint32_t replay;  // backlog position of the next record to send
+#endif
+
+  /** @brief True if a line of `level` (-1 if not known) goes to this client */
+  boolean accepts(int8_t lvl) {
+    return client && password_ok && !tracing && lvl <= (int8_t)level;
+  }
+};
+
+static TelnetSession sessions[ARDEBUG_TELNET_CLIENTS];
+
+#if defined(ARDEBUG_QUEUE)
+#if defined(ESP32)
+// WiFiClient::write() on ESP32 waits until the socket has taken everything,
+// so the queues write through this, which sends what fits now and leaves
+// the rest queued. There is no availableForWrite() either, but a socket that
+// selects as writable has at least one segment of send buffer free.
+class ClientOutput : public Print {
+  private:
+    int fd_;
+
+  public:
+    explicit ClientOutput(WiFiClient& client) : fd_(client.fd()) {}
+    size_t write(uint8_t c) override { return write(&c, 1); }
+    size_t write(const uint8_t* data, size_t len) override {
+      if (fd_ < 0) return 0;
+      int sent = send(fd_, data, len, MSG_DONTWAIT);
+      return sent > 0 ? (size_t)sent : 0;
+    }
+    int availableForWrite() override {
+      if (fd_ < 0) return 0;
+      fd_set set;
+      FD_ZERO(&set);
+      FD_SET(fd_, &set);
+      struct timeval timeout = {0, 0};
+      return select(fd_ + 1, nullptr, &set, nullptr, &timeout) > 0 ? ARDEBUG_COALESCE_SIZE : 0;
+    }
+};
+#else
+typedef WiFiClient& ClientOutput;  // reports its free space, writes within it do not wait
+#endif
+
+static int clientSpace(Print& out) {
+  return out.availableForWrite();
+}
+#endif // ARDEBUG_QUEUE
+
+static void sendClient(TelnetSession& session, const uint8_t* data, size_t len) {
+#if defined(ARDEBUG_QUEUE)
+  ClientOutput out(session.client);
+  session.queue.write(out, clientSpace, data, len, queue_policy, queue_block_ms);
+#else
+  session.client.write(data, len);
+#endif
+}
+
+#if defined(ARDEBUG_COALESCE)
+static uint32_t coalesce_segments = 0;
+static uint32_t coalesce_lines = 0;
+
+// one write for the whole segment while the client keeps up, otherwise
+// line by line into the queue, so a full queue still drops whole lines
+static void flushSegment(TelnetSession& session) {
+  size_t len = session.segment_len;
+  if (len == 0) return;
+  coalesce_segments++;
+  coalesce_lines += session.segment_lines;
+  session.segment_len = 0;
+  session.segment_lines = 0;
+  const uint8_t* data = session.segment;
+#if defined(ARDEBUG_QUEUE)
+  ClientOutput out(session.client);
+  if (session.queue.idle() && clientSpace(out) >= (int)len) {
+    size_t written = out.write(data, len);
+    data += written;
+    len -= written;
+  }
+  while (len > 0) {
+    const uint8_t* lf = (const uint8_t*)memchr(data, '\n', len);
+    size_t n = lf != nullptr ? lf - data + 1 : len;
+    sendClient(session, data, n);
+    data += n;
+    len -= n;
+  }
+#else
+  session.client.write(data, len);
+#endif
+}
+
+// a log line, held until the segment is full, ARDEBUG_COALESCE_MS old or
+// gets a warning or error
+static void coalesce(TelnetSession& session, const uint8_t* data, size_t len, int8_t level) {
+  if (session.segment_len + len > sizeof(session.segment)) flushSegment(session);
+  if (len > sizeof(session.segment)) {
+    sendClient(session, data, len);
+    return;
+  }
+  if (session.segment_len == 0) session.segment_since = millis();
+  memcpy(session.segment + session.segment_len, data, len);
+  session.segment_len += len;
+  session.segment_lines++;
+  if (level >= 0 && level <= ARDEBUG_W) flushSegment(session);
+}
+#endif // ARDEBUG_COALESCE
+
+// replies and other output of a session, after the log lines before them
+static void writeClient(TelnetSession& session, const uint8_t* data, size_t len) {
+#if defined(ARDEBUG_COALESCE)
+  flushSegment(session);
+#endif
+  sendClient(session, data, len);
+}
+
+// log lines of a session
+static void writeLog(TelnetSession& session, const uint8_t* data, size_t len, int8_t level) {
+#if defined(ARDEBUG_COALESCE)
+  coalesce(session, data, len, level);
+#else
+  (void)level;
+  sendClient(session, data, len);
+#endif
+}
+
+// text in flash, copied to the client through the stack
+static void writeClient_P(TelnetSession& session, const char* text) {
+  char buffer[64];
+  size_t len = strlen_P(text);
+  for (size_t done = 0; done < len; done += sizeof(buffer)) {
+    size_t n = len - done < sizeof(buffer) ? len - done : sizeof(buffer);
+    memcpy_P(buffer, text + done, n);
+    writeClient(session, (const uint8_t*)buffer, n);
+  }
+}
+
+static const char* debugColor(uint8_t level) {
+  switch (level) {
+    case ARDEBUG_V: return ARD_COLOR_V;
+    case ARDEBUG_D: return ARD_COLOR_D;
+    case ARDEBUG_I: return ARD_COLOR_I;
+    case ARDEBUG_W: return ARD_COLOR_W;
+    case ARDEBUG_E: return ARD_COLOR_E;
+    default: return ARD_COLOR_RESET;
+  }
+}
+
+#if defined(ARDEBUG_BACKLOG)
+static Backlog backlog;
+
+static void startReplay(TelnetSession& session) {
+  session.replay = backlog.begin();
+  session.replaying = session.replay != backlog.end();
+}
+
+// up to ARDEBUG_BACKLOG_CHUNK bytes per call, each once the client has
+// taken the last, then the session goes live
+static void replayBacklog(TelnetSession& session) {
+#if defined(ARDEBUG_QUEUE)
+  if (session.queue.size() > 0) return;
+#endif
+  if (backlog.lost(session.replay)) session.replay = backlog.begin();  // overtaken by new output
+  char buffer[ARDEBUG_COLOR_HEAD + ARDEBUG_BACKLOG_RECORD + ARDEBUG_COLOR_TAIL + 1];
+  size_t sent = 0;
+  while (sent < ARDEBUG_BACKLOG_CHUNK && session.replay != backlog.end()) {
+    int8_t level;
+    bool raw;
+    size_t len;
+    session.replay = backlog.read(session.replay, &level, &raw,
+                                  (uint8_t*)buffer + ARDEBUG_COLOR_HEAD, &len);
+    if (level > (int8_t)session.level) continue;
+    const char* data = buffer + ARDEBUG_COLOR_HEAD;
+    if (!raw && session.color && level >= ARDEBUG_E) {
+      LineBuilder line(buffer, sizeof(buffer), len);
+      data = line.colored(debugColor(level), &len);
+    }
+    writeLog(session, (const uint8_t*)data, len, level);
+    sent += len;
+  }
+  if (session.replay == backlog.end()) session.replaying = false;
+}
+#endif // ARDEBUG_BACKLOG
+
+/**
+ * @brief Telnet output, fanned out to the sessions whose level accepts a record.
+ * Its own level is the one new sessions start with.
+*/
+class TelnetSink : public Sink {
+  public:
+    void write(const LogRecord& record) override {
+      const char* colored = nullptr;
+      size_t colored_len = 0;
+      for (TelnetSession& session : sessions) {
+        if (!session.accepts(record.level)) continue;
+#if defined(ARDEBUG_BACKLOG)
+        if (session.replaying) continue;
+#endif
+        if (session.color && record.level >= ARDEBUG_E) {
+          if (colored == nullptr) colored = record.colored(debugColor(record.level), &colored_len);
+          writeLog(session, (const uint8_t*)colored, colored_len, record.level);
+        } else {
+          writeLog(session, (const uint8_t*)record.text(), record.length(), record.level);
+        }
+      }
+    }
+    void writeRaw(const uint8_t* data, size_t len, int8_t level) override {
+      for (TelnetSession& session : sessions) {
+#if defined(ARDEBUG_BACKLOG)
+        if (session.replaying) continue;
+#endif
+        if (session.accepts(level)) writeLog(session, data, len, level);
+      }
+    }
+    void poll() override {
+      for (TelnetSession& session : sessions) {
+        if (!session.client) continue;
+#if defined(ARDEBUG_COALESCE)
+        if (session.segment_len > 0 && millis() - session.segment_since >= ARDEBUG_COALESCE_MS) {
+          flushSegment(session);
+        }
+#endif
+#if defined(ARDEBUG_QUEUE)
+        ClientOutput out(session.client);
+        session.queue.pump(out, clientSpace);
+#endif
+#if defined(ARDEBUG_BACKLOG)
+        if (session.replaying && session.accepts(-1)) replayBacklog(session);
+#endif
+      }
+    }
+    int8_t maxLevel() override {
+      int8_t level = -1;
+      for (TelnetSession& session : sessions) {
+        if (session.accepts(-1) && (int8_t)session.level > level) {
+          level = session.level;
+        }
+      }
+      return level;
+    }
+    const char* name() const override { return "telnet"; }
+};
+
+static TelnetSink telnet_sink;
+#endif // BOARD_WIFI
+
+#if defined(ARDEBUG_FILE)
+static FileSink file_sink;
+#endif
+
+#if defined(ARDEBUG_HISTORY)
+static BOARD_NOINIT HistoryRegion history_region;
+static History history(history_region);
+#endif
+
+#if defined(ARDEBUG_ASYNC)
+struct AsyncRecord {
+  const CallSite* site;  // nullptr for ardprintf output
+  boolean packed;  // deferred record, line holds packed arguments
+  uint32_t stamp;  // micros(), orders records of different cores
+  uint32_t millis;
+  uint8_t core;
+  int8_t level;  // -1 if not known (ardprintf output)
+  uint16_t len;
+  uint16_t message;  // offset of the message in line
+  char line[ARDEBUG_LINE_SIZE];
+};
+
+typedef LogRing<AsyncRecord, ARDEBUG_ASYNC_SLOTS> AsyncRing;
+
+// one staging ring per core, so the cores never contend for a slot
+static AsyncRing async_rings[BOARD_CORES];
+
+#if defined(ARDEBUG_DEFERRED)
+static const CallSite* sent_sites[ARDEBUG_DEFERRED_SITE_CACHE] = {0};
+#endif
+
+#if defined(ARDEBUG_ASYNC_TASK)
+static TaskHandle_t drain_task = nullptr;
+
+static void drainTask(void* param) {
+  DebugContext* ctx = (DebugContext*)param;
+  for (;;) {
+    ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(ARDEBUG_ASYNC_DRAIN_MS));
+    ctx->drain();
+  }
+}
+#endif // ARDEBUG_ASYNC_TASK
+
+static void notifyDrain(AsyncRing& ring) {
+#if defined(ARDEBUG_ASYNC_TASK)
+  if (drain_task && ring.size() >= ARDEBUG_ASYNC_SLOTS / 2) {
+    xTaskNotifyGive(drain_task);
+  }
+#else
+  (void)ring;
+#endif
+}
+#endif // ARDEBUG_ASYNC
+
+static inline uint8_t coreId() {
+#ifdef BOARD_MULTI_CORE
+  return (uint8_t)xPortGetCoreID();
+#else
+  return 0;
+#endif
+}
+
+#if defined(ARDEBUG_ISR)
+static IsrRing<ARDEBUG_ISR_SLOTS> isr_ring;
+#if defined(ARDEBUG_ASYNC)
+static IsrRecord isr_next;  // taken ahead by drain() to merge by time
+static bool isr_next_held = false;
+#endif
+
+// interrupt context: no locks, no formatting, nothing that can wait
+void BOARD_ISR_ATTR captureIsr(const CallSite* site, const uint32_t* words, uint8_t count) {
+  uint32_t ticket;
+  IsrRecord* rec = isr_ring.claim(&ticket);
+  rec->site = site;
+  rec->stamp = micros();
+  rec->millis = millis();
+  rec->core = coreId();
+  rec->count = count;
+  for (uint8_t i = 0; i < count; i++) rec->args[i] = words[i];
+  isr_ring.publish(ticket);
+}
+#endif // ARDEBUG_ISR
+
+#if defined(ARDEBUG_RATE)
+static RateTable<ARDEBUG_RATE_SITES> rate_table;
+// per level: lines per second << 16 | burst, 0 for no limit
+#define ARDEBUG_RATE_DEFAULT (ARDEBUG_RATE_LIMIT > 0 ? \
+    (uint32_t)ARDEBUG_RATE_LIMIT << 16 | ARDEBUG_RATE_BURST : 0)
+static std::atomic<uint32_t> rate_limits[ARDEBUG_V + 1] = {
+  {ARDEBUG_RATE_DEFAULT}, {ARDEBUG_RATE_DEFAULT}, {ARDEBUG_RATE_DEFAULT},
+  {ARDEBUG_RATE_DEFAULT}, {ARDEBUG_RATE_DEFAULT}
+};
+#endif // ARDEBUG_RATE
+
+#if defined(ARDEBUG_TRACE)
+static OverwriteRing<TraceEvent, ARDEBUG_TRACE_SLOTS> trace_ring;
+static uint64_t trace_clock = 0;  // micros() of the last event read, unwrapped
+static boolean trace_clock_set = false;
+
+void BOARD_ISR_ATTR traceEvent(char phase, const char* name, int32_t value) {
+  // task 0 in an interrupt, checked first: xTaskGetCurrentTaskHandle() is not in IRAM
+#if defined(ESP32)
+  uint32_t task = xPortInIsrContext() ? 0 : (uint32_t)(uintptr_t)xTaskGetCurrentTaskHandle();
+#else
+  uint32_t task = 1;
+#endif
+  uint32_t ticket;
+  TraceEvent* event = trace_ring.claim(&ticket);
+  event->name = name;
+  event->stamp = micros();
+  event->task = task;
+  event->value = value;
+  event->phase = phase;
+  event->core = coreId();
+  trace_ring.publish(ticket);
+}
+
+// events of the cores are a few microseconds out of order at most
+static uint64_t traceTime(uint32_t stamp) {
+  if (!trace_clock_set) {
+    trace_clock = stamp;
+    trace_clock_set = true;
+  }
+  trace_clock += (int64_t)(int32_t)(stamp - (uint32_t)trace_clock);
+  return trace_clock;
+}
+
+// one track per core, with the interrupt handlers as thread 0
+static void appendTraceNames(LineBuilder& line, uint8_t core) {
+  if (core > 0) line.append(',');
+  line.append("{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":");
+  line.appendUnsigned(core);
+  line.append(",\"args\":{\"name\":\"Core ");
+  line.appendUnsigned(core);
+  line.append("\"}}\n,{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":");
+  line.appendUnsigned(core);
+  line.append(",\"tid\":0,\"args\":{\"name\":\"ISR\"}}\n");
+}
+
+// ,{"name":"loop","ph":"B","ts":1234567,"pid":0,"tid":1073445000}
+static void appendTraceEvent(LineBuilder& line, const TraceEvent& event) {
+  uint64_t ts = traceTime(event.stamp);
+  line.append(",{\"name\":\"");
+  line.append(event.name);
+  line.append("\",\"ph\":\"");
+  line.append(event.phase);
+  line.append("\",\"ts\":");
+  if (ts >= 1000000) {
+    line.appendUnsigned((uint32_t)(ts / 1000000));
+    uint32_t us = (uint32_t)(ts % 1000000);
+    for (uint32_t digit = 100000; digit > 1 && us < digit; digit /= 10) line.append('0');
+    line.appendUnsigned(us);
+  } else {
+    line.appendUnsigned((uint32_t)ts);
+  }
+  line.append(",\"pid\":");
+  line.appendUnsigned(event.core);
+  line.append(",\"tid\":");
+  line.appendUnsigned(event.task);
+  if (event.phase == 'C') {
+    line.append(",\"args\":{\"value\":");
+    if (event.value < 0) line.append('-');
+    line.appendUnsigned(event.value < 0 ? 0u - (uint32_t)event.value : (uint32_t)event.value);
+    line.append('}');
+  }
+  if (event.phase == 'i') line.append(",\"s\":\"t\"");
+  line.append("}\n");
+}
+#endif // ARDEBUG_TRACE
+
+#if defined(ARDEBUG_PROFILE)
+static ProfileHistogram profiles[ARDEBUG_PROFILE_SCOPES];
+static const char* profile_names[ARDEBUG_PROFILE_SCOPES];
+static std::atomic<uint8_t> profile_count{0};
+
+uint8_t profileScope(const char* name) {
+  SinkLock lock;  // once per scope
+  uint8_t count = profile_count.load(std::memory_order_relaxed);
+  for (uint8_t id = 0; id < count; id++) {
+    if (strcmp(profile_names[id], name) == 0) return id;
+  }
+  if (count == ARDEBUG_PROFILE_SCOPES) return count;  // table full, not recorded
+  profile_names[count] = name;
+  profile_count.store(count + 1, std::memory_order_release);
+  return count;
+}
+
+void profileRecord(uint8_t id, uint32_t us) {
+  if (id < ARDEBUG_PROFILE_SCOPES) profiles[id].record(us);
+}
+
+#endif // ARDEBUG_PROFILE
+
+#if defined(ARDEBUG_PROFILE) || (defined(ARDEBUG_STATS) && defined(BOARD_WIFI))
+// "<name>: n=<count> min=<us> p50=<us> p99=<us> max=<us> us"
+static void appendHistogram(LineBuilder& line, const char* name, const ProfileHistogram& profile) {
+  line.append(name);
+  line.append(": n=");
+  line.appendUnsigned(profile.count());
+  line.append(" min=");
+  line.appendUnsigned(profile.min());
+  line.append(" p50=");
+  line.appendUnsigned(profile.percentile(500));
+  line.append(" p99=");
+  line.appendUnsigned(profile.percentile(990));
+  line.append(" max=");
+  line.appendUnsigned(profile.max());
+  line.append(" us");
+}
+#endif
+
+#if defined(ARDEBUG_PROFILE)
+static void appendProfile(LineBuilder& line, uint8_t id) {
+  appendHistogram(line, profile_names[id], profiles[id]);
+}
+#endif // ARDEBUG_PROFILE
+
+#if defined(ARDEBUG_STATS)
+static uint32_t stat_lines[ARDEBUG_STATS_LEVELS];  // written with the sinks
+static uint32_t stat_bytes[ARDEBUG_STATS_LEVELS];
+static std::atomic<uint32_t> stat_truncated{0};  // by the logging tasks
+static uint32_t stat_dropped_base = 0;  // drops before resetStats()
+static ProfileHistogram call_latency;
+
+static uint8_t statLevel(int8_t level) {
+  return level >= 0 && level <= ARDEBUG_V ? level : ARDEBUG_V + 1;
+}
+
+static void countTruncated(const LineBuilder& line) {
+  if (line.truncated()) stat_truncated.fetch_add(1, std::memory_order_relaxed);
+}
+
+// times a log call from the gate to its return
+class CallTimer {
+  private:
+    uint32_t start_ = micros();
+
+  public:
+    ~CallTimer() { call_latency.record(micros() - start_); }
+};
+#endif // ARDEBUG_STATS
+
+ConfigByte DebugContext::log_level_{ARDEBUG_I};
+ConfigByte DebugContext::tag_gate_[ARDEBUG_MAX_TAGS];
+
+// Slot 0 is shared by the tags that did not fit, and follows log_level_
+static char tag_names[ARDEBUG_MAX_TAGS][ARDEBUG_TAG_SIZE];
+static int8_t tag_levels[ARDEBUG_MAX_TAGS] = {-1};  // a tag's own level, -1 if none
+static uint8_t tag_count = 1;
+
+static char levelLabel(uint8_t level) {
+  static const char labels[] = "EWIDV";
+  return level <= ARDEBUG_V ? labels[level] : 'V';
+}
+
+static uint8_t findTag(const char* tag) {
+  for (uint8_t id = 1; id < tag_count; id++) {
+    if (strncmp(tag_names[id], tag, ARDEBUG_TAG_SIZE - 1) == 0) return id;
+  }
+  return 0;
+}
+
+#if defined(ARDEBUG_ESP_LOG)
+static vprintf_like_t esp_log_previous = nullptr;  // restored by stop()
+static volatile bool esp_log_busy[BOARD_CORES];
+static const char esp_log_letters[] = "EWIDV";
+// esp_log lines have no call site, so each level and tag ID has one
+static uint8_t esp_tag_ids[ARDEBUG_MAX_TAGS];
+static CallSite esp_sites[ARDEBUG_V + 1][ARDEBUG_MAX_TAGS];
+struct EspTagEntry {
+  std::atomic<const char*> key;
+  std::atomic<uint8_t> id;
+};
+static EspTagEntry esp_tags[ARDEBUG_ESP_LOG_TAG_CACHE];
+
+// IDF tags are static strings, so the pointer finds the ID without a compare.
+// Entries are read without the lock; the key is cleared while one is rewritten
+// and checked again after the ID is read.
+static uint8_t espTagId(const char* tag) {
+  EspTagEntry& entry = esp_tags[((uintptr_t)tag >> 2) % ARDEBUG_ESP_LOG_TAG_CACHE];
+  if (entry.key.load(std::memory_order_acquire) == tag) {
+    uint8_t id = entry.id.load(std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (entry.key.load(std::memory_order_relaxed) == tag) return id;
+  }
+  SinkLock lock;  // one writer at a time
+  uint8_t id = DebugContext::internTag(tag);
+  entry.key.store(nullptr, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  entry.id.store(id, std::memory_order_relaxed);
+  entry.key.store(tag, std::memory_order_release);
+  return id;
+}
+#endif // ARDEBUG_ESP_LOG
 
 DebugContext::~DebugContext() {
 #if defined(BOARD_WIFI) // && !defined(ARDEBUG_WIFI_DISABLED)
-  if (client && client.connected()) {
-    client.flush();
+  for (TelnetSession& session : sessions) {
+    if (session.client && session.client.connected()) session.client.flush();
   }
 #endif // BOARD_WIFI
   stop();
 }
 
-// iterate looking for [x] pattern
-static int8_t isDebug(const char* candidate) {
-  if (strlen(candidate) > 0 && candidate[0] == '[') {
-    char prev = candidate[0];
-    for (size_t i = 1; i < strlen(candidate); i++) {
-      char c = candidate[i];
-      char next = i < strlen(candidate) - 1 ? candidate[i + 1] : ' ';
-      if (prev == '[' && next == ']') {
-        switch (c) {
-          case 'V': return ARDEBUG_V;
-          case 'D': return ARDEBUG_D;
-          case 'I': return ARDEBUG_I;
-          case 'W': return ARDEBUG_W;
-          case 'E': return ARDEBUG_E;
-        }
-      }
-      prev = c;
+void DebugContext::appendPrefix(LineBuilder& line, uint8_t format, const CallSite* site,
+                                uint32_t ms, uint8_t core) {
+  if (format & SHOW_MILLIS) {
+    line.append('[');
+    line.appendUnsigned(ms, 6);
+    line.append(']');
+  }
+  line.append('[');
+  line.append(levelLabel(site->level));
+  line.append(']');
+  const char* tag = site->tag ? tagName(*site->tag) : nullptr;
+  if (tag) {
+    line.append('[');
+    line.append(tag);
+    line.append(']');
+  }
+  if ((format & SHOW_LINE) && site->file) {
+    line.append('[');
+#if defined(ARDEBUG_PROGMEM)
+    line.append_P(site->file);
+#else
+    line.append(site->file);
+#endif
+    line.append(':');
+    line.appendUnsigned(site->line);
+    line.append(']');
+  }
+#ifdef BOARD_MULTI_CORE
+  if (format & SHOW_CORE) {
+    line.append("[C", 2);
+    line.appendUnsigned(core);
+    line.append(']');
+  }
+#else
+  (void)core;
+#endif
+  if ((format & SHOW_FUNC) && site->func) {
+    line.append(' ');
+    line.append(site->func);
+    line.append("()", 2);
+  }
+  line.append(": ", 2);
+}
+
+// printf arguments, which a FLEXBUFFER line may format twice
+class VaMessage : public Message {
+  private:
+    mutable va_list args_;
+
+  public:
+    VaMessage(const char* format, va_list args, bool in_flash = false) : Message(format, in_flash) {
+      va_copy(args_, args);
     }
+    ~VaMessage() { va_end(args_); }
+    void appendTo(LineBuilder& line) const override {
+      va_list copy;
+      va_copy(copy, args_);
+#if defined(ARDEBUG_PROGMEM)
+      if (flash) line.vappendf_P(fmt, copy);
+      else line.vappendf(fmt, copy);
+#else
+      line.vappendf(fmt, copy);
+#endif
+      va_end(copy);
+    }
+};
+
+static bool endsWithNewline(const Message& msg) {
+#if defined(ARDEBUG_PROGMEM)
+  if (msg.flash) {
+    size_t len = strlen_P(msg.fmt);
+    return len > 0 && pgm_read_byte(msg.fmt + len - 1) == '\n';
   }
-  return -1;
+#endif
+  return msg.fmt[0] != 0 && msg.fmt[strlen(msg.fmt) - 1] == '\n';
 }
 
-static char* debugColor(uint8_t level) {
-  switch (level) {
-    case ARDEBUG_V: return (char*)ARD_COLOR_V;
-    case ARDEBUG_D: return (char*)ARD_COLOR_D;
-    case ARDEBUG_I: return (char*)ARD_COLOR_I;
-    case ARDEBUG_W: return (char*)ARD_COLOR_W;
-    case ARDEBUG_E: return (char*)ARD_COLOR_E;
-    default: return (char*)ARD_COLOR_RESET;
+// returns the length of the prefix, where the message starts
+size_t DebugContext::formatLine(LineBuilder& line, const CallSite* site, const Message& msg,
+                                uint32_t ms, uint8_t core) {
+  if (site) {
+    appendPrefix(line, format_, site, ms, core);
   }
+  size_t message = line.length();
+  msg.appendTo(line);
+  line.finish(endsWithNewline(msg));
+  return message;
 }
 
-static void colorize(char* str, const size_t buffer_size, const char* color) {
-  if (strlen(str) <= buffer_size - (2 * ARD_COLORSIZE)) {
-    char tmp[buffer_size];
-    strncpy(tmp, str, buffer_size);
-    snprintf(str, buffer_size, "%s%s%s", color, tmp, ARD_COLOR_RESET);
+// Formats the line once, straight into an async slot when queued
+size_t DebugContext::output(const CallSite* site, const Message& msg) {
+  if (!output_active_) return 0;
+#if defined(ARDEBUG_STATS)
+  CallTimer timer;
+#endif
+  uint32_t ms = millis();
+  uint8_t core = coreId();
+  int8_t level = site ? (int8_t)site->level : -1;
+#if defined(ARDEBUG_ASYNC)
+  AsyncRing& ring = async_rings[core];
+  size_t ticket;
+  AsyncRecord* rec = ring.claim(&ticket);
+  if (rec == nullptr) return 0;
+  LineBuilder queued(rec->line, sizeof(rec->line));
+  rec->message = (uint16_t)formatLine(queued, site, msg, ms, core);
+#if defined(ARDEBUG_STATS)
+  countTruncated(queued);
+#endif
+#if defined(ARDEBUG_HISTORY)
+  if (history_enabled_) history.append(queued.text(), queued.length());
+#endif
+  rec->site = site;
+  rec->packed = false;
+  rec->stamp = micros();
+  rec->millis = ms;
+  rec->core = core;
+  rec->level = level;
+  rec->len = (uint16_t)queued.length();
+  ring.publish(ticket);
+  notifyDrain(ring);
+  return queued.length();
+#else
+
+  char buffer[ARDEBUG_LINE_SIZE];
+  LineBuilder line(buffer, sizeof(buffer));
+  size_t message = formatLine(line, site, msg, ms, core);
+#if defined(ARDEBUG_HISTORY)
+  if (history_enabled_) history.append(line.text(), line.length());
+#endif
+  SinkLock lock;  // only on a multi-core board
+#if defined(ARDEBUG_FLEXBUFFER)
+  if (line.truncated()) {
+    size_t size = ARDEBUG_COLOR_HEAD + line.required() + ARDEBUG_COLOR_TAIL + 1;
+#if defined(ARDEBUG_NO_HEAP)
+    char* temp = flex_arena_busy ? nullptr : flex_arena;
+    if (size > sizeof(flex_arena)) size = sizeof(flex_arena);
+#else
+    char* temp = new char[size];
+#endif
+    if (temp != NULL) {
+#if defined(ARDEBUG_NO_HEAP)
+      flex_arena_busy = true;
+#endif
+      LineBuilder full(temp, size);
+      formatLine(full, site, msg, ms, core);
+#if defined(ARDEBUG_STATS)
+      countTruncated(full);
+#endif
+      LogRecord record = {level, ms, core, site, &full, message};
+      emit(record);
+#if defined(ARDEBUG_NO_HEAP)
+      flex_arena_busy = false;
+#else
+      delete[] temp;
+#endif
+      return full.length();
+    }
   }
+#endif
+#if defined(ARDEBUG_STATS)
+  countTruncated(line);
+#endif
+  LogRecord record = {level, ms, core, site, &line, message};
+  emit(record);
+  return line.length();
+#endif // ARDEBUG_ASYNC
 }
 
 size_t DebugContext::dprintf(const char* fmt, ...) {
-  if (!serial_enabled_ && !isConnected() && !file_enabled_) return 0;
-  char buffer[ARDEBUG_BUFFER_SIZE];
-  char* temp = buffer;
   va_list args;
-  va_list copy;
   va_start(args, fmt);
-  va_copy(copy, args);
-  int len = vsnprintf(temp, ARDEBUG_BUFFER_SIZE, fmt, copy);
-  va_end(copy);
-  if (len < 0) {
-      va_end(args);
-      return 0;
-  }
-#if defined(ARDEBUG_FLEXBUFFER)
-  if (len >= ARDEBUG_BUFFER_SIZE) {
-      temp = new char[len + 1];
-      if (temp == NULL) {
-          va_end(args);
-          return 0;
-      }
-      len = vsnprintf(temp, len + 1, fmt, args);
+  size_t len = output(nullptr, VaMessage(fmt, args));
+  va_end(args);
+  return len;
+}
+
+#if defined(ARDEBUG_PROGMEM)
+size_t DebugContext::dprintf(const __FlashStringHelper* fmt, ...) {
+  va_list args;
+  va_start(args, fmt);
+  size_t len = output(nullptr, VaMessage((const char*)fmt, args, true));
+  va_end(args);
+  return len;
+}
+#endif
+
+// a sink gets a record if it is active and its level accepts the record's
+void DebugContext::emit(const LogRecord& record) {
+#if defined(ARDEBUG_RATE)
+  if (collapse_ && collapse(record)) return;
+#endif
+#if defined(ARDEBUG_BACKLOG)
+  if (telnet_enabled_) {
+    backlog.append(record.level, false, (const uint8_t*)record.text(), record.length());
   }
-#else
-  if (len >= ARDEBUG_BUFFER_SIZE - 1) {
-    int offset = strlen(temp) - 1;
-    if (fmt[strlen(fmt) - 1] == '\n' || temp[strlen(temp) - 1] == '\n') {
-      temp[strlen(temp) - 1] = '\n';
-      offset--;
+#endif
+#if defined(ARDEBUG_STATS)
+  stat_lines[statLevel(record.level)]++;
+  stat_bytes[statLevel(record.level)] += record.length();
+#endif
+  for (uint8_t i = 0; i < sink_count_; i++) {
+    int8_t level = sinks_[i]->maxLevel();
+    if (level >= 0 && record.level <= level) {
+      sinks_[i]->write(record);
+#if defined(ARDEBUG_STATS)
+      sinks_[i]->offered_lines_++;
+      sinks_[i]->offered_bytes_ += record.length();
+#endif
     }
-    for (int i = offset; i > offset - 3; i--) temp[i] = '.';
-    len = strlen(temp);
   }
+}
+
+void DebugContext::emitRaw(const uint8_t* data, size_t len, int8_t level) {
+#if defined(ARDEBUG_BACKLOG)
+  if (telnet_enabled_) backlog.append(level, true, data, len);
+#endif
+#if defined(ARDEBUG_STATS)
+  stat_bytes[statLevel(level)] += len;
+#endif
+  for (uint8_t i = 0; i < sink_count_; i++) {
+    int8_t max = sinks_[i]->maxLevel();
+    if (max >= 0 && level <= max) {
+      sinks_[i]->writeRaw(data, len, level);
+#if defined(ARDEBUG_STATS)
+      sinks_[i]->offered_bytes_ += len;
 #endif
-  if (serial_enabled_ && serial_) {
-    serial_->write((const char*)temp, len);
+    }
   }
-  // if (file_enabled_) File.write((const char*)temp, len);
+}
+
+// output of the library itself, without a call site, for sinks that take `level`
+void DebugContext::notice(LineBuilder& note, int8_t level) {
+  LogRecord record = {level, (uint32_t)millis(), coreId(), nullptr, &note, 0};
+  emit(record);
+}
+
+// lines left queued by a busy sink go out as it frees up
+void DebugContext::pollSinks() {
+  for (uint8_t i = 0; i < sink_count_; i++) sinks_[i]->poll();
+}
+
+bool DebugContext::addSink(Sink* sink) {
+  SinkLock lock;
+  for (uint8_t i = 0; i < sink_count_; i++) {
+    if (sinks_[i] == sink) return true;
+  }
+  if (sink == nullptr || sink_count_ == ARDEBUG_MAX_SINKS) return false;
+  sinks_[sink_count_++] = sink;
+  updateLogLevel();
+  return true;
+}
+
+void DebugContext::removeSink(Sink* sink) {
+  SinkLock lock;
+  for (uint8_t i = 0; i < sink_count_; i++) {
+    if (sinks_[i] == sink) {
+      sinks_[i] = sinks_[--sink_count_];
+      sinks_[sink_count_] = nullptr;
+      updateLogLevel();
+      return;
+    }
+  }
+}
+
+void DebugContext::enableSerial(boolean enable) {
+  SinkLock lock;
+  serial_sink.enabled = enable;
+  updateLogLevel();
+}
+
+#if defined(ARDEBUG_QUEUE)
+void DebugContext::setQueuePolicy(uint8_t policy, uint32_t block_ms) {
+  if (policy > ARDEBUG_BLOCK) return;
+  queue_policy = policy;
+  queue_block_ms = block_ms;
+}
+
+uint32_t DebugContext::droppedLines() {
+  uint32_t dropped = serial_sink.queue.dropped();
 #if defined(BOARD_WIFI) // && !defined(ARDEBUG_WIFI_DISABLED)
-  int8_t is_debug = isDebug(temp);
-  if (telnet_enabled_ && client) {
-    if (show_color_ && is_debug >= ARDEBUG_E) {
-      colorize(temp, ARDEBUG_BUFFER_SIZE, debugColor(is_debug));
-      len = strlen(temp);
+  for (TelnetSession& session : sessions) dropped += session.queue.dropped();
+#endif
+  return dropped;
+}
+#endif // ARDEBUG_QUEUE
+
+#if defined(ARDEBUG_COALESCE)
+uint32_t DebugContext::telnetSegments(uint32_t* lines) {
+  SinkLock lock;
+  if (lines != nullptr) *lines = coalesce_lines;
+  return coalesce_segments;
+}
+#endif
+
+/** @brief Level of Serial, the log file and telnet sessions opened later. */
+void DebugContext::setLogLevel(uint8_t level) {
+  if (level > ARDEBUG_V) return;
+  SinkLock lock;
+  base_level_ = level;
+  serial_sink.setLevel(level);
+#if defined(BOARD_WIFI) // && !defined(ARDEBUG_WIFI_DISABLED)
+  telnet_sink.setLevel(level);
+#endif
+#if defined(ARDEBUG_FILE)
+  file_sink.setLevel(level);
+#endif
+  updateLogLevel();
+}
+
+// the inline gate is the most verbose level any sink accepts
+void DebugContext::updateLogLevel() {
+  SinkLock lock;
+  int8_t level = -1;
+  for (uint8_t i = 0; i < sink_count_; i++) {
+    int8_t max = sinks_[i]->maxLevel();
+    if (max > level) level = max;
+  }
+#if defined(ARDEBUG_HISTORY)
+  if (history_enabled_ && (int8_t)base_level_ > level) level = base_level_;
+#endif
+#if defined(ARDEBUG_BACKLOG)
+  if (telnet_enabled_ && (int8_t)base_level_ > level) level = base_level_;  // for later clients
+#endif
+  output_active_ = level >= 0 ? 1 : 0;
+  log_level_ = level >= 0 ? level : ARDEBUG_E;
+  for (uint8_t id = 0; id < tag_count; id++) {
+    tag_gate_[id] = tag_levels[id] >= 0 ? (uint8_t)tag_levels[id] : (uint8_t)log_level_;
+  }
+#if defined(ARDEBUG_DEFERRED)
+  memset(sent_sites, 0, sizeof(sent_sites));  // a session may now see new sites
+#endif
+}
+
+void DebugContext::setFormat(uint8_t flag, boolean show) {
+  if (low_memory_) return;
+#if defined(BOARD_LOW_MEMORY)
+  format_ = show ? (format_ | flag) : (format_ & ~flag);
+#else
+  if (show) format_.fetch_or(flag);
+  else format_.fetch_and((uint8_t)~flag);
+#endif
+}
+
+uint8_t DebugContext::internTag(const char* tag) {
+  SinkLock lock;  // once per call site
+  uint8_t id = findTag(tag);
+  if (id != 0 || tag_count == ARDEBUG_MAX_TAGS) return id;
+  id = tag_count;
+  strncpy(tag_names[id], tag, ARDEBUG_TAG_SIZE - 1);
+  tag_levels[id] = -1;
+  tag_gate_[id] = (uint8_t)log_level_;
+  tag_count = id + 1;
+  return id;
+}
+
+const char* DebugContext::tagName(uint8_t id) {
+  return id > 0 && id < tag_count ? tag_names[id] : nullptr;
+}
+
+bool DebugContext::setTagLevel(const char* tag, int8_t level) {
+  if (level > ARDEBUG_V) return false;
+  SinkLock lock;
+  uint8_t id = internTag(tag);
+  if (id == 0) return false;  // table full
+  tag_levels[id] = level < 0 ? -1 : level;
+  updateLogLevel();
+#if defined(ARDEBUG_ESP_LOG)
+  if (esp_log_previous) {  // let the component's esp_log lines through too
+    esp_log_level_set(tag_names[id], (esp_log_level_t)(level < 0 ?
+        CONFIG_LOG_DEFAULT_LEVEL : level + ESP_LOG_ERROR));
+  }
+#endif
+  return true;
+}
+
+int8_t DebugContext::tagLevel(const char* tag) {
+  return tag_levels[findTag(tag)];
+}
+
+#if defined(ARDEBUG_RATE)
+bool DebugContext::ratePass(const CallSite* site) {
+  uint32_t limit = rate_limits[site->level].load(std::memory_order_relaxed);
+  if (limit == 0) return true;
+  return rate_table.pass(site, millis(), limit >> 16, limit & 0xFFFF);
+}
+
+void DebugContext::setRateLimit(uint16_t per_sec, uint16_t burst) {
+  for (uint8_t level = ARDEBUG_E; level <= ARDEBUG_V; level++) {
+    setLevelRateLimit(level, per_sec, burst);
+  }
+}
+
+void DebugContext::setLevelRateLimit(uint8_t level, uint16_t per_sec, uint16_t burst) {
+  if (level > ARDEBUG_V) return;
+  rate_limits[level] = per_sec == 0 ? 0 : (uint32_t)per_sec << 16 | (burst > 0 ? burst : 1);
+}
+
+uint32_t DebugContext::suppressedLines() {
+  return rate_table.suppressed();
+}
+
+// identical consecutive lines of a call site are counted instead of written
+bool DebugContext::collapse(const LogRecord& record) {
+  if (record.site == nullptr) return false;
+  uint32_t hash = 2166136261u;  // FNV-1a of the message
+  const char* text = record.messageText();
+  for (size_t i = 0; i < record.messageLength(); i++) {
+    hash = (hash ^ (uint8_t)text[i]) * 16777619u;
+  }
+  if (record.site == repeat_site_ && hash == repeat_hash_) {
+    if (repeat_count_++ == 0) repeat_since_ = millis();
+    return true;
+  }
+  emitRepeats();
+  repeat_site_ = record.site;
+  repeat_hash_ = hash;
+  repeat_level_ = record.level;
+  return false;
+}
+
+void DebugContext::emitRepeats() {
+  if (repeat_count_ == 0) return;
+  char buffer[ARDEBUG_COLOR_HEAD + 56 + ARDEBUG_COLOR_TAIL];
+  LineBuilder note(buffer, sizeof(buffer));
+  note.append("[ardebug] last message repeated ");
+  note.appendUnsigned(repeat_count_);
+  note.append(" times\n");
+  repeat_count_ = 0;
+  notice(note, repeat_level_);
+}
+
+// what the flood control held back, every ARDEBUG_RATE_REPORT_MS at most
+void DebugContext::emitSuppressed() {
+  uint32_t now = millis();
+  if (repeat_count_ > 0 && (!collapse_ || now - repeat_since_ >= ARDEBUG_RATE_REPORT_MS)) {
+    emitRepeats();
+  }
+  if (!collapse_) repeat_site_ = nullptr;
+  if (now - rate_reported_ < ARDEBUG_RATE_REPORT_MS) return;
+  rate_reported_ = now;
+  rate_table.report([this](const CallSite* site, uint32_t count) {
+    char buffer[ARDEBUG_COLOR_HEAD + 96 + ARDEBUG_COLOR_TAIL];
+    LineBuilder note(buffer, sizeof(buffer));
+    note.append("[ardebug] ");
+    note.appendUnsigned(count);
+    note.append(" lines suppressed");
+    const char* tag = site && site->tag ? tagName(*site->tag) : nullptr;
+    if (site && site->file) {
+      note.append(" at ");
+      note.append(site->file);
+      note.append(':');
+      note.appendUnsigned(site->line);
+    } else if (tag) {
+      note.append(" of ");
+      note.append(tag);
     }
-    client.write((const char*)temp, len);
+    note.append('\n');
+    notice(note, site ? (int8_t)site->level : -1);
+  });
+}
+#endif // ARDEBUG_RATE
+
+#if defined(ARDEBUG_PROFILE)
+void DebugContext::reportProfiles() {
+  SinkLock lock;
+  uint8_t count = profile_count.load(std::memory_order_acquire);
+  char buffer[ARDEBUG_LINE_SIZE];
+  for (uint8_t id = 0; id < count; id++) {
+    LineBuilder note(buffer, sizeof(buffer));
+    note.append("[ardebug] profile ");
+    appendProfile(note, id);
+    note.append('\n');
+    notice(note);
   }
-#endif // BOARD_WIFI
-  va_end(args);
-#if defined(ARDEBUG_FLEXBUFFER)
-  if (temp != buffer) delete[] temp;
-#endif
-  return (size_t)len;
-}
-
-size_t DebugContext::debugf(uint8_t level, const char* caller, const char* filename, uint32_t lineno, const char* fmt, ...) {
-  if (level > log_level_) return 0;
-  bool lf_required = fmt[strlen(fmt) - 1] == '\n';
-  DebugMessage msg{level};
-  msg.millis = millis();
-  strncpy(msg.func, caller, ARDEBUG_FUNCNAME_SIZE);
-  strncpy(msg.filename, filename, ARDEBUG_FILENAME_SIZE);
-  msg.lineno = lineno;
-  const size_t max_prefix_len = ARDEBUG_MAX_PREFIX_SIZE + 1;
-  char prefix[max_prefix_len] = {0};
-  size_t offset = 0;
-  char level_label;
-  switch (level) {
-      case ARDEBUG_D:
-          level_label = 'D';
-          break;
-      case ARDEBUG_I:
-          level_label = 'I';
-          break;
-      case ARDEBUG_W:
-          level_label = 'W';
-          break;
-      case ARDEBUG_E:
-          level_label = 'E';
-          break;
-      default:
-          level_label = 'V';
-  }
-  if (show_millis_) {
-    offset += snprintf(prefix + offset, max_prefix_len, "[%*d]", 6, millis());
-  }
-  offset += snprintf(prefix + offset, max_prefix_len, "%s[%c]", prefix + offset, level_label);
-  if (show_line_) {
-    offset += snprintf(prefix + offset, max_prefix_len, "%s[%s:%d]", prefix + offset, filename, lineno);
+}
+
+void DebugContext::resetProfiles() {
+  for (ProfileHistogram& profile : profiles) profile.reset();
+}
+#endif // ARDEBUG_PROFILE
+
+#if defined(ARDEBUG_TRACE)
+size_t DebugContext::writeTrace(Print& out) {
+  SinkLock lock;
+#if defined(BOARD_WIFI) // && !defined(ARDEBUG_WIFI_DISABLED)
+  if (trace_session_) return 0;
+#endif
+  char buffer[ARDEBUG_LINE_SIZE];
+  out.print("[\n");
+  for (uint8_t core = 0; core < BOARD_CORES; core++) {
+    LineBuilder line(buffer, sizeof(buffer));
+    appendTraceNames(line, core);
+    out.write((const uint8_t*)line.text(), line.length());
   }
-#ifdef BOARD_MULTI_CORE
-  if (show_core_) {
-    offset += snprintf(prefix + offset, max_prefix_len, "%s[C%d]", prefix + offset, xPortGetCoreID());
+  size_t count = 0;
+  TraceEvent event;
+  while (trace_ring.pop(event)) {
+    LineBuilder line(buffer, sizeof(buffer));
+    appendTraceEvent(line, event);
+    out.write((const uint8_t*)line.text(), line.length());
+    count++;
   }
+  out.print("]\n");
+  return count;
+}
+#endif // ARDEBUG_TRACE
+
+#if defined(ARDEBUG_ASYNC)
+uint32_t DebugContext::asyncDropped() {
+  uint32_t dropped = 0;
+  for (AsyncRing& ring : async_rings) dropped += ring.dropped();
+  return dropped;
+}
+
+uint32_t DebugContext::asyncOverflows() {
+  uint32_t overflows = 0;
+  for (AsyncRing& ring : async_rings) overflows += ring.overflows();
+  return overflows;
+}
+#endif // ARDEBUG_ASYNC
+
+#if defined(ARDEBUG_DEFERRED)
+size_t DebugContext::enqueueDeferred(const CallSite* site, const uint8_t* args, size_t len) {
+  uint8_t core = coreId();
+  AsyncRing& ring = async_rings[core];
+  size_t ticket;
+  AsyncRecord* rec = ring.claim(&ticket);
+  if (rec == nullptr) return 0;
+  rec->site = site;
+  rec->packed = true;
+  rec->stamp = micros();
+  rec->millis = millis();
+  rec->core = core;
+  memcpy(rec->line, args, len);
+  rec->len = (uint16_t)len;
+  ring.publish(ticket);
+  notifyDrain(ring);
+  return len;
+}
+
+void DebugContext::emitDeferred(const CallSite* site, uint32_t ms, uint8_t core,
+                                const uint8_t* args, size_t args_len) {
+  char buffer[ARDEBUG_LINE_SIZE];
+  LineBuilder line(buffer, sizeof(buffer));
+  appendPrefix(line, format_, site, ms, core);
+  size_t message = line.length();
+  size_t room = line.room();
+  size_t len = formatPacked(line.tail(), room, site->fmt, args, args_len);
+  line.advance(len, len + 1 >= room ? len + 1 : len);
+  line.finish(site->fmt[0] != 0 && site->fmt[strlen(site->fmt) - 1] == '\n');
+#if defined(ARDEBUG_STATS)
+  countTruncated(line);
+#endif
+#if defined(ARDEBUG_HISTORY)
+  if (history_enabled_) history.append(line.text(), line.length());
 #endif
-  if (show_func_ && caller) {
-      offset += snprintf(prefix + offset, max_prefix_len, "%s %s()", prefix + offset, caller);
+  LogRecord record = {(int8_t)site->level, ms, core, site, &line, message};
+  emit(record);
+}
+
+// the first record of a call site is preceded by its dictionary frame
+void DebugContext::emitFrames(const CallSite* site, uint32_t ms, uint8_t core,
+                              const uint8_t* args, size_t args_len) {
+  uint8_t frame[ARDEBUG_BUFFER_SIZE];
+  uint32_t id = (uint32_t)(uintptr_t)site;
+  const CallSite** sent = &sent_sites[(id >> 2) % ARDEBUG_DEFERRED_SITE_CACHE];
+  size_t len;
+  if (*sent != site) {
+    len = encodeSiteFrame(frame, sizeof(frame), id, site);
+    if (len > 0) emitRaw(frame, len, site->level);
+    *sent = site;
   }
-  offset += snprintf(prefix + offset, max_prefix_len, "%s: ", prefix + offset);
-  char buffer[ARDEBUG_BUFFER_SIZE];
-  // memset(buffer, 0, ARDEBUG_BUFFER_SIZE);
-  char* temp = buffer;
-  va_list args;
+  len = encodeRecordFrame(frame, sizeof(frame), id, ms, core, args, args_len);
+  if (len > 0) emitRaw(frame, len, site->level);
+}
+
+void DebugContext::setBinaryOutput(boolean enable) {
+  SinkLock lock;
+  memset(sent_sites, 0, sizeof(sent_sites));
+  binary_output_ = enable ? 1 : 0;
+}
+#endif // ARDEBUG_DEFERRED
+
+#if defined(ARDEBUG_ESP_LOG)
+// a sink writing to the network may log through esp_log itself
+int DebugContext::espLogHook(const char* fmt, va_list args) {
+  uint8_t core = coreId();
+  if (esp_log_busy[core]) return esp_log_previous(fmt, args);
+  esp_log_busy[core] = true;
+  int len = get().espLog(fmt, args);
+  esp_log_busy[core] = false;
+  return len;
+}
+
+/**
+ * @brief Write an esp_log line as an ardebug line of its level and tag.
+ * IDF passes "<color>L (%u) %s: <format><reset>\n" with the timestamp and
+ * tag ahead of the caller's arguments, so the prefix is parsed from the
+ * format and only the caller's format is formatted, once.
+*/
+int DebugContext::espLog(const char* fmt, va_list args) {
+  const char* p = fmt;
+  if (*p == '\x1b') {  // color
+    p = strchr(p, 'm');
+    p = p ? p + 1 : fmt;
+  }
+  const char* letter = *p ? strchr(esp_log_letters, *p) : nullptr;
+  const char* close = letter && strncmp(p + 1, " (%", 3) == 0 ? strchr(p + 4, ')') : nullptr;
+  const char* message = close && strncmp(close, ") %s: ", 6) == 0 ? close + 6 : nullptr;
+  size_t len = message ? strlen(message) : 0;
+  if (len > 0 && message[len - 1] == '\n') len--;
+  if (len >= 4 && strncmp(message + len - 4, "\x1b[0m", 4) == 0) len -= 4;
+  char format[ARDEBUG_BUFFER_SIZE];
+  if (message == nullptr || len + 2 > sizeof(format)) {
+    return (int)output(nullptr, VaMessage(fmt, args));  // not a log line, written as is
+  }
+  memcpy(format, message, len);
+  format[len] = '\n';
+  format[len + 1] = 0;
   va_list copy;
-  va_start(args, fmt);
   va_copy(copy, args);
-  int len = vsnprintf(temp, ARDEBUG_BUFFER_SIZE, fmt, copy);
+  (void)va_arg(copy, uint32_t);  // IDF timestamp, the prefix has millis()
+  const char* tag = va_arg(copy, const char*);
+  const CallSite* site = &esp_sites[letter - esp_log_letters][espTagId(tag)];
+  size_t written = 0;
+#if defined(ARDEBUG_RATE)
+  if (siteEnabled(site) && ratePass(site)) written = output(site, VaMessage(format, copy));
+#else
+  if (siteEnabled(site)) written = output(site, VaMessage(format, copy));
+#endif
   va_end(copy);
-  if (len < 0) {
-      va_end(args);
-      return 0;
+  return (int)written;
+}
+#endif // ARDEBUG_ESP_LOG
+
+#if defined(ARDEBUG_ISR)
+// records left by interrupt handlers, formatted here in task context
+void DebugContext::emitIsr() {
+  IsrRecord rec;
+  while (isr_ring.pop(rec)) emitIsr(rec);
+  noteIsrDrops();
+}
+
+void DebugContext::emitIsr(const IsrRecord& rec) {
+  const CallSite* site = rec.site;
+#if defined(ARDEBUG_RATE)
+  if (!ratePass(site)) return;
+#endif
+  char buffer[ARDEBUG_LINE_SIZE];
+  LineBuilder line(buffer, sizeof(buffer));
+  appendPrefix(line, format_, site, rec.millis, rec.core);
+  size_t message = line.length();
+#if defined(ARDEBUG_TYPED)
+  FormatArg args[ARDEBUG_ISR_ARGS + 1] = {};
+  for (uint8_t i = 0; i < rec.count; i++) {
+    args[i].fn = formatSigned;  // writes the bits for %u, %o, %x and %c
+    args[i].i = (int32_t)rec.args[i];
   }
-#if defined(ARDEBUG_FLEXBUFFER)
-  if (len >= ARDEBUG_BUFFER_SIZE) {
-      temp = new char[len + 1];
-      if (temp == NULL) {
-          va_end(args);
-          return 0;
-      }
-      len = vsnprintf(temp, len + 1, fmt, args);
+  formatArgs(line, site->fmt, args);
+#else
+  uint32_t a[8] = {0};  // unused words are passed and ignored
+  memcpy(a, rec.args, rec.count * sizeof(uint32_t));
+  line.appendf(site->fmt, a[0], a[1], a[2], a[3], a[4], a[5], a[6], a[7]);
+#endif
+  line.finish(true);
+#if defined(ARDEBUG_STATS)
+  countTruncated(line);
+#endif
+#if defined(ARDEBUG_HISTORY)
+  if (history_enabled_) history.append(line.text(), line.length());
+#endif
+  LogRecord record = {(int8_t)site->level, rec.millis, rec.core, site, &line, message};
+  emit(record);
+}
+
+void DebugContext::noteIsrDrops() {
+  uint32_t dropped = isr_ring.dropped();
+  if (dropped != isr_reported_drops_) {
+    char buffer[ARDEBUG_COLOR_HEAD + 40 + ARDEBUG_COLOR_TAIL];
+    LineBuilder note(buffer, sizeof(buffer));
+    note.append("[ardebug] ");
+    note.appendUnsigned(dropped - isr_reported_drops_);
+    note.append(" ISR records dropped\n");
+    isr_reported_drops_ = dropped;
+    notice(note);
+  }
+}
+#endif // ARDEBUG_ISR
+
+#if defined(ARDEBUG_ASYNC)
+// the oldest record at the head of any core's ring
+static AsyncRing* oldestRing() {
+  AsyncRing* oldest = nullptr;
+  uint32_t stamp = 0;
+  for (AsyncRing& ring : async_rings) {
+    AsyncRecord* rec = ring.peek();
+    if (rec && (oldest == nullptr || (int32_t)(rec->stamp - stamp) < 0)) {
+      oldest = &ring;
+      stamp = rec->stamp;
+    }
   }
-  len = (int)dprintf("%s%s", prefix, temp);
-  if (temp != buffer) delete[] temp;
+  return oldest;
+}
+#endif // ARDEBUG_ASYNC
+
+/**
+ * @brief Write queued records to the sinks, the cores' rings and the records
+ * of interrupt handlers merged by time. Rate limit summaries go first.
+ * Called by the drain task on ESP32, otherwise from handle().
+ * @param max_records Limit per call, 0 drains everything queued
+ * @return The number of records written
+*/
+size_t DebugContext::drain(size_t max_records) {
+  size_t count = 0;
+#if defined(ARDEBUG_ASYNC)
+  SinkLock lock;
+#if defined(ARDEBUG_RATE)
+  emitSuppressed();
+#endif
+  while (max_records == 0 || count < max_records) {
+    AsyncRing* ring = oldestRing();
+#if defined(ARDEBUG_ISR)
+    if (!isr_next_held) isr_next_held = isr_ring.pop(isr_next);
+    if (isr_next_held && (ring == nullptr || (int32_t)(isr_next.stamp - ring->peek()->stamp) < 0)) {
+      emitIsr(isr_next);
+      isr_next_held = false;
+      count++;
+      continue;
+    }
+#endif
+    if (ring == nullptr) break;
+    AsyncRecord* rec = ring->peek();
+    if (!rec->packed) {
+      LineBuilder line(rec->line, sizeof(rec->line), rec->len);
+      LogRecord record = {rec->level, rec->millis, rec->core, rec->site, &line, rec->message};
+      emit(record);
+#if defined(ARDEBUG_DEFERRED)
+    } else if (binary_output_) {
+      emitFrames(rec->site, rec->millis, rec->core, (const uint8_t*)rec->line, rec->len);
+    } else {
+      emitDeferred(rec->site, rec->millis, rec->core, (const uint8_t*)rec->line, rec->len);
+#endif
+    }
+    ring->release();
+    count++;
+  }
+#if defined(ARDEBUG_ISR)
+  noteIsrDrops();
+#endif
+#if defined(ARDEBUG_TRACE) && defined(BOARD_WIFI)
+  pumpTrace();
+#endif
+  uint32_t dropped = asyncDropped();
+  if (dropped != async_reported_drops_) {
+    char buffer[ARDEBUG_COLOR_HEAD + 40 + ARDEBUG_COLOR_TAIL];
+    LineBuilder note(buffer, sizeof(buffer));
+    note.append("[ardebug] ");
+    note.appendUnsigned(dropped - async_reported_drops_);
+    note.append(" records dropped\n");
+    async_reported_drops_ = dropped;
+    notice(note);
+  }
+  pollSinks();
 #else
-  if (lf_required) {
-    if (buffer[strlen(buffer) - 1] == '\n')
-      buffer[strlen(buffer) - 1] = 0;
-    len = (int)dprintf("%s%s\n", prefix, buffer);
-  } else {
-    len = (int)dprintf("%s%s", prefix, buffer);
+  (void)max_records;
+#endif
+  return count;
+}
+
+#if defined(ARDEBUG_STATS)
+// lines lost to full queues and rings since startup
+static uint32_t allDropped(DebugContext& ctx) {
+  uint32_t dropped = 0;
+#if defined(ARDEBUG_QUEUE)
+  dropped += ctx.droppedLines();
+#endif
+#if defined(ARDEBUG_ASYNC)
+  dropped += ctx.asyncDropped();
+#endif
+#if defined(ARDEBUG_ISR)
+  dropped += isr_ring.dropped();
+#endif
+  return dropped;
+}
+
+void DebugContext::stats(DebugStats& out) {
+  SinkLock lock;
+  memcpy(out.lines, stat_lines, sizeof(out.lines));
+  memcpy(out.bytes, stat_bytes, sizeof(out.bytes));
+  out.truncated = stat_truncated.load(std::memory_order_relaxed);
+  out.dropped = allDropped(*this) - stat_dropped_base;
+}
+
+const ProfileHistogram& DebugContext::callLatency() const {
+  return call_latency;
+}
+
+void DebugContext::resetStats() {
+  SinkLock lock;
+  memset(stat_lines, 0, sizeof(stat_lines));
+  memset(stat_bytes, 0, sizeof(stat_bytes));
+  stat_truncated.store(0, std::memory_order_relaxed);
+  stat_dropped_base = allDropped(*this);
+  call_latency.reset();
+  for (uint8_t i = 0; i < sink_count_; i++) {
+    sinks_[i]->offered_lines_ = 0;
+    sinks_[i]->offered_bytes_ = 0;
   }
-#endif  
+}
+#endif // ARDEBUG_STATS
+
+size_t DebugContext::debugf(const CallSite* site, ...) {
+#if defined(ARDEBUG_PROGMEM)
+  CallSite copy;
+  site = loadSite(site, copy);
+#endif
+  if (!siteEnabled(site)) return 0;
+#if defined(ARDEBUG_RATE)
+  if (!ratePass(site)) return 0;
+#endif
+  va_list args;
+  va_start(args, site);
+  size_t len = output(site, VaMessage(site->fmt, args, flash_sites_));
   va_end(args);
-  return (size_t)len;
+  return len;
 }
 
 bool DebugContext::begin(Stream* stream, const char* host_name, const char* file_name) {
   if (stream == nullptr && host_name == nullptr && file_name == nullptr)
     return false;
+#ifdef BOARD_LOW_MEMORY
+    low_memory_ = true;
+    format_ = 0;
+#endif
+#if defined(BOARD_MULTI_CORE)
+  if (sink_mutex == nullptr) sink_mutex = xSemaphoreCreateRecursiveMutex();
+#endif
+  SinkLock lock;
   if (stream != nullptr) {
-    serial_enabled_ = true;
-    serial_ = stream;
+    serial_sink.stream = stream;
+    serial_sink.enabled = true;
+    serial_sink.setLevel(base_level_);
+    addSink(&serial_sink);
   }
 #if defined(BOARD_WIFI) // && !defined(ARDEBUG_WIFI_DISABLED)
   if (host_name && strlen(host_name) > 0) {
     telnet_enabled_ = true;
     strncpy(hostname, host_name, 32);
+    telnet_sink.setLevel(base_level_);
+    addSink(&telnet_sink);
     if (WiFi.isConnected()) {
       server.begin();
       telnet_listening_ = true;
@@ -215,17 +1515,48 @@ bool DebugContext::begin(Stream* stream, const char* host_name, const char* file
 #else // no wifi = no host
   if (host_name != nullptr) return false;
 #endif // BOARD_WIFI
-#ifdef BOARD_LOW_MEMORY
-    low_memory_ = true;
-    show_millis_ = false;
-    show_line_ = false;
-    show_func_ = false;
-    show_core_ = false;
-    show_color_ = false;
-#endif
-  // if (file_name != nullptr) {
-  //   file_enabled_ = true;
-  // }
+#if defined(ARDEBUG_ASYNC_TASK)
+  if (drain_task == nullptr) {
+    xTaskCreatePinnedToCore(drainTask, "ardebug", ARDEBUG_ASYNC_TASK_STACK,
+        this, ARDEBUG_ASYNC_TASK_PRIORITY, &drain_task, ARDEBUG_ASYNC_TASK_CORE);
+  }
+#endif
+#if defined(ARDEBUG_FILE)
+  if (file_name != nullptr && strlen(file_name) > 0) {
+    if (file_system_ == nullptr) {
+#if defined(ARDEBUG_NATIVE)
+      file_system_ = &HostFS;
+#else
+#if defined(ESP32)
+      if (!LittleFS.begin(true)) return false;  // format on first use
+#else
+      if (!LittleFS.begin()) return false;
+#endif
+      file_system_ = &LittleFS;
+#endif
+    }
+    file_enabled_ = file_sink.begin(*file_system_, file_name);
+    if (!file_enabled_) return false;
+    file_sink.setLevel(base_level_);
+    addSink(&file_sink);
+  }
+#else // no filesystem
+  if (file_name != nullptr) return false;
+#endif // ARDEBUG_FILE
+#if defined(ARDEBUG_HISTORY)
+  if (!history_enabled_) replayHistory();
+#endif
+#if defined(ARDEBUG_ESP_LOG)
+  if (esp_log_previous == nullptr) {
+    for (uint8_t id = 0; id < ARDEBUG_MAX_TAGS; id++) {
+      esp_tag_ids[id] = id;
+      for (uint8_t level = 0; level <= ARDEBUG_V; level++) {
+        esp_sites[level][id] = {level, nullptr, 0, nullptr, "", &esp_tag_ids[id]};
+      }
+    }
+    esp_log_previous = esp_log_set_vprintf(espLogHook);
+  }
+#endif
   return true;
 }
 
@@ -240,9 +1571,27 @@ bool DebugContext::setPassword(const char* password) {
 }
 
 void DebugContext::stop() {
+  drain();  // here rather than by the drain task, so nothing queued is lost
+  SinkLock lock;
+#if defined(ARDEBUG_ESP_LOG)
+  if (esp_log_previous) {
+    esp_log_set_vprintf(esp_log_previous);
+    esp_log_previous = nullptr;
+  }
+#endif
+#if defined(ARDEBUG_FILE)
+  if (file_enabled_) {
+    file_sink.end();
+    removeSink(&file_sink);
+    file_enabled_ = false;
+  }
+#endif
 #if defined(BOARD_WIFI) // && !defined(ARDEBUG_WIFI_DISABLED)
   if (telnet_enabled_) {
-    if (client) client.stop();
+    for (TelnetSession& session : sessions) {
+      if (session.client) session.client.stop();
+    }
+    updateLogLevel();
     server.stop();
     telnet_listening_ = false;
   }
@@ -250,6 +1599,21 @@ void DebugContext::stop() {
 }
 
 void DebugContext::handle() {
+  SinkLock lock;  // telnet sessions are also written by the drain task
+#if defined(ARDEBUG_ASYNC) && !defined(ARDEBUG_ASYNC_TASK)
+  drain();
+#elif !defined(ARDEBUG_ASYNC)
+#if defined(ARDEBUG_ISR)
+  emitIsr();
+#endif
+#if defined(ARDEBUG_RATE)
+  emitSuppressed();
+#endif
+#if defined(ARDEBUG_TRACE) && defined(BOARD_WIFI)
+  pumpTrace();
+#endif
+  pollSinks();  // the drain step does this when async
+#endif
 #if defined(BOARD_WIFI) // && !defined(ARDEBUG_WIFI_DISABLED)
   if (telnet_enabled_) {
     if (!telnet_listening_) {
@@ -258,162 +1622,488 @@ void DebugContext::handle() {
         telnet_listening_ = true;
       }
     } else {
-      if (!client && server.hasClient()) {
-        client = server.available();
-        client.setNoDelay(true);
-        client.flush();
-        onConnect();
-      } else if (client.connected()) {
-        while (client.available() > 0) {
-          char c = client.read();
-          if (c == '\r' || strlen(telnet_cmd_) == ARDEBUG_CMD_BUFFER - 1) {
-            processCommand();
+      while (server.hasClient()) {
+        TelnetSession* free_session = nullptr;
+        for (TelnetSession& session : sessions) {
+          if (!session.client) {
+            free_session = &session;
+            break;
+          }
+        }
+        WiFiClient incoming = server.available();
+        if (free_session == nullptr) {
+          incoming.print("Too many telnet clients.\n");
+          incoming.stop();
+          continue;
+        }
+        free_session->client = incoming;
+        free_session->client.setNoDelay(true);
+        free_session->client.flush();
+        onConnect(*free_session);
+      }
+      for (TelnetSession& session : sessions) {
+        if (!session.client) continue;
+        if (!session.client.connected()) {
+          session.client.stop();
+          updateLogLevel();
+          continue;
+        }
+        while (session.client && session.client.available() > 0) {
+          char c = session.client.read();
+          size_t len = strlen(session.cmd);
+          if (c == '\r' || len == ARDEBUG_CMD_BUFFER - 1) {
+            processCommand(session);
           } else if (isPrintable(c) && c != '\n') {
-            telnet_cmd_[strlen(telnet_cmd_)] = c;
+            session.cmd[len] = c;
           }
         }
-      } else {
-        client.stop();
       }
     }
   }
 #endif //BOARD_WIFI
 }
 
+#if defined(ARDEBUG_HISTORY)
+/**
+ * @brief Write the output kept from before the last reset to the sinks.
+ * Called once by begin(), after which the history records this session.
+*/
+void DebugContext::replayHistory() {
+  size_t held = history.valid() ? history.available() : 0;
+  if (held > 0) {
+    char buffer[ARDEBUG_COLOR_HEAD + 64 + ARDEBUG_COLOR_TAIL];
+    LineBuilder note(buffer, sizeof(buffer));
+    note.append("[ardebug] previous session, last ");
+    note.appendUnsigned(held);
+    note.append(" bytes");
+#if defined(ESP32)
+    note.append(", reset reason ");
+    note.appendUnsigned((uint32_t)esp_reset_reason());
+#endif
+    note.append(":\n");
+    notice(note);
+    size_t offset = 0;
+    char chunk[64];
+    if (history.wrapped()) {  // the oldest line is partly overwritten
+      while (offset < held && history.copy(offset++, chunk, 1) == 1 && chunk[0] != '\n') {}
+    }
+    size_t n;
+    while ((n = history.copy(offset, chunk, sizeof(chunk))) > 0) {
+      for (size_t i = 0; i < n; i++) {
+        if (!isPrintable(chunk[i]) && chunk[i] != '\n') chunk[i] = '?';
+      }
+      emitRaw((const uint8_t*)chunk, n, -1);
+      offset += n;
+    }
+    LineBuilder end(buffer, sizeof(buffer));
+    end.append("[ardebug] end of previous session\n");
+    notice(end);
+  }
+  history.reset();
+  history_enabled_ = true;
+  updateLogLevel();
+}
+#endif // ARDEBUG_HISTORY
+
+#if defined(ARDEBUG_FILE)
+void DebugContext::flushFile() {
+  SinkLock lock;
+  if (file_enabled_) file_sink.flush();
+}
+#endif
+
 void DebugContext::disconnect() {
 #if defined(BOARD_WIFI) // && !defined(ARDEBUG_WIFI_DISABLED)
-  if (telnet_enabled_ && client) {
-    if (client.connected())
-      client.print("Closing client connection.\n");
-    client.stop();
+  SinkLock lock;
+  if (telnet_enabled_) {
+    for (TelnetSession& session : sessions) {
+      if (session.client) disconnect(session);
+    }
   }
 #endif // BOARD_WIFI
 }
 
-void DebugContext::onConnect() {
 #if defined(BOARD_WIFI) // && !defined(ARDEBUG_WIFI_DISABLED)
-  if (strlen(password_) > 0) {
-    password_ok_ = false;
-    password_attempt_ = 1;
-  }
-  showHelp();
-#endif // BOARD_WIFI
+void DebugContext::disconnect(TelnetSession& session) {
+#if defined(ARDEBUG_COALESCE)
+  flushSegment(session);
+#endif
+  if (session.client.connected())
+    session.client.print("Closing client connection.\n");
+  session.client.stop();
+  updateLogLevel();
+}
+
+void DebugContext::onConnect(TelnetSession& session) {
+  session.level = base_level_;
+  session.color = (format_ & SHOW_COLOR) != 0;
+  session.password_ok = strlen(password_) == 0;
+  session.password_attempt = 1;
+  session.tracing = false;
+  memset(session.cmd, 0, ARDEBUG_CMD_BUFFER);
+#if defined(ARDEBUG_QUEUE)
+  session.queue.clear();
+#endif
+#if defined(ARDEBUG_COALESCE)
+  session.segment_len = 0;
+  session.segment_lines = 0;
+#endif
+#if defined(ARDEBUG_BACKLOG)
+  session.replaying = false;
+#endif
+  updateLogLevel();  // also resends the binary dictionary
+  showHelp(session);
+#if defined(ARDEBUG_BACKLOG)
+  if (session.password_ok) startReplay(session);
+#endif
+}
+
+// Command responses, with the compile-time format check of the log calls.
+// _P keeps the format in flash.
+#define ARDEBUG_REPLY(session, fmt, ...) \
+    (ARDEBUG_FORMAT_CHECK(fmt, ##__VA_ARGS__), reply(session, fmt, ##__VA_ARGS__))
+#define ARDEBUG_REPLY_P(session, fmt, ...) \
+    (ARDEBUG_FORMAT_CHECK(fmt, ##__VA_ARGS__), reply(session, F(fmt), ##__VA_ARGS__))
+
+// command responses go only to the session that asked, bypassing the queue
+size_t DebugContext::reply(TelnetSession& session, const Message& msg) {
+  char buffer[ARDEBUG_LINE_SIZE];
+  LineBuilder line(buffer, sizeof(buffer));
+  msg.appendTo(line);
+  if (line.length() == 0) return 0;
+  writeClient(session, (const uint8_t*)line.text(), line.length());
+  return line.length();
+}
+
+#if !defined(ARDEBUG_TYPED)
+size_t DebugContext::reply(TelnetSession& session, const char* fmt, ...) {
+  va_list args;
+  va_start(args, fmt);
+  size_t len = reply(session, VaMessage(fmt, args));
+  va_end(args);
+  return len;
+}
+
+size_t DebugContext::reply(TelnetSession& session, const __FlashStringHelper* fmt, ...) {
+  va_list args;
+  va_start(args, fmt);
+  size_t len = reply(session, VaMessage((const char*)fmt, args, true));
+  va_end(args);
+  return len;
 }
+#endif
+#endif // BOARD_WIFI
 
 boolean DebugContext::isConnected() {
 #if defined(BOARD_WIFI) // && !defined(ARDEBUG_WIFI_DISABLED)
-  return (telnet_enabled_ && client.connected());
+  if (!telnet_enabled_) return false;
+  for (TelnetSession& session : sessions) {
+    if (session.client && session.client.connected()) return true;
+  }
 #endif // BOARD_WIFI
   return false;
 }
 
-void DebugContext::showHelp() {
 #if defined(BOARD_WIFI) // && !defined(ARDEBUG_WIFI_DISABLED)
-  bool en = serial_enabled_;
-  if (en) serial_enabled_ = false;
-  if (strlen(password_) > 0 && !password_ok_) {
-    dprintf("Enter password > \r\n");
-  } else {
-    String help = "";
-    help.concat(ARD_COLOR_I);
-    help.concat("\r\n**************************************************");
-    help.concat("\r\n* Remote debug over telnet - version ");
-    help.concat(ARDEBUG_VERSION);
-    help.concat("\r\n* Host name: ");
-    help.concat(hostname);
-    help.concat("\r\n* IP:");
-    help.concat(WiFi.localIP().toString());
-    help.concat("\r\n* MAC: ");
-    help.concat(WiFi.macAddress());
-    help.concat("\r\n* Free Heap RAM: ");
-    help.concat(getFreeMemory());
+// the command list of the help screen, kept in flash
+static const char help_commands[] PROGMEM =
+    "\r\n---------------------------------------------------"
+    "\r\n* Commands:"
+    "\r\n*\t m -> display memory available"
+#if defined(ARDEBUG_STATS)
+    "\r\n*\t stats -> show lines and bytes per level and output, drops and log call times"
+    "\r\n*\t stats reset -> clear the statistics, for all clients"
+#endif
+    "\r\n*\t v -> set your debug level to verbose"
+    "\r\n*\t d -> set your debug level to debug"
+    "\r\n*\t i -> set your debug level to info"
+    "\r\n*\t w -> set your debug level to warning"
+    "\r\n*\t e -> set your debug level to errors"
+    "\r\n*\t l -> show your debug level"
+    "\r\n*\t tag -> list tags and their levels"
+    "\r\n*\t tag <name> <v|d|i|w|e|-> -> set a tag's level, for all clients"
+#if defined(ARDEBUG_TRACE)
+    "\r\n*\t trace -> stream trace events as JSON instead of logs, again to stop"
+#endif
+#if defined(ARDEBUG_PROFILE)
+    "\r\n*\t prof -> show profiled scopes (count, min, p50, p99, max)"
+    "\r\n*\t prof reset -> clear profiled scopes, for all clients"
+#endif
+    "\r\n*\t t -> show time (millis), for all clients"
+    "\r\n*\t c -> show colors"
+    "\r\n*\t q -> quit (close this connection)"
+    "\r\n*\t ? or help -> display these help of commands"
+    "\r\n*"
+    "\r\n**************************************************\r\n"
+    ARD_COLOR_RESET;
+
+void DebugContext::showHelp(TelnetSession& session) {
+  if (!session.password_ok) {
+    ARDEBUG_REPLY(session, "Enter password > \r\n");
+    return;
+  }
+  IPAddress ip = WiFi.localIP();
+  uint8_t mac[6];
+  WiFi.macAddress(mac);
+  ARDEBUG_REPLY_P(session, ARD_COLOR_I "\r\n**************************************************"
+                  "\r\n* Remote debug over telnet - version " ARDEBUG_VERSION
+                  "\r\n* Host name: %s", hostname);
+  ARDEBUG_REPLY_P(session, "\r\n* IP:%u.%u.%u.%u\r\n* MAC: %02X:%02X:%02X:%02X:%02X:%02X"
+                  "\r\n* Free Heap RAM: %u", ip[0], ip[1], ip[2], ip[3],
+                  mac[0], mac[1], mac[2], mac[3], mac[4], mac[5], (unsigned)getFreeMemory());
 #if defined(ESP32) || defined(ESP8266)
-    help.concat("\r\n* ESP SDK version: ");
-    help.concat(ESP.getSdkVersion());
+  ARDEBUG_REPLY_P(session, "\r\n* ESP SDK version: %s", ESP.getSdkVersion());
 #endif // ESP specific
-    help.concat("\r\n---------------------------------------------------");
-    help.concat("\r\n* Commands:");
-    help.concat("\r\n*\t m -> display memory available");
-    help.concat("\r\n*\t v -> set debug level to verbose");
-    help.concat("\r\n*\t d -> set debug level to debug");
-    help.concat("\r\n*\t i -> set debug level to info");
-    help.concat("\r\n*\t w -> set debug level to warning");
-    help.concat("\r\n*\t e -> set debug level to errors");
-    help.concat("\r\n*\t l -> show debug level");
-    help.concat("\r\n*\t t -> show time (millis)");
-    help.concat("\r\n*\t c -> show colors");
-    help.concat("\r\n*\t q -> quit (close this connection)");
-    help.concat("\r\n*\t ? or help -> display these help of commands");
-    help.concat("\r\n*");
-    help.concat("\r\n**************************************************\r\n");
-    help.concat(ARD_COLOR_RESET);
-    dprintf(help.c_str());
-    if (en) serial_enabled_ = true;
-  }
-#endif // BOARD_WIFI
+  writeClient_P(session, help_commands);
 }
 
-void DebugContext::processCommand() {
-#if defined(BOARD_WIFI) // && !defined(ARDEBUG_WIFI_DISABLED)  
-  if (strlen(password_) > 0 && !password_ok_) {  // Process the password - 18/08/18 - adjust in 04/09/08 and 2018-10-19
-    if (strcmp(telnet_cmd_, password_) == 0) {
-      dprintf("* Password ok, allowing access now...\n");
-      password_ok_ = true;
-      showHelp();
+void DebugContext::processCommand(TelnetSession& session) {
+  const char* cmd = session.cmd;
+  if (!session.password_ok) {  // Process the password - 18/08/18 - adjust in 04/09/08 and 2018-10-19
+    if (strcmp(cmd, password_) == 0) {
+      ARDEBUG_REPLY(session, "* Password ok, allowing access now...\n");
+      session.password_ok = true;
+      updateLogLevel();
+      showHelp(session);
+#if defined(ARDEBUG_BACKLOG)
+      startReplay(session);
+#endif
     } else {
-      dprintf("*** Invalid password ***\n");
-      password_attempt_++;
-      if (password_attempt_ > ARDEBUG_MAX_PWD_ATTEMPTS) {
-        dprintf("*** Too many attempts ***\n");
-        disconnect();
+      ARDEBUG_REPLY(session, "*** Invalid password ***\n");
+      session.password_attempt++;
+      if (session.password_attempt > ARDEBUG_MAX_PWD_ATTEMPTS) {
+        ARDEBUG_REPLY(session, "*** Too many attempts ***\n");
+        disconnect(session);
       }
     }
   } else {
-    if (strcmp(telnet_cmd_, "h") == 0 || strcmp(telnet_cmd_, "?") == 0) {
-      showHelp();
-    } else if (strcmp(telnet_cmd_, "q") == 0) {
-      disconnect();
-    } else if (strcmp(telnet_cmd_, "m") == 0) {
-      dprintf("Free heap RAM: %d", getFreeMemory());
+    if (strcmp(cmd, "h") == 0 || strcmp(cmd, "?") == 0) {
+      showHelp(session);
+    } else if (strcmp(cmd, "q") == 0) {
+      disconnect(session);
+    } else if (strcmp(cmd, "m") == 0) {
+      ARDEBUG_REPLY(session, "Free heap RAM: %u", (unsigned)getFreeMemory());
+#if defined(ARDEBUG_COALESCE)
+      uint32_t lines;
+      uint32_t segments = telnetSegments(&lines);
+      uint32_t tenths = segments > 0 ? (uint32_t)((uint64_t)lines * 10 / segments) : 0;
+      ARDEBUG_REPLY(session, "\r\nTelnet: %lu lines in %lu segments, %lu.%lu per segment",
+            (unsigned long)lines, (unsigned long)segments,
+            (unsigned long)(tenths / 10), (unsigned long)(tenths % 10));
+#endif
+#if defined(ARDEBUG_BACKLOG)
+      ARDEBUG_REPLY(session, "\r\nBacklog: %u lines, %u of %u bytes",
+            (unsigned)backlog.records(), (unsigned)backlog.size(), (unsigned)ARDEBUG_BACKLOG_SIZE);
+#endif
+#if defined(ARDEBUG_STATS)
+    } else if (strncmp(cmd, "stats", 5) == 0 && (cmd[5] == 0 || cmd[5] == ' ')) {
+      statsCommand(session, cmd + 5);
+#endif
 #if defined(ESP8266)
-    } else if (strcmp(telnet_cmd_, "cpu80") == 0) {
+    } else if (strcmp(cmd, "cpu80") == 0) {
       system_update_cpu_freq(80);
-      dprintf("CPU ESP8266 changed to: 80 MHz");
-    } else if (strcmp(telnet_cmd_, "cpu160") == 0) {
+      ARDEBUG_REPLY(session, "CPU ESP8266 changed to: 80 MHz");
+    } else if (strcmp(cmd, "cpu160") == 0) {
       system_update_cpu_freq(160);
-      dprintf("CPU ESP8266 changed to: 160 MHz");
-#endif
-    } else if (strcmp(telnet_cmd_, "v") == 0) {
-      log_level_ = ARDEBUG_V;
-      dprintf("Log level set to VERBOSE\n");
-    } else if (strcmp(telnet_cmd_, "d") == 0) {
-      log_level_ = ARDEBUG_D;
-      dprintf("Log level set to DEBUG\n");
-    } else if (strcmp(telnet_cmd_, "i") == 0) {
-      log_level_ = ARDEBUG_I;
-      dprintf("Log level set to INFO\n");
-    } else if (strcmp(telnet_cmd_, "w") == 0) {
-      log_level_ = ARDEBUG_W;
-      dprintf("Log level set to WARNING\n");
-    } else if (strcmp(telnet_cmd_, "e") == 0) {
-      log_level_ = ARDEBUG_E;
-      dprintf("Log level set to ERROR\n");
-    } else if (strcmp(telnet_cmd_, "l") == 0) {
-      dprintf("Log level: %d\n", log_level_);
-    } else if (strcmp(telnet_cmd_, "t") == 0) {
-      show_millis_ = !show_millis_;
-      dprintf("* Include time: %s\r\n", (show_millis_) ? "On" : "Off");
-    } else if (strcmp(telnet_cmd_, "c") == 0) {
-      show_color_ = !show_color_;
-      dprintf("* Show colors: %s\r\n", (show_color_) ? "On" : "Off");
+      ARDEBUG_REPLY(session, "CPU ESP8266 changed to: 160 MHz");
+#endif
+    } else if (strcmp(cmd, "v") == 0) {
+      session.level = ARDEBUG_V;
+      updateLogLevel();
+      ARDEBUG_REPLY(session, "Log level set to VERBOSE\n");
+    } else if (strcmp(cmd, "d") == 0) {
+      session.level = ARDEBUG_D;
+      updateLogLevel();
+      ARDEBUG_REPLY(session, "Log level set to DEBUG\n");
+    } else if (strcmp(cmd, "i") == 0) {
+      session.level = ARDEBUG_I;
+      updateLogLevel();
+      ARDEBUG_REPLY(session, "Log level set to INFO\n");
+    } else if (strcmp(cmd, "w") == 0) {
+      session.level = ARDEBUG_W;
+      updateLogLevel();
+      ARDEBUG_REPLY(session, "Log level set to WARNING\n");
+    } else if (strcmp(cmd, "e") == 0) {
+      session.level = ARDEBUG_E;
+      updateLogLevel();
+      ARDEBUG_REPLY(session, "Log level set to ERROR\n");
+    } else if (strcmp(cmd, "l") == 0) {
+      ARDEBUG_REPLY(session, "Log level: %d\n", session.level);
+    } else if (strncmp(cmd, "tag", 3) == 0 && (cmd[3] == 0 || cmd[3] == ' ')) {
+      tagCommand(session, cmd + 3);
+#if defined(ARDEBUG_TRACE)
+    } else if (strcmp(cmd, "trace") == 0) {
+      traceCommand(session);
+#endif
+#if defined(ARDEBUG_PROFILE)
+    } else if (strncmp(cmd, "prof", 4) == 0 && (cmd[4] == 0 || cmd[4] == ' ')) {
+      profileCommand(session, cmd + 4);
+#endif
+    } else if (strcmp(cmd, "t") == 0) {
+      boolean show = !(format_ & SHOW_MILLIS);
+      setFormat(SHOW_MILLIS, show);
+      ARDEBUG_REPLY(session, "* Include time: %s\r\n", show ? "On" : "Off");
+    } else if (strcmp(cmd, "c") == 0) {
+      session.color = !session.color;
+      ARDEBUG_REPLY(session, "* Show colors: %s\r\n", (session.color) ? "On" : "Off");
     } else {
-      dprintf("Unknown command: %s\n", telnet_cmd_);
+      ARDEBUG_REPLY(session, "Unknown command: %s\n", cmd);
     }
   }
-  memset(telnet_cmd_, 0, ARDEBUG_CMD_BUFFER);
-#endif // BOARD_WIFI
+  memset(session.cmd, 0, ARDEBUG_CMD_BUFFER);
+}
+
+// "tag" lists the tags, "tag <name> <level>" sets one, '-' clears it
+void DebugContext::tagCommand(TelnetSession& session, const char* args) {
+  while (*args == ' ') args++;
+  if (*args == 0) {
+    for (uint8_t id = 1; id < tag_count; id++) {
+      if (tag_levels[id] < 0) ARDEBUG_REPLY(session, "* %s: -\r\n", tag_names[id]);
+      else ARDEBUG_REPLY(session, "* %s: %c\r\n", tag_names[id], levelLabel(tag_levels[id]));
+    }
+    if (tag_count == 1) ARDEBUG_REPLY(session, "* No tags\r\n");
+    return;
+  }
+  char name[ARDEBUG_TAG_SIZE] = {0};
+  size_t len = 0;
+  while (args[len] != 0 && args[len] != ' ') len++;
+  memcpy(name, args, len < sizeof(name) - 1 ? len : sizeof(name) - 1);
+  const char* value = args + len;
+  while (*value == ' ') value++;
+  static const char letters[] = "ewidv";
+  const char* letter = *value ? strchr(letters, *value) : nullptr;
+  if (*value != '-' && letter == nullptr) {
+    ARDEBUG_REPLY(session, "Usage: tag <name> <v|d|i|w|e|->\r\n");
+  } else if (!setTagLevel(name, *value == '-' ? -1 : (int8_t)(letter - letters))) {
+    ARDEBUG_REPLY(session, "* Too many tags\r\n");
+  } else {
+    ARDEBUG_REPLY(session, "* Tag %s level: %c\r\n", name, *value == '-' ? '-' : levelLabel(letter - letters));
+  }
 }
 
+#if defined(ARDEBUG_PROFILE)
+// "prof" lists the profiled scopes, "prof reset" clears them
+void DebugContext::profileCommand(TelnetSession& session, const char* args) {
+  while (*args == ' ') args++;
+  if (strcmp(args, "reset") == 0) {
+    resetProfiles();
+    ARDEBUG_REPLY(session, "* Profiles reset\r\n");
+  } else if (*args != 0) {
+    ARDEBUG_REPLY(session, "Usage: prof [reset]\r\n");
+  } else {
+    uint8_t count = profile_count.load(std::memory_order_acquire);
+    char buffer[ARDEBUG_LINE_SIZE];
+    for (uint8_t id = 0; id < count; id++) {
+      LineBuilder line(buffer, sizeof(buffer));
+      line.append("* ");
+      appendProfile(line, id);
+      line.append("\r\n");
+      writeClient(session, (const uint8_t*)line.text(), line.length());
+    }
+    if (count == 0) ARDEBUG_REPLY(session, "* No profiled scopes\r\n");
+  }
+}
+#endif // ARDEBUG_PROFILE
+
+#if defined(ARDEBUG_STATS)
+static const char stat_level_names[ARDEBUG_STATS_LEVELS][6] = {"E", "W", "I", "D", "V", "other"};
+
+// "stats" shows the counters, "stats reset" clears them
+void DebugContext::statsCommand(TelnetSession& session, const char* args) {
+  while (*args == ' ') args++;
+  if (strcmp(args, "reset") == 0) {
+    resetStats();
+    ARDEBUG_REPLY(session, "* Statistics reset\r\n");
+    return;
+  } else if (*args != 0) {
+    ARDEBUG_REPLY(session, "Usage: stats [reset]\r\n");
+    return;
+  }
+  DebugStats counts;
+  stats(counts);
+  char buffer[ARDEBUG_LINE_SIZE];
+  LineBuilder lines(buffer, sizeof(buffer));
+  lines.append("* Lines:");
+  for (uint8_t i = 0; i < ARDEBUG_STATS_LEVELS; i++) {
+    lines.append(' ');
+    lines.append(stat_level_names[i]);
+    lines.append('=');
+    lines.appendUnsigned(counts.lines[i]);
+  }
+  lines.append("\r\n");
+  writeClient(session, (const uint8_t*)lines.text(), lines.length());
+  LineBuilder bytes(buffer, sizeof(buffer));
+  bytes.append("* Bytes:");
+  for (uint8_t i = 0; i < ARDEBUG_STATS_LEVELS; i++) {
+    bytes.append(' ');
+    bytes.append(stat_level_names[i]);
+    bytes.append('=');
+    bytes.appendUnsigned(counts.bytes[i]);
+  }
+  bytes.append("\r\n");
+  writeClient(session, (const uint8_t*)bytes.text(), bytes.length());
+  for (uint8_t i = 0; i < sink_count_; i++) {
+    ARDEBUG_REPLY(session, "* %s: %lu lines, %lu bytes offered\r\n", sinks_[i]->name(),
+          (unsigned long)sinks_[i]->offeredLines(), (unsigned long)sinks_[i]->offeredBytes());
+  }
+  ARDEBUG_REPLY(session, "* Truncated: %lu, dropped: %lu\r\n",
+        (unsigned long)counts.truncated, (unsigned long)counts.dropped);
+  LineBuilder latency(buffer, sizeof(buffer));
+  latency.append("* ");
+  appendHistogram(latency, "Log calls", call_latency);
+  latency.append("\r\n");
+  writeClient(session, (const uint8_t*)latency.text(), latency.length());
+}
+#endif // ARDEBUG_STATS
+
+#if defined(ARDEBUG_TRACE)
+// "trace" turns a session into a stream of Trace Event JSON, "trace" again ends it
+void DebugContext::traceCommand(TelnetSession& session) {
+  if (trace_session_ == &session) {
+    trace_session_ = nullptr;
+    session.tracing = false;
+    ARDEBUG_REPLY(session, "]\n");
+    updateLogLevel();
+  } else if (trace_session_ != nullptr) {
+    ARDEBUG_REPLY(session, "* Trace already streaming to another client\r\n");
+  } else {
+    trace_session_ = &session;
+    session.tracing = true;
+    updateLogLevel();
+    char buffer[ARDEBUG_LINE_SIZE];
+    ARDEBUG_REPLY(session, "[\n");
+    for (uint8_t core = 0; core < BOARD_CORES; core++) {
+      LineBuilder line(buffer, sizeof(buffer));
+      appendTraceNames(line, core);
+      writeClient(session, (const uint8_t*)line.text(), line.length());
+    }
+  }
+}
+
+// events go out as the client's queue frees up, so none is dropped there
+void DebugContext::pumpTrace() {
+  TelnetSession* session = trace_session_;
+  if (session == nullptr) return;
+  if (!session->client) {
+    session->tracing = false;
+    trace_session_ = nullptr;
+    return;
+  }
+  char buffer[ARDEBUG_LINE_SIZE];
+  TraceEvent event;
+  for (uint8_t i = 0; i < 32; i++) {
+#if defined(ARDEBUG_QUEUE)
+    if (ARDEBUG_QUEUE_SIZE - session->queue.size() < 2 * sizeof(buffer)) break;
+#endif
+    if (!trace_ring.pop(event)) break;
+    LineBuilder line(buffer, sizeof(buffer));
+    appendTraceEvent(line, event);
+    writeClient(*session, (const uint8_t*)line.text(), line.length());
+  }
+}
+#endif // ARDEBUG_TRACE
+#endif // BOARD_WIFI
+
 uint32_t DebugContext::getFreeMemory() {
   uint32_t free = 0;
 #if defined(ESP32) || defined(ESP8266)
@@ -0,0 +1,49 @@
+#include "ardebug.h"
+
+#if !defined(ARDEBUG_DISABLED) && defined(ARDEBUG_BACKLOG)
+
+namespace ardebug {
+
+#define ARDEBUG_BACKLOG_MASK (ARDEBUG_BACKLOG_SIZE - 1)
+#define ARDEBUG_BACKLOG_RAW 0x80  // in the level byte, which holds level + 1
+
+void Backlog::append(int8_t level, bool raw, const uint8_t* data, size_t len) {
+  if (len == 0) return;
+  if (len > ARDEBUG_BACKLOG_RECORD) len = ARDEBUG_BACKLOG_RECORD;
+  while (ARDEBUG_BACKLOG_SIZE - size() < len + 3) {
+    begin_ += 3 + recordLength(begin_);
+    records_--;
+  }
+  buffer_[end_ & ARDEBUG_BACKLOG_MASK] = len & 0xFF;
+  buffer_[(end_ + 1) & ARDEBUG_BACKLOG_MASK] = len >> 8;
+  buffer_[(end_ + 2) & ARDEBUG_BACKLOG_MASK] =
+      (uint8_t)(level + 1) | (raw ? ARDEBUG_BACKLOG_RAW : 0);
+  size_t pos = (end_ + 3) & ARDEBUG_BACKLOG_MASK;
+  size_t first = ARDEBUG_BACKLOG_SIZE - pos;
+  if (first > len) first = len;
+  memcpy(buffer_ + pos, data, first);
+  memcpy(buffer_, data + first, len - first);
+  end_ += 3 + len;
+  records_++;
+}
+
+void Backlog::clear() {
+  begin_ = end_;
+  records_ = 0;
+}
+
+uint32_t Backlog::read(uint32_t pos, int8_t* level, bool* raw, uint8_t* out, size_t* len) const {
+  *len = recordLength(pos);
+  *level = (int8_t)(at(pos + 2) & ~ARDEBUG_BACKLOG_RAW) - 1;
+  *raw = (at(pos + 2) & ARDEBUG_BACKLOG_RAW) != 0;
+  size_t start = (pos + 3) & ARDEBUG_BACKLOG_MASK;
+  size_t first = ARDEBUG_BACKLOG_SIZE - start;
+  if (first > *len) first = *len;
+  memcpy(out, buffer_ + start, first);
+  memcpy(out + first, buffer_, *len - first);
+  return pos + 3 + *len;
+}
+
+} // namespace ardebug
+
+#endif // ARDEBUG_BACKLOG
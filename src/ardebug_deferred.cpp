@@ -0,0 +1,192 @@
+#include "ardebug.h"
+
+#if !defined(ARDEBUG_DISABLED) && defined(ARDEBUG_DEFERRED)
+
+namespace ardebug {
+
+struct PackedArg {
+  char type;
+  int64_t i;
+  double f;
+  const char* s;
+  uint8_t slen;
+};
+
+static bool nextArg(const uint8_t* args, size_t len, size_t* pos, PackedArg* arg) {
+  if (*pos >= len) return false;
+  arg->type = (char)args[(*pos)++];
+  switch (arg->type) {
+    case ARDEBUG_ARG_I32: {
+      int32_t x;
+      if (*pos + sizeof(x) > len) return false;
+      memcpy(&x, args + *pos, sizeof(x));
+      *pos += sizeof(x);
+      arg->i = x;
+      arg->f = x;
+      return true;
+    }
+    case ARDEBUG_ARG_I64:
+    case ARDEBUG_ARG_PTR: {
+      int64_t x;
+      if (*pos + sizeof(x) > len) return false;
+      memcpy(&x, args + *pos, sizeof(x));
+      *pos += sizeof(x);
+      arg->i = x;
+      arg->f = (double)x;
+      return true;
+    }
+    case ARDEBUG_ARG_F64:
+      if (*pos + sizeof(double) > len) return false;
+      memcpy(&arg->f, args + *pos, sizeof(double));
+      *pos += sizeof(double);
+      arg->i = (int64_t)arg->f;
+      return true;
+    case ARDEBUG_ARG_STR:
+      if (*pos >= len) return false;
+      arg->slen = args[(*pos)++];
+      if (*pos + arg->slen > len) return false;
+      arg->s = (const char*)args + *pos;
+      *pos += arg->slen;
+      return true;
+  }
+  return false;
+}
+
+size_t formatPacked(char* out, size_t size, const char* fmt,
+                    const uint8_t* args, size_t args_len) {
+  if (size == 0) return 0;
+  size_t n = 0;
+  size_t pos = 0;
+  const char* p = fmt;
+  while (*p && n < size - 1) {
+    if (*p != '%') {
+      out[n++] = *p++;
+      continue;
+    }
+    if (p[1] == '%') {
+      out[n++] = '%';
+      p += 2;
+      continue;
+    }
+    // rebuild the conversion with a length modifier matching the stored type
+    char spec[24];
+    size_t sl = 0;
+    spec[sl++] = *p++;
+    while (*p && strchr("-+ #0123456789.*", *p) && sl < sizeof(spec) - 8) {
+      PackedArg star;
+      if (*p == '*') {
+        if (nextArg(args, args_len, &pos, &star))
+          sl += snprintf(spec + sl, sizeof(spec) - 8 - sl, "%d", (int)star.i);
+        p++;
+      } else {
+        spec[sl++] = *p++;
+      }
+    }
+    while (*p && strchr("hlLqjzt", *p)) p++;
+    char conv = *p;
+    if (!conv) break;
+    p++;
+    PackedArg arg;
+    size_t room = size - n;
+    int written;
+    if (!nextArg(args, args_len, &pos, &arg)) {
+      written = snprintf(out + n, room, "<?>");
+    } else {
+      switch (conv) {
+        case 'd': case 'i': case 'u': case 'o': case 'x': case 'X': {
+          long long value = arg.i;
+          if (conv != 'd' && conv != 'i' && arg.type == ARDEBUG_ARG_I32)
+            value = (uint32_t)arg.i;
+          spec[sl++] = 'l';
+          spec[sl++] = 'l';
+          spec[sl++] = conv;
+          spec[sl] = 0;
+          written = snprintf(out + n, room, spec, value);
+          break;
+        }
+        case 'c':
+          spec[sl++] = conv;
+          spec[sl] = 0;
+          written = snprintf(out + n, room, spec, (int)arg.i);
+          break;
+        case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': case 'a': case 'A':
+          spec[sl++] = conv;
+          spec[sl] = 0;
+          written = snprintf(out + n, room, spec, arg.f);
+          break;
+        case 's':
+          if (arg.type == ARDEBUG_ARG_STR) {
+            char str[256];
+            memcpy(str, arg.s, arg.slen);
+            str[arg.slen] = 0;
+            spec[sl++] = conv;
+            spec[sl] = 0;
+            written = snprintf(out + n, room, spec, str);
+          } else {
+            written = snprintf(out + n, room, "<?>");
+          }
+          break;
+        case 'p':
+          written = snprintf(out + n, room, "%p", (void*)(uintptr_t)arg.i);
+          break;
+        default:
+          spec[sl++] = conv;
+          spec[sl] = 0;
+          written = snprintf(out + n, room, "%s", spec);
+      }
+    }
+    if (written > 0) n += (size_t)written < room ? (size_t)written : room - 1;
+  }
+  out[n] = 0;
+  return n;
+}
+
+static size_t putFrameHeader(uint8_t* out, char type, size_t payload) {
+  out[0] = ARDEBUG_FRAME_START;
+  out[1] = (uint8_t)type;
+  out[2] = (uint8_t)(payload & 0xFF);
+  out[3] = (uint8_t)(payload >> 8);
+  return ARDEBUG_FRAME_HEADER;
+}
+
+static size_t putString(uint8_t* out, size_t room, const char* str) {
+  if (str == nullptr) str = "";
+  size_t n = strlen(str) + 1;
+  if (n > room) n = room;
+  memcpy(out, str, n);
+  if (n > 0) out[n - 1] = 0;
+  return n;
+}
+
+size_t encodeSiteFrame(uint8_t* out, size_t size, uint32_t id, const CallSite* site) {
+  const size_t fixed = ARDEBUG_FRAME_HEADER + sizeof(id) + 1 + sizeof(uint16_t);
+  if (size < fixed + 3) return 0;
+  size_t n = ARDEBUG_FRAME_HEADER;
+  uint16_t line = (uint16_t)site->line;
+  memcpy(out + n, &id, sizeof(id));
+  n += sizeof(id);
+  out[n++] = site->level;
+  memcpy(out + n, &line, sizeof(line));
+  n += sizeof(line);
+  n += putString(out + n, size - n - 2, site->file);
+  n += putString(out + n, size - n - 1, site->func);
+  n += putString(out + n, size - n, site->fmt);
+  putFrameHeader(out, ARDEBUG_FRAME_SITE, n - ARDEBUG_FRAME_HEADER);
+  return n;
+}
+
+size_t encodeRecordFrame(uint8_t* out, size_t size, uint32_t id, uint32_t ms,
+                         uint8_t core, const uint8_t* args, size_t args_len) {
+  size_t n = ARDEBUG_FRAME_HEADER + sizeof(id) + sizeof(ms) + 1;
+  if (size < n + args_len) return 0;
+  putFrameHeader(out, ARDEBUG_FRAME_RECORD, n - ARDEBUG_FRAME_HEADER + args_len);
+  memcpy(out + ARDEBUG_FRAME_HEADER, &id, sizeof(id));
+  memcpy(out + ARDEBUG_FRAME_HEADER + sizeof(id), &ms, sizeof(ms));
+  out[n - 1] = core;
+  memcpy(out + n, args, args_len);
+  return n + args_len;
+}
+
+} // namespace ardebug
+
+#endif // ARDEBUG_DEFERRED
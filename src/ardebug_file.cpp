@@ -0,0 +1,103 @@
+#include "ardebug.h"
+
+#if !defined(ARDEBUG_DISABLED) && defined(ARDEBUG_FILE)
+
+namespace ardebug {
+
+bool FileSink::begin(fs::FS& fs, const char* path) {
+  end();
+  fs_ = &fs;
+  strncpy(path_, path, ARDEBUG_FILE_PATH_SIZE - 1);
+  return open();
+}
+
+void FileSink::end() {
+  if (file_) {
+    flush();
+    file_.close();
+  }
+}
+
+bool FileSink::open() {
+  file_ = fs_->open(path_, "a");
+  size_ = file_ ? (uint32_t)file_.size() : 0;
+  last_write_ = millis();
+  return (bool)file_;
+}
+
+// <path>.<n>, n is a single digit
+static void rotatedPath(char* out, const char* path, int n) {
+  size_t len = strlen(path);
+  memcpy(out, path, len);
+  out[len] = '.';
+  out[len + 1] = (char)('0' + n);
+  out[len + 2] = 0;
+}
+
+void FileSink::rotate() {
+  char from[ARDEBUG_FILE_PATH_SIZE + 4];
+  char to[ARDEBUG_FILE_PATH_SIZE + 4];
+  file_.close();
+  rotatedPath(to, path_, ARDEBUG_FILE_COUNT);
+  if (fs_->exists(to)) fs_->remove(to);
+  for (int i = ARDEBUG_FILE_COUNT - 1; i > 0; i--) {
+    rotatedPath(from, path_, i);
+    rotatedPath(to, path_, i + 1);
+    if (fs_->exists(from)) fs_->rename(from, to);
+  }
+  rotatedPath(to, path_, 1);
+  fs_->rename(path_, to);
+  rotations_++;
+  open();
+}
+
+void FileSink::writeBlock() {
+  if (used_ == 0) return;
+  if (file_) {
+    file_.write(block_, used_);
+    file_.flush();
+  }
+  size_ += used_;
+  used_ = 0;
+  last_write_ = millis();
+}
+
+void FileSink::write(const LogRecord& record) {
+  append(record.text(), record.length(), record.level);
+}
+
+void FileSink::writeRaw(const uint8_t* data, size_t len, int8_t level) {
+  append((const char*)data, len, level);
+}
+
+void FileSink::append(const char* text, size_t len, int8_t level) {
+  if (!file_) return;
+  if (size_ + used_ + len > ARDEBUG_FILE_MAX_SIZE && size_ + used_ > 0) {
+    writeBlock();  // lines never straddle two files
+    rotate();
+  }
+  while (len > 0) {
+    // after a partial write the block ends at the next boundary of the file
+    size_t block = ARDEBUG_FILE_BLOCK_SIZE - size_ % ARDEBUG_FILE_BLOCK_SIZE;
+    size_t n = block - used_;
+    if (len < n) n = len;
+    memcpy(block_ + used_, text, n);
+    used_ += n;
+    text += n;
+    len -= n;
+    if (used_ == block) writeBlock();
+  }
+  if (level == ARDEBUG_E) writeBlock();
+}
+
+void FileSink::poll() {
+  if (used_ > 0 && millis() - last_write_ >= ARDEBUG_FILE_FLUSH_MS) writeBlock();
+}
+
+void FileSink::flush() {
+  writeBlock();
+}
+
+} // namespace ardebug
+
+#endif // ARDEBUG_FILE
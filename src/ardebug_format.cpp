@@ -0,0 +1,345 @@
+#include "ardebug.h"
+
+#if !defined(ARDEBUG_DISABLED) && defined(ARDEBUG_TYPED)
+
+namespace ardebug {
+
+#define ARDEBUG_FORMAT_DECIMALS 9  // most digits after the point of a float
+
+static const uint32_t decimal_powers[ARDEBUG_FORMAT_DECIMALS + 1] = {
+  1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000, 1000000000
+};
+
+static void appendRepeat(LineBuilder& line, char c, size_t count) {
+  while (count-- > 0) line.append(c);
+}
+
+// `head` (sign, "0x"), `zeros` zeros and `body`, padded to the width of `spec`
+static void appendField(LineBuilder& line, const FormatSpec& spec, const char* head,
+                        size_t head_len, size_t zeros, const char* body, size_t body_len,
+                        bool zero_fill) {
+  size_t len = head_len + zeros + body_len;
+  size_t pad = spec.width > len ? spec.width - len : 0;
+  if (!spec.left && !zero_fill) appendRepeat(line, ' ', pad);
+  line.append(head, head_len);
+  if (!spec.left && zero_fill) zeros += pad;
+  appendRepeat(line, '0', zeros);
+  line.append(body, body_len);
+  if (spec.left) appendRepeat(line, ' ', pad);
+}
+
+// digits of `value` written backwards ending at `end`, returns the first
+static char* toDigits(char* end, uint32_t value, uint8_t base, bool upper) {
+  const char* digits = upper ? "0123456789ABCDEF" : "0123456789abcdef";
+  do {
+    *--end = digits[value % base];
+    value /= base;
+  } while (value > 0);
+  return end;
+}
+
+// 64-bit division only for the high digits
+static char* toDigits64(char* end, uint64_t value, uint8_t base, bool upper) {
+  const char* digits = upper ? "0123456789ABCDEF" : "0123456789abcdef";
+  while (value > UINT32_MAX) {
+    *--end = digits[value % base];
+    value /= base;
+  }
+  return toDigits(end, (uint32_t)value, base, upper);
+}
+
+static uint8_t integerBase(char conv) {
+  return conv == 'x' || conv == 'X' ? 16 : conv == 'o' ? 8 : 10;
+}
+
+static void appendInteger(LineBuilder& line, const FormatSpec& spec, bool negative,
+                          const char* digits, const char* end) {
+  char head[2];
+  size_t head_len = 0;
+  if (negative) {
+    head[head_len++] = '-';
+  } else if (spec.sign && (spec.conv == 'd' || spec.conv == 'i')) {
+    head[head_len++] = spec.sign;
+  }
+  size_t len = end - digits;
+  bool zero = len == 1 && digits[0] == '0';
+  if (zero && spec.precision == 0) len = 0;  // "%.0d" of 0 is empty
+  size_t zeros = spec.precision > (int)len ? spec.precision - len : 0;
+  if (spec.alt && !zero && (spec.conv == 'x' || spec.conv == 'X')) {
+    head[head_len++] = '0';
+    head[head_len++] = spec.conv;
+  }
+  if (spec.alt && spec.conv == 'o' && zeros == 0 && (len == 0 || digits[0] != '0')) zeros = 1;
+  appendField(line, spec, head, head_len, zeros, digits, len, spec.zero && spec.precision < 0);
+}
+
+void formatUnsigned(LineBuilder& line, const FormatSpec& spec, const FormatArg& arg) {
+  if (spec.conv == 'c') {
+    char c = (char)arg.u;
+    appendField(line, spec, "", 0, 0, &c, 1, false);
+    return;
+  }
+  char digits[11];
+  char* end = digits + sizeof(digits);
+  char* first = toDigits(end, arg.u, integerBase(spec.conv), spec.conv == 'X');
+  appendInteger(line, spec, false, first, end);
+}
+
+// %u, %x and %o of a negative value write its bits, as printf does
+void formatSigned(LineBuilder& line, const FormatSpec& spec, const FormatArg& arg) {
+  if (spec.conv != 'd' && spec.conv != 'i') {
+    FormatArg bits;
+    bits.u = (uint32_t)arg.i;
+    formatUnsigned(line, spec, bits);
+    return;
+  }
+  char digits[10];
+  char* end = digits + sizeof(digits);
+  uint32_t magnitude = arg.i < 0 ? 0u - (uint32_t)arg.i : (uint32_t)arg.i;
+  appendInteger(line, spec, arg.i < 0, toDigits(end, magnitude, 10, false), end);
+}
+
+void formatUnsigned64(LineBuilder& line, const FormatSpec& spec, const FormatArg& arg) {
+  if (spec.conv == 'c') {
+    FormatArg low;
+    low.u = (uint32_t)arg.ull;
+    formatUnsigned(line, spec, low);
+    return;
+  }
+  char digits[22];
+  char* end = digits + sizeof(digits);
+  char* first = toDigits64(end, arg.ull, integerBase(spec.conv), spec.conv == 'X');
+  appendInteger(line, spec, false, first, end);
+}
+
+void formatSigned64(LineBuilder& line, const FormatSpec& spec, const FormatArg& arg) {
+  if (spec.conv != 'd' && spec.conv != 'i') {
+    FormatArg bits;
+    bits.ull = (uint64_t)arg.ll;
+    formatUnsigned64(line, spec, bits);
+    return;
+  }
+  char digits[20];
+  char* end = digits + sizeof(digits);
+  uint64_t magnitude = arg.ll < 0 ? 0u - (uint64_t)arg.ll : (uint64_t)arg.ll;
+  appendInteger(line, spec, arg.ll < 0, toDigits64(end, magnitude, 10, false), end);
+}
+
+void formatPointer(LineBuilder& line, const FormatSpec& spec, const FormatArg& arg) {
+  char digits[2 * sizeof(uintptr_t)];
+  char* end = digits + sizeof(digits);
+#if UINTPTR_MAX > UINT32_MAX
+  char* first = toDigits64(end, (uintptr_t)arg.p, 16, false);
+#else
+  char* first = toDigits(end, (uintptr_t)arg.p, 16, false);
+#endif
+  appendField(line, spec, "0x", 2, 0, first, end - first, false);
+}
+
+void formatString(LineBuilder& line, const FormatSpec& spec, const FormatArg& arg) {
+  if (spec.conv == 'p') {
+    formatPointer(line, spec, arg);
+    return;
+  }
+  const char* str = arg.s ? arg.s : "(null)";
+  size_t len = 0;
+  while (str[len] != 0 && (spec.precision < 0 || len < (size_t)spec.precision)) len++;
+  appendField(line, spec, "", 0, 0, str, len, false);
+}
+
+// `value` >= 0 split into its integer part and `decimals` rounded decimals
+static uint64_t splitFixed(double value, uint8_t decimals, uint32_t* fraction) {
+  uint64_t whole = (uint64_t)value;
+  uint32_t scaled = (uint32_t)((value - (double)whole) * decimal_powers[decimals] + 0.5);
+  if (scaled >= decimal_powers[decimals]) {
+    whole++;
+    scaled -= decimal_powers[decimals];
+  }
+  *fraction = scaled;
+  return whole;
+}
+
+static size_t putFixed(char* out, uint64_t whole, uint32_t fraction, uint8_t decimals,
+                       bool point) {
+  char digits[20];
+  char* end = digits + sizeof(digits);
+  char* first = toDigits64(end, whole, 10, false);
+  size_t n = end - first;
+  memcpy(out, first, n);
+  if (decimals > 0 || point) out[n++] = '.';
+  for (uint8_t i = decimals; i > 0; i--) {
+    out[n + i - 1] = '0' + fraction % 10;
+    fraction /= 10;
+  }
+  return n + decimals;
+}
+
+// `value` > 0 scaled into [1, 10), returns the power of 10 it was scaled by
+static int16_t normalize(double& value) {
+  int16_t exponent = 0;
+  while (value >= 1e8) { value /= 1e8; exponent += 8; }
+  while (value >= 10) { value /= 10; exponent++; }
+  while (value < 1e-7) { value *= 1e8; exponent -= 8; }
+  while (value < 1) { value *= 10; exponent--; }
+  return exponent;
+}
+
+static size_t putExponent(char* out, double value, uint8_t decimals, bool point, bool upper) {
+  int16_t exponent = value == 0 ? 0 : normalize(value);
+  uint32_t fraction;
+  uint64_t whole = splitFixed(value, decimals, &fraction);
+  if (whole >= 10) {  // 9.99.. rounded up
+    whole = 1;
+    exponent++;
+  }
+  size_t n = putFixed(out, whole, fraction, decimals, point);
+  out[n++] = upper ? 'E' : 'e';
+  out[n++] = exponent < 0 ? '-' : '+';
+  uint16_t magnitude = exponent < 0 ? -exponent : exponent;
+  if (magnitude >= 100) out[n++] = '0' + magnitude / 100;
+  out[n++] = '0' + magnitude / 10 % 10;
+  out[n++] = '0' + magnitude % 10;
+  return n;
+}
+
+// %g: fixed or exponent notation by the exponent, without trailing zeros
+static size_t putGeneral(char* out, double value, uint8_t precision, bool alt, bool upper) {
+  uint8_t digits = precision == 0 ? 1 : precision;
+  int16_t exponent = 0;
+  if (value != 0) {
+    double mantissa = value;
+    exponent = normalize(mantissa);
+    uint32_t fraction;
+    if (splitFixed(mantissa, digits - 1, &fraction) >= 10) exponent++;
+  }
+  size_t n;
+  if (exponent < digits && exponent >= -4) {
+    int16_t decimals = digits - 1 - exponent;
+    if (decimals > ARDEBUG_FORMAT_DECIMALS) decimals = ARDEBUG_FORMAT_DECIMALS;
+    uint32_t fraction;
+    uint64_t whole = splitFixed(value, (uint8_t)decimals, &fraction);
+    n = putFixed(out, whole, fraction, (uint8_t)decimals, alt);
+  } else {
+    n = putExponent(out, value, digits - 1, alt, upper);
+  }
+  if (alt) return n;
+  char* point = (char*)memchr(out, '.', n);
+  if (point == nullptr) return n;
+  char* mark = (char*)memchr(point, upper ? 'E' : 'e', out + n - point);
+  char* end = mark ? mark : out + n;
+  char* last = end;
+  while (last[-1] == '0') last--;
+  if (last[-1] == '.') last--;
+  size_t tail = out + n - end;
+  memmove(last, end, tail);
+  return last - out + tail;
+}
+
+/**
+ * @brief %f, %e and %g from double arithmetic, without the printf float code.
+ * At most ARDEBUG_FORMAT_DECIMALS decimals; values beyond 64-bit integers
+ * are written in exponent notation by %f.
+*/
+void formatFloat(LineBuilder& line, const FormatSpec& spec, const FormatArg& arg) {
+  double value = arg.f;
+  bool upper = spec.conv == 'F' || spec.conv == 'E' || spec.conv == 'G';
+  char head[1];
+  size_t head_len = 0;
+  if (value < 0) {
+    head[head_len++] = '-';
+    value = -value;
+  } else if (spec.sign) {
+    head[head_len++] = spec.sign;
+  }
+  if (value != value || value - value != 0) {  // NaN or infinity
+    const char* text = value != value ? (upper ? "NAN" : "nan") : (upper ? "INF" : "inf");
+    appendField(line, spec, head, head_len, 0, text, 3, false);
+    return;
+  }
+  uint8_t precision = spec.precision < 0 ? 6 : (uint8_t)spec.precision;
+  if (precision > ARDEBUG_FORMAT_DECIMALS) precision = ARDEBUG_FORMAT_DECIMALS;
+  char body[32];
+  size_t len;
+  if (spec.conv == 'g' || spec.conv == 'G') {
+    len = putGeneral(body, value, precision, spec.alt, upper);
+  } else if ((spec.conv == 'f' || spec.conv == 'F') && value < 1.8e19) {
+    uint32_t fraction;
+    uint64_t whole = splitFixed(value, precision, &fraction);
+    len = putFixed(body, whole, fraction, precision, spec.alt);
+  } else {
+    len = putExponent(body, value, precision, spec.alt, upper);
+  }
+  appendField(line, spec, head, head_len, 0, body, len, spec.zero);
+}
+
+// a character of the format, which is PROGMEM on boards with ARDEBUG_PROGMEM
+static inline char formatChar(const char* p, bool flash) {
+#if defined(ARDEBUG_PROGMEM)
+  if (flash) return (char)pgm_read_byte(p);
+#else
+  (void)flash;
+#endif
+  return *p;
+}
+
+static void appendText(LineBuilder& line, const char* text, size_t len, bool flash) {
+#if defined(ARDEBUG_PROGMEM)
+  if (flash) {
+    line.append_P(text, len);
+    return;
+  }
+#else
+  (void)flash;
+#endif
+  line.append(text, len);
+}
+
+void formatArgs(LineBuilder& line, const char* fmt, const FormatArg* args, bool flash) {
+  const char* p = fmt;
+  while (true) {
+    const char* text = p;
+    while (formatChar(p, flash) != 0 && formatChar(p, flash) != '%') p++;
+    if (p > text) appendText(line, text, p - text, flash);
+    if (formatChar(p, flash) == 0) return;
+    p++;
+    if (formatChar(p, flash) == '%') {
+      line.append('%');
+      p++;
+      continue;
+    }
+    FormatSpec spec = {0, false, false, 0, false, 0, -1};
+    for (;; p++) {
+      char c = formatChar(p, flash);
+      if (c == '-') spec.left = true;
+      else if (c == '0') spec.zero = true;
+      else if (c == '+') spec.sign = '+';
+      else if (c == ' ') { if (spec.sign == 0) spec.sign = ' '; }
+      else if (c == '#') spec.alt = true;
+      else break;
+    }
+    uint16_t width = 0;
+    for (char c; (c = formatChar(p, flash)) >= '0' && c <= '9'; p++) width = width * 10 + (c - '0');
+    spec.width = width > 255 ? 255 : (uint8_t)width;
+    if (formatChar(p, flash) == '.') {
+      uint16_t precision = 0;
+      p++;
+      for (char c; (c = formatChar(p, flash)) >= '0' && c <= '9'; p++) {
+        precision = precision * 10 + (c - '0');
+      }
+      spec.precision = precision > 127 ? 127 : (int8_t)precision;
+    }
+    while (formatChar(p, flash) != 0 && strchr("hlLzjt", formatChar(p, flash)) != nullptr) {
+      p++;  // sizes come from the types
+    }
+    spec.conv = formatChar(p, flash);
+    if (spec.conv == 0) return;
+    p++;
+    if (args->fn == nullptr) continue;  // more conversions than arguments
+    args->fn(line, spec, *args);
+    args++;
+  }
+}
+
+} // namespace ardebug
+
+#endif // ARDEBUG_TYPED
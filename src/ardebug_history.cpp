@@ -0,0 +1,53 @@
+#include "ardebug.h"
+
+#if !defined(ARDEBUG_DISABLED) && defined(ARDEBUG_HISTORY)
+
+namespace ardebug {
+
+#define ARDEBUG_HISTORY_MAGIC 0x41524448  // "ARDH"
+
+bool History::valid() const {
+  return region_->magic == ARDEBUG_HISTORY_MAGIC &&
+         region_->size == ARDEBUG_HISTORY_SIZE &&
+         region_->check == (region_->magic ^ region_->size ^ region_->written);
+}
+
+void History::reset() {
+  region_->magic = ARDEBUG_HISTORY_MAGIC;
+  region_->size = ARDEBUG_HISTORY_SIZE;
+  region_->written = 0;
+  region_->check = ARDEBUG_HISTORY_MAGIC ^ ARDEBUG_HISTORY_SIZE;
+}
+
+void History::append(const char* text, size_t len) {
+  if (len > ARDEBUG_HISTORY_SIZE) {
+    text += len - ARDEBUG_HISTORY_SIZE;
+    len = ARDEBUG_HISTORY_SIZE;
+  }
+  uint32_t pos = __atomic_fetch_add(&region_->written, (uint32_t)len, __ATOMIC_RELAXED);
+  size_t start = pos & (ARDEBUG_HISTORY_SIZE - 1);
+  size_t first = ARDEBUG_HISTORY_SIZE - start;
+  if (first > len) first = len;
+  memcpy(region_->data + start, text, first);
+  memcpy(region_->data, text + first, len - first);
+  __atomic_fetch_xor(&region_->check, pos ^ (uint32_t)(pos + len), __ATOMIC_RELEASE);
+}
+
+size_t History::available() const {
+  return wrapped() ? ARDEBUG_HISTORY_SIZE : region_->written;
+}
+
+size_t History::copy(size_t offset, char* out, size_t len) const {
+  size_t held = available();
+  if (offset >= held) return 0;
+  if (len > held - offset) len = held - offset;
+  uint32_t oldest = region_->written - held;
+  for (size_t i = 0; i < len; i++) {
+    out[i] = region_->data[(oldest + offset + i) & (ARDEBUG_HISTORY_SIZE - 1)];
+  }
+  return len;
+}
+
+} // namespace ardebug
+
+#endif // ARDEBUG_HISTORY
@@ -0,0 +1,111 @@
+#include "ardebug.h"
+
+#ifndef ARDEBUG_DISABLED
+
+namespace ardebug {
+
+LineBuilder::LineBuilder(char* buffer, size_t size) : buffer_(buffer), size_(size) {
+  text_()[0] = 0;
+}
+
+LineBuilder::LineBuilder(char* buffer, size_t size, size_t len)
+    : buffer_(buffer), size_(size), len_(len), required_(len) {}
+
+void LineBuilder::append(char c) {
+  required_++;
+  if (len_ < capacity()) {
+    char* text = text_();
+    text[len_++] = c;
+    text[len_] = 0;
+  }
+}
+
+void LineBuilder::append(const char* str) {
+  append(str, strlen(str));
+}
+
+void LineBuilder::append(const char* str, size_t len) {
+  required_ += len;
+  size_t n = capacity() - len_;
+  if (len < n) n = len;
+  char* text = text_();
+  memcpy(text + len_, str, n);
+  len_ += n;
+  text[len_] = 0;
+}
+
+void LineBuilder::appendUnsigned(uint32_t value, uint8_t width) {
+  char digits[10];
+  uint8_t n = 0;
+  do {
+    digits[n++] = '0' + (value % 10);
+    value /= 10;
+  } while (value > 0);
+  while (width > n) {
+    append(' ');
+    width--;
+  }
+  while (n > 0) append(digits[--n]);
+}
+
+void LineBuilder::appendf(const char* fmt, ...) {
+  va_list args;
+  va_start(args, fmt);
+  vappendf(fmt, args);
+  va_end(args);
+}
+
+void LineBuilder::vappendf(const char* fmt, va_list args) {
+  int len = vsnprintf(tail(), room(), fmt, args);
+  if (len > 0) advance((size_t)len, (size_t)len);
+}
+
+#if defined(ARDEBUG_PROGMEM)
+void LineBuilder::append_P(const char* str) {
+  append_P(str, strlen_P(str));
+}
+
+void LineBuilder::append_P(const char* str, size_t len) {
+  required_ += len;
+  size_t n = capacity() - len_;
+  if (len < n) n = len;
+  char* text = text_();
+  memcpy_P(text + len_, str, n);
+  len_ += n;
+  text[len_] = 0;
+}
+
+void LineBuilder::vappendf_P(const char* fmt, va_list args) {
+  int len = vsnprintf_P(tail(), room(), fmt, args);
+  if (len > 0) advance((size_t)len, (size_t)len);
+}
+#endif // ARDEBUG_PROGMEM
+
+void LineBuilder::advance(size_t written, size_t required) {
+  required_ += required;
+  size_t n = capacity() - len_;
+  len_ += written < n ? written : n;
+  text_()[len_] = 0;
+}
+
+void LineBuilder::finish(bool lf) {
+  if (!truncated() || len_ < 4) return;
+  memcpy(text_() + len_ - (lf ? 4 : 3), "...\n", lf ? 4 : 3);
+}
+
+const char* LineBuilder::colored(const char* color, size_t* len) {
+  size_t head = strlen(color);
+  if (head > ARDEBUG_COLOR_HEAD || ARDEBUG_COLOR_TAIL < sizeof(ARD_COLOR_RESET) - 1) {
+    *len = len_;
+    return text_();
+  }
+  char* start = text_() - head;
+  memcpy(start, color, head);
+  memcpy(text_() + len_, ARD_COLOR_RESET, sizeof(ARD_COLOR_RESET) - 1);
+  *len = head + len_ + sizeof(ARD_COLOR_RESET) - 1;
+  return start;
+}
+
+} // namespace ardebug
+
+#endif // ARDEBUG_DISABLED
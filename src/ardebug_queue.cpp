@@ -0,0 +1,163 @@
+#include "ardebug.h"
+
+#if !defined(ARDEBUG_DISABLED) && defined(ARDEBUG_QUEUE)
+
+namespace ardebug {
+
+#define ARDEBUG_QUEUE_MASK (ARDEBUG_QUEUE_SIZE - 1)
+#define ARDEBUG_QUEUE_RECORD (ARDEBUG_QUEUE_SIZE / 4)  // longer writes are split
+#define ARDEBUG_QUEUE_NOTE_SIZE 40
+
+uint16_t OutputQueue::recordLength(uint32_t pos) const {
+  return buffer_[pos & ARDEBUG_QUEUE_MASK] |
+         (buffer_[(pos + 1) & ARDEBUG_QUEUE_MASK] << 8);
+}
+
+// a partly written record stays, its remainder must still go out
+bool OutputQueue::dropOldest(size_t needed) {
+  uint32_t oldest = tail_;
+  if (sent_ > 0 && oldest != head_) oldest += 2 + recordLength(oldest);
+  uint32_t end = oldest;
+  size_t space = free();
+  while (space < needed && end != head_) {
+    uint32_t len = 2 + recordLength(end);
+    end += len;
+    space += len;
+    dropped_++;
+    gap_++;
+  }
+  if (space < needed) return false;
+  if (end == oldest) return true;
+  if (oldest == tail_) {
+    tail_ = end;
+  } else {  // keep the partial record by moving it up against the survivors
+    uint16_t len = recordLength(tail_);
+    uint32_t to = end - 2 - len;
+    for (int32_t i = 2 + len - 1; i >= 0; i--) {
+      buffer_[(to + i) & ARDEBUG_QUEUE_MASK] = buffer_[(tail_ + i) & ARDEBUG_QUEUE_MASK];
+    }
+    tail_ = to;
+  }
+  return true;
+}
+
+bool OutputQueue::push(const uint8_t* data, size_t len) {
+  if (len + 2 > free()) return false;
+  buffer_[head_ & ARDEBUG_QUEUE_MASK] = len & 0xFF;
+  buffer_[(head_ + 1) & ARDEBUG_QUEUE_MASK] = len >> 8;
+  size_t pos = (head_ + 2) & ARDEBUG_QUEUE_MASK;
+  size_t first = ARDEBUG_QUEUE_SIZE - pos;
+  if (first > len) first = len;
+  memcpy(buffer_ + pos, data, first);
+  memcpy(buffer_, data + first, len - first);
+  head_ += 2 + len;
+  return true;
+}
+
+static void appendNote(LineBuilder& note, uint32_t count) {
+  note.append("[ardebug] ");
+  note.appendUnsigned(count);
+  note.append(" lines dropped\n");
+}
+
+// the newest lines were lost, so the note goes behind the queued ones
+bool OutputQueue::pushNote() {
+  char buffer[ARDEBUG_COLOR_HEAD + ARDEBUG_QUEUE_NOTE_SIZE + ARDEBUG_COLOR_TAIL];
+  LineBuilder note(buffer, sizeof(buffer));
+  uint32_t count = dropped_ - reported_ - gap_;
+  appendNote(note, count);
+  if (!push((const uint8_t*)note.text(), note.length())) return false;
+  reported_ += count;
+  return true;
+}
+
+bool OutputQueue::write(Print& out, SpaceFn space, const uint8_t* data, size_t len,
+                        uint8_t policy, uint32_t block_ms) {
+  if (idle() && len <= ARDEBUG_QUEUE_RECORD) {
+    int room = space(out);  // nothing waiting: write straight through
+    if (room > 0) gated_ = true;
+    if (!gated_ || (size_t)room >= len) {
+      size_t written = out.write(data, len);
+      if (written == len) return true;
+      push(data, len);  // the rest goes out with the next pump()
+      sent_ = written;
+      return true;
+    }
+  }
+  pump(out, space);
+  while (len > ARDEBUG_QUEUE_RECORD) {
+    if (!write(out, space, data, ARDEBUG_QUEUE_RECORD, policy, block_ms)) return false;
+    data += ARDEBUG_QUEUE_RECORD;
+    len -= ARDEBUG_QUEUE_RECORD;
+  }
+  size_t needed = len + 2;
+  if (dropped_ - reported_ > gap_) needed += 2 + ARDEBUG_QUEUE_NOTE_SIZE;
+  if (needed > free()) {
+    if (policy == ARDEBUG_BLOCK) {
+      uint32_t start = millis();
+      while (needed > free() && millis() - start < block_ms) {
+        delay(1);
+        pump(out, space);
+      }
+    } else if (policy == ARDEBUG_DROP_OLDEST) {
+      dropOldest(needed);
+    }
+  }
+  if (dropped_ - reported_ > gap_) pushNote();
+  if (!push(data, len)) {
+    dropped_++;
+    return false;
+  }
+  pump(out, space);
+  return true;
+}
+
+size_t OutputQueue::pump(Print& out, SpaceFn space) {
+  size_t total = 0;
+  while (tail_ != head_) {
+    int room = space(out);
+    if (room > 0) gated_ = true;
+    if (gated_ && room <= 0) break;
+    if (gap_ > 0 && sent_ == 0) {  // the oldest lines were lost right here
+      if (note_sent_ == 0) note_count_ = gap_;  // fixed until the note is out
+      char buffer[ARDEBUG_COLOR_HEAD + ARDEBUG_QUEUE_NOTE_SIZE + ARDEBUG_COLOR_TAIL];
+      LineBuilder note(buffer, sizeof(buffer));
+      appendNote(note, note_count_);
+      size_t len = note.length();
+      if (gated_ && (size_t)room < len - note_sent_) break;
+      note_sent_ += out.write((const uint8_t*)note.text() + note_sent_, len - note_sent_);
+      if (note_sent_ < len) break;
+      note_sent_ = 0;
+      reported_ += note_count_;
+      gap_ -= note_count_;
+      continue;
+    }
+    uint16_t len = recordLength(tail_);
+    size_t pos = (tail_ + 2 + sent_) & ARDEBUG_QUEUE_MASK;
+    size_t n = len - sent_;
+    if (gated_ && (size_t)room < n) n = room;
+    if (n > ARDEBUG_QUEUE_SIZE - pos) n = ARDEBUG_QUEUE_SIZE - pos;
+    size_t written = out.write(buffer_ + pos, n);
+    total += written;
+    sent_ += written;
+    if (sent_ == len) {
+      tail_ += 2 + len;
+      sent_ = 0;
+    }
+    if (written < n) break;
+  }
+  return total;
+}
+
+// drop counts are kept, only the pending note goes with the lines
+void OutputQueue::clear() {
+  head_ = tail_ = 0;
+  sent_ = 0;
+  gap_ = 0;
+  note_sent_ = 0;
+  reported_ = dropped_;
+}
+
+} // namespace ardebug
+
+#endif // ARDEBUG_QUEUE
@@ -0,0 +1,294 @@
+/**
+ * @brief The lock-free rings in ardebug_ring.h filled from several threads,
+ * and drain() writing the async records to a Stream (pio test -e native_async)
+*/
+
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+#include <unity.h>
+#include "ardebug.h"
+#include "ardebug_ring.h"
+
+using ardebug::LogRing;
+using ardebug::OverwriteRing;
+
+#define THREADS 4
+
+// `check` is ~`seq`, so a record copied while it was written shows up
+struct Record {
+  uint32_t thread;
+  uint32_t seq;
+  uint32_t check;
+};
+
+static Record record(uint32_t thread, uint32_t seq) {
+  return {thread, seq, ~seq};
+}
+
+/** @brief Checks that each thread's records arrive whole and in order */
+class OrderCheck {
+  private:
+    int64_t last_[THREADS];
+
+  public:
+    uint32_t records = 0;
+    bool ok = true;
+
+    OrderCheck() {
+      for (int64_t& last : last_) last = -1;
+    }
+    void add(const Record& rec) {
+      records++;
+      if (rec.thread >= THREADS || rec.check != ~rec.seq || (int64_t)rec.seq <= last_[rec.thread]) {
+        ok = false;
+        return;
+      }
+      last_[rec.thread] = rec.seq;
+    }
+};
+
+/** @brief A Stream that keeps what is written to it */
+class MockStream : public Stream {
+  public:
+    std::string text;
+
+    size_t write(uint8_t c) override {
+      text += (char)c;
+      return 1;
+    }
+    size_t write(const uint8_t* buffer, size_t size) override {
+      text.append((const char*)buffer, size);
+      return size;
+    }
+    using Print::write;
+    int availableForWrite() override { return 1 << 16; }
+    int available() override { return 0; }
+    int read() override { return -1; }
+    int peek() override { return -1; }
+};
+
+static MockStream mock;
+
+static void handleFor(uint32_t ms) {
+  uint32_t start = millis();
+  do {
+    ardebugHandle();
+    delay(1);
+  } while (millis() - start < ms);
+}
+
+static int count(const std::string& text, const char* part) {
+  int n = 0;
+  for (size_t pos = text.find(part); pos != std::string::npos; pos = text.find(part, pos + 1)) n++;
+  return n;
+}
+
+void setUp() {
+  handleFor(20);
+  mock.text.clear();
+}
+
+void tearDown() {}
+
+void test_log_ring_counts_each_overflow_once() {
+  static LogRing<Record, 64> ring;
+  const uint32_t per_thread = 1000;
+  std::atomic<uint32_t> accepted(0);
+  std::vector<std::thread> threads;
+  for (uint32_t t = 0; t < THREADS; t++) {
+    threads.emplace_back([&accepted, t, per_thread]() {
+      for (uint32_t i = 0; i < per_thread; i++) {
+        size_t ticket;
+        Record* slot = ring.claim(&ticket);
+        if (slot == nullptr) continue;
+        *slot = record(t, i);
+        ring.publish(ticket);
+        accepted++;
+      }
+    });
+  }
+  for (std::thread& thread : threads) thread.join();
+  TEST_ASSERT_EQUAL(ring.capacity(), accepted.load());
+  TEST_ASSERT_EQUAL(THREADS * per_thread - ring.capacity(), ring.dropped());
+  TEST_ASSERT_EQUAL(1, ring.overflows());  // one episode, however many drops
+
+  OrderCheck check;
+  Record* rec;
+  while ((rec = ring.peek()) != nullptr) {
+    check.add(*rec);
+    ring.release();
+  }
+  TEST_ASSERT_TRUE(check.ok);
+  TEST_ASSERT_EQUAL(ring.capacity(), check.records);
+
+  for (uint32_t i = 0; i <= ring.capacity(); i++) {  // fills up again
+    size_t ticket;
+    if (ring.claim(&ticket) != nullptr) ring.publish(ticket);
+  }
+  TEST_ASSERT_EQUAL(2, ring.overflows());
+}
+
+void test_log_ring_with_a_concurrent_reader() {
+  static LogRing<Record, 64> ring;
+  const uint32_t per_thread = 200000;
+  std::atomic<uint32_t> accepted(0);
+  std::atomic<int> running(THREADS);
+  std::vector<std::thread> threads;
+  for (uint32_t t = 0; t < THREADS; t++) {
+    threads.emplace_back([&accepted, &running, t, per_thread]() {
+      for (uint32_t i = 0; i < per_thread; i++) {
+        size_t ticket;
+        Record* slot = ring.claim(&ticket);
+        if (slot == nullptr) continue;
+        *slot = record(t, i);
+        ring.publish(ticket);
+        accepted++;
+      }
+      running--;
+    });
+  }
+  OrderCheck check;
+  for (;;) {
+    bool done = running.load() == 0;
+    Record* rec;
+    while ((rec = ring.peek()) != nullptr) {
+      check.add(*rec);
+      ring.release();
+    }
+    if (done) break;
+  }
+  for (std::thread& thread : threads) thread.join();
+  TEST_ASSERT_TRUE(check.ok);
+  TEST_ASSERT_EQUAL(accepted.load(), check.records);
+  TEST_ASSERT_EQUAL(THREADS * per_thread, accepted.load() + ring.dropped());
+  TEST_ASSERT_LESS_OR_EQUAL(ring.dropped(), ring.overflows());
+}
+
+void test_overwrite_ring_keeps_the_newest() {
+  static OverwriteRing<Record, 32> ring;
+  for (uint32_t i = 0; i < 32 + 10; i++) {
+    uint32_t ticket;
+    *ring.claim(&ticket) = record(0, i);
+    ring.publish(ticket);
+  }
+  Record rec;
+  for (uint32_t i = 10; i < 32 + 10; i++) {
+    TEST_ASSERT_TRUE(ring.pop(rec));
+    TEST_ASSERT_EQUAL(i, rec.seq);
+  }
+  TEST_ASSERT_FALSE(ring.pop(rec));
+  TEST_ASSERT_EQUAL(10, ring.dropped());
+}
+
+void test_overwrite_ring_with_a_concurrent_reader() {
+  static OverwriteRing<Record, 32> ring;
+  const uint32_t per_thread = 200000;
+  std::atomic<int> running(THREADS);
+  std::vector<std::thread> threads;
+  for (uint32_t t = 0; t < THREADS; t++) {
+    threads.emplace_back([&running, t, per_thread]() {
+      for (uint32_t i = 0; i < per_thread; i++) {
+        uint32_t ticket;
+        *ring.claim(&ticket) = record(t, i);
+        ring.publish(ticket);
+      }
+      running--;
+    });
+  }
+  OrderCheck check;
+  Record rec;
+  for (;;) {
+    bool done = running.load() == 0;
+    while (ring.pop(rec)) check.add(rec);
+    if (done) break;
+  }
+  for (std::thread& thread : threads) thread.join();
+  TEST_ASSERT_TRUE(check.ok);
+  TEST_ASSERT_EQUAL(THREADS * per_thread, check.records + ring.dropped());
+}
+
+void test_drain_writes_the_records_in_order() {
+  ardebug::DebugContext& ctx = ardebug::DebugContext::get();
+  uint32_t dropped = ctx.asyncDropped();
+  uint32_t overflows = ctx.asyncOverflows();
+  for (int i = 0; i < ARDEBUG_ASYNC_SLOTS + 5; i++) AR_LOGI("record %03d", i);
+  TEST_ASSERT_EQUAL(dropped + 5, ctx.asyncDropped());
+  TEST_ASSERT_EQUAL(overflows + 1, ctx.asyncOverflows());
+  TEST_ASSERT_TRUE(mock.text.empty());  // nothing written until drained
+
+  TEST_ASSERT_EQUAL(ARDEBUG_ASYNC_SLOTS, ctx.drain());
+  handleFor(20);
+  size_t pos = 0;
+  char text[16];
+  for (int i = 0; i < ARDEBUG_ASYNC_SLOTS; i++) {
+    snprintf(text, sizeof(text), "record %03d\n", i);
+    size_t next = mock.text.find(text, pos);
+    TEST_ASSERT_TRUE(next != std::string::npos);
+    pos = next;
+  }
+  TEST_ASSERT_EQUAL(ARDEBUG_ASYNC_SLOTS, count(mock.text, "record "));
+  TEST_ASSERT_TRUE(mock.text.find("5 records dropped", pos) != std::string::npos);
+}
+
+void test_drain_with_several_logging_threads() {
+  ardebug::DebugContext& ctx = ardebug::DebugContext::get();
+  uint32_t dropped = ctx.asyncDropped();
+  const int per_thread = 5000;
+  std::atomic<int> running(THREADS);
+  std::vector<std::thread> threads;
+  for (int t = 0; t < THREADS; t++) {
+    threads.emplace_back([&running, t, per_thread]() {
+      for (int i = 0; i < per_thread; i++) AR_LOGI("thread %d line %05d", t, i);
+      running--;
+    });
+  }
+  while (running.load() > 0) ctx.drain();
+  for (std::thread& thread : threads) thread.join();
+  handleFor(20);
+  dropped = ctx.asyncDropped() - dropped;
+
+  TEST_ASSERT_EQUAL(THREADS * per_thread - dropped, count(mock.text, " line "));
+  for (int t = 0; t < THREADS; t++) {
+    char thread[16];
+    snprintf(thread, sizeof(thread), "thread %d line ", t);
+    int last = -1;
+    for (size_t pos = mock.text.find(thread); pos != std::string::npos;
+         pos = mock.text.find(thread, pos + 1)) {
+      int line = atoi(mock.text.c_str() + pos + strlen(thread));
+      TEST_ASSERT_GREATER_THAN(last, line);
+      last = line;
+    }
+  }
+  TEST_ASSERT_EQUAL(0, ctx.droppedLines());  // the Stream took everything
+}
+
+void test_drain_merges_isr_records_by_time() {
+  ardebug::DebugContext& ctx = ardebug::DebugContext::get();
+  AR_LOGI("merge 1");
+  delay(1);
+  AR_LOGI_ISR("merge %d", 2);
+  delay(1);
+  AR_LOGI("merge 3");
+  TEST_ASSERT_EQUAL(3, ctx.drain());
+  handleFor(20);
+  size_t first = mock.text.find("merge 1\n");
+  size_t second = mock.text.find("merge 2\n");
+  size_t third = mock.text.find("merge 3\n");
+  TEST_ASSERT_TRUE(first != std::string::npos && third != std::string::npos);
+  TEST_ASSERT_TRUE(first < second && second < third);
+}
+
+int main() {
+  ardebugBegin(&mock, nullptr, nullptr);
+  UNITY_BEGIN();
+  RUN_TEST(test_log_ring_counts_each_overflow_once);
+  RUN_TEST(test_log_ring_with_a_concurrent_reader);
+  RUN_TEST(test_overwrite_ring_keeps_the_newest);
+  RUN_TEST(test_overwrite_ring_with_a_concurrent_reader);
+  RUN_TEST(test_drain_writes_the_records_in_order);
+  RUN_TEST(test_drain_with_several_logging_threads);
+  RUN_TEST(test_drain_merges_isr_records_by_time);
+  return UNITY_END();
+}
@@ -0,0 +1,115 @@
+/**
+ * @brief ESP_LOGx output through the esp_log hook, with the esp_log shim in
+ * native/ (pio test -e native_esplog)
+*/
+
+#include <string>
+#include <unity.h>
+#include "ardebug.h"
+#include "esp_log.h"
+
+/** @brief Keeps the last record written to it */
+class CaptureSink : public ardebug::Sink {
+  public:
+    int records = 0;
+    int8_t level = -2;
+    std::string tag;
+    std::string text;
+    std::string message;
+
+    void write(const ardebug::LogRecord& record) override {
+      records++;
+      level = record.level;
+      const char* name = record.site && record.site->tag ?
+          ardebug::DebugContext::get().tagName(*record.site->tag) : nullptr;
+      tag = name ? name : "";
+      text.assign(record.text(), record.length());
+      message.assign(record.messageText(), record.messageLength());
+    }
+    const char* name() const override { return "capture"; }
+};
+
+static CaptureSink capture;
+
+// what reaches the vprintf that was installed before ardebugBegin()
+static std::string earlier;
+
+static int earlierVprintf(const char* fmt, va_list args) {
+  char buffer[256];
+  int len = vsnprintf(buffer, sizeof(buffer), fmt, args);
+  earlier += buffer;
+  return len;
+}
+
+void setUp() {
+  capture.records = 0;
+  earlier.clear();
+}
+
+void tearDown() {}
+
+void test_esp_log_lines_reach_the_sinks() {
+  ESP_LOGW("wifi", "lost %d beacons", 3);
+  ardebugHandle();
+  TEST_ASSERT_EQUAL(1, capture.records);
+  TEST_ASSERT_EQUAL(ARDEBUG_W, capture.level);
+  TEST_ASSERT_EQUAL_STRING("wifi", capture.tag.c_str());
+  TEST_ASSERT_EQUAL_STRING("lost 3 beacons\n", capture.message.c_str());
+  TEST_ASSERT_TRUE(capture.text.find("[W][wifi]") != std::string::npos);
+  TEST_ASSERT_TRUE(capture.text.find('\x1b') == std::string::npos);  // IDF's color is gone
+  TEST_ASSERT_TRUE(capture.text.find("W (") == std::string::npos);  // and its prefix
+  TEST_ASSERT_TRUE(earlier.empty());
+
+  ESP_LOGE("tls", "handshake failed: %s", "timeout");
+  ESP_LOGI("tls", "retry in %u ms", 500u);
+  ardebugHandle();
+  TEST_ASSERT_EQUAL(3, capture.records);
+  TEST_ASSERT_EQUAL(ARDEBUG_I, capture.level);
+  TEST_ASSERT_EQUAL_STRING("tls", capture.tag.c_str());
+  TEST_ASSERT_EQUAL_STRING("retry in 500 ms\n", capture.message.c_str());
+}
+
+// IDF 4 formats the timestamp with %u, IDF 5 with %lu (uint32_t is long there)
+void test_idf4_and_idf5_timestamps_parse() {
+  esp_log_write(ESP_LOG_INFO, "idf4", LOG_COLOR_I "I (%u) %s: value %d" LOG_RESET_COLOR "\n",
+                (unsigned)1234, "idf4", 4);
+  ardebugHandle();
+  TEST_ASSERT_EQUAL(1, capture.records);
+  TEST_ASSERT_EQUAL_STRING("idf4", capture.tag.c_str());
+  TEST_ASSERT_EQUAL_STRING("value 4\n", capture.message.c_str());
+
+  esp_log_write(ESP_LOG_WARN, "idf5", LOG_COLOR_W "W (%lu) %s: value %d" LOG_RESET_COLOR "\n",
+                (unsigned long)1234, "idf5", 5);
+  ardebugHandle();
+  TEST_ASSERT_EQUAL(2, capture.records);
+  TEST_ASSERT_EQUAL(ARDEBUG_W, capture.level);
+  TEST_ASSERT_EQUAL_STRING("idf5", capture.tag.c_str());
+  TEST_ASSERT_EQUAL_STRING("value 5\n", capture.message.c_str());
+
+  esp_log_write(ESP_LOG_INFO, "none", "I (%lu) %s: no color\n", (unsigned long)1, "none");
+  ardebugHandle();
+  TEST_ASSERT_EQUAL(3, capture.records);
+  TEST_ASSERT_EQUAL_STRING("no color\n", capture.message.c_str());
+}
+
+void test_stop_restores_the_previous_vprintf() {
+  ardebug::DebugContext::get().stop();
+  ESP_LOGI("wifi", "after %s", "stop");
+  ardebugHandle();
+  TEST_ASSERT_EQUAL(0, capture.records);
+  TEST_ASSERT_TRUE(earlier.find("I (") != std::string::npos);
+  TEST_ASSERT_TRUE(earlier.find("wifi: after stop") != std::string::npos);
+  TEST_ASSERT_TRUE(esp_log_set_vprintf(vprintf) == earlierVprintf);
+}
+
+int main() {
+  esp_log_set_vprintf(earlierVprintf);
+  ardebugBegin(&Serial, nullptr, nullptr);
+  capture.setLevel(ARDEBUG_V);
+  ardebugAddSink(&capture);
+  UNITY_BEGIN();
+  RUN_TEST(test_esp_log_lines_reach_the_sinks);
+  RUN_TEST(test_idf4_and_idf5_timestamps_parse);
+  RUN_TEST(test_stop_restores_the_previous_vprintf);
+  return UNITY_END();
+}
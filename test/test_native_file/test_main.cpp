@@ -0,0 +1,162 @@
+/**
+ * @brief FileSink block alignment and rotation, against the stdio backed
+ * fs::FS stand-in in native/
+*/
+
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <string>
+#include <unity.h>
+#include "ardebug.h"
+
+using ardebug::FileSink;
+
+#define BLOCK ARDEBUG_FILE_BLOCK_SIZE
+
+static char dir[] = "/tmp/ardebug_file_XXXXXX";
+static fs::FS* files = nullptr;
+
+static std::string hostPath(const char* path) {
+  return std::string(dir) + path;
+}
+
+// the size on disk, which only grows by the sink's writes
+static long diskSize(const char* path) {
+  struct stat st;
+  return stat(hostPath(path).c_str(), &st) == 0 ? (long)st.st_size : -1;
+}
+
+static std::string readFile(const char* path) {
+  std::string text;
+  FILE* f = fopen(hostPath(path).c_str(), "r");
+  if (f == nullptr) return text;
+  char buffer[512];
+  size_t n;
+  while ((n = fread(buffer, 1, sizeof(buffer), f)) > 0) text.append(buffer, n);
+  fclose(f);
+  return text;
+}
+
+static void writeFile(const char* path, size_t len) {
+  FILE* f = fopen(hostPath(path).c_str(), "w");
+  for (size_t i = 0; i < len; i++) fputc('x', f);
+  fclose(f);
+}
+
+static void appendText(FileSink& sink, const std::string& text, int8_t level = ARDEBUG_I) {
+  sink.writeRaw((const uint8_t*)text.data(), text.size(), level);
+}
+
+// n bytes ending in a newline
+static std::string line(size_t n, char fill = 'a') {
+  return std::string(n - 1, fill) + "\n";
+}
+
+void setUp() {
+  static const char* names[] = {"/log.txt", "/log.txt.1", "/log.txt.2", "/log.txt.3",
+                                "/log.txt.4"};
+  for (const char* name : names) unlink(hostPath(name).c_str());
+}
+
+void tearDown() {}
+
+void test_full_blocks_from_an_empty_file() {
+  FileSink sink;
+  TEST_ASSERT_TRUE(sink.begin(*files, "/log.txt"));
+  appendText(sink, line(BLOCK - 12));
+  TEST_ASSERT_EQUAL(0, diskSize("/log.txt"));
+  appendText(sink, line(40));
+  TEST_ASSERT_EQUAL(BLOCK, diskSize("/log.txt"));
+  appendText(sink, line(3 * BLOCK));
+  TEST_ASSERT_EQUAL(4 * BLOCK, diskSize("/log.txt"));
+  TEST_ASSERT_EQUAL(4 * BLOCK + 28, sink.size());
+  sink.end();
+  TEST_ASSERT_EQUAL(4 * BLOCK + 28, diskSize("/log.txt"));
+}
+
+void test_existing_file_fills_up_its_last_block() {
+  writeFile("/log.txt", 100);
+  FileSink sink;
+  TEST_ASSERT_TRUE(sink.begin(*files, "/log.txt"));
+  TEST_ASSERT_EQUAL(100, sink.size());
+  appendText(sink, line(BLOCK - 100 - 1));
+  TEST_ASSERT_EQUAL(100, diskSize("/log.txt"));
+  appendText(sink, line(2));  // one byte past the boundary
+  TEST_ASSERT_EQUAL(BLOCK, diskSize("/log.txt"));
+  appendText(sink, line(BLOCK));
+  TEST_ASSERT_EQUAL(2 * BLOCK, diskSize("/log.txt"));
+  sink.end();
+}
+
+void test_partial_writes_realign() {
+  FileSink sink;
+  TEST_ASSERT_TRUE(sink.begin(*files, "/log.txt"));
+  appendText(sink, line(70));
+  sink.flush();
+  TEST_ASSERT_EQUAL(70, diskSize("/log.txt"));
+  appendText(sink, line(BLOCK));
+  TEST_ASSERT_EQUAL(BLOCK, diskSize("/log.txt"));  // not 70 + BLOCK
+  appendText(sink, line(30), ARDEBUG_E);  // an error is written at once
+  TEST_ASSERT_EQUAL(BLOCK + 70 + 30, diskSize("/log.txt"));
+  appendText(sink, line(2 * BLOCK));
+  TEST_ASSERT_EQUAL(3 * BLOCK, diskSize("/log.txt"));
+  appendText(sink, line(BLOCK));
+  TEST_ASSERT_EQUAL(4 * BLOCK, diskSize("/log.txt"));
+  sink.end();
+  TEST_ASSERT_EQUAL(4 * BLOCK + 100, diskSize("/log.txt"));
+}
+
+void test_rotation_keeps_whole_lines_in_order() {
+  FileSink sink;
+  TEST_ASSERT_TRUE(sink.begin(*files, "/log.txt"));
+  std::string all;
+  char text[100];
+  int n = 0;
+  while (sink.rotations() == 0) {
+    snprintf(text, sizeof(text), "line %06d %s\n", n++, std::string(80, 'r').c_str());
+    appendText(sink, text);
+    all += text;
+  }
+  sink.end();
+  long rotated = diskSize("/log.txt.1");
+  TEST_ASSERT_LESS_OR_EQUAL(ARDEBUG_FILE_MAX_SIZE, rotated);
+  TEST_ASSERT_GREATER_THAN(ARDEBUG_FILE_MAX_SIZE - (long)strlen(text), rotated);
+  std::string first = readFile("/log.txt.1");
+  std::string second = readFile("/log.txt");
+  TEST_ASSERT_EQUAL('\n', first.back());
+  TEST_ASSERT_EQUAL_STRING_LEN("line ", second.c_str(), 5);
+  TEST_ASSERT_TRUE(first + second == all);
+}
+
+void test_rotation_keeps_the_newest_files() {
+  FileSink sink;
+  TEST_ASSERT_TRUE(sink.begin(*files, "/log.txt"));
+  // each line takes more than half a file
+  for (char fill = 'a'; fill <= 'f'; fill++) {
+    appendText(sink, line(ARDEBUG_FILE_MAX_SIZE / 2 + 1, fill));
+  }
+  sink.end();
+  TEST_ASSERT_EQUAL(5, sink.rotations());
+  TEST_ASSERT_EQUAL('f', readFile("/log.txt")[0]);
+  TEST_ASSERT_EQUAL('e', readFile("/log.txt.1")[0]);
+  TEST_ASSERT_EQUAL('d', readFile("/log.txt.2")[0]);
+  TEST_ASSERT_EQUAL('c', readFile("/log.txt.3")[0]);
+  TEST_ASSERT_EQUAL(-1, diskSize("/log.txt.4"));
+}
+
+int main() {
+  if (mkdtemp(dir) == nullptr) return 1;
+  fs::FS host(dir);
+  files = &host;
+  UNITY_BEGIN();
+  RUN_TEST(test_full_blocks_from_an_empty_file);
+  RUN_TEST(test_existing_file_fills_up_its_last_block);
+  RUN_TEST(test_partial_writes_realign);
+  RUN_TEST(test_rotation_keeps_whole_lines_in_order);
+  RUN_TEST(test_rotation_keeps_the_newest_files);
+  int failures = UNITY_END();
+  setUp();
+  rmdir(dir);
+  return failures;
+}
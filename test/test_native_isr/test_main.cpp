@@ -0,0 +1,129 @@
+/**
+ * @brief AR_LOGx_ISR() records, formatted by ardebugHandle(), and the
+ * overwrite of the oldest when the ring laps
+*/
+
+#include <stdlib.h>
+#include <atomic>
+#include <string>
+#include <thread>
+#include <unity.h>
+#include "ardebug.h"
+
+/** @brief A Stream that keeps what is written to it */
+class MockStream : public Stream {
+  public:
+    std::string text;
+
+    size_t write(uint8_t c) override {
+      text += (char)c;
+      return 1;
+    }
+    size_t write(const uint8_t* buffer, size_t size) override {
+      text.append((const char*)buffer, size);
+      return size;
+    }
+    using Print::write;
+    int availableForWrite() override { return 1 << 16; }
+    int available() override { return 0; }
+    int read() override { return -1; }
+    int peek() override { return -1; }
+};
+
+static MockStream mock;
+
+static int count(const std::string& text, const char* part) {
+  int n = 0;
+  for (size_t pos = text.find(part); pos != std::string::npos; pos = text.find(part, pos + 1)) n++;
+  return n;
+}
+
+static bool contains(const std::string& text, const char* part) {
+  return text.find(part) != std::string::npos;
+}
+
+void setUp() {
+  ardebugHandle();
+  mock.text.clear();
+}
+
+void tearDown() {}
+
+void test_records_are_formatted_by_handle() {
+  int steps = -3;
+  AR_LOGD_ISR("edge %u at step %d", 1u, steps);
+  AR_LOGW_ISR("flags %x %X %o char %c", 0xbeefu, 0xbeefu, 8u, 'k');
+  TEST_ASSERT_TRUE(mock.text.empty());  // nothing formatted in the handler
+  ardebugHandle();
+  TEST_ASSERT_TRUE(contains(mock.text, "[D]"));
+  TEST_ASSERT_TRUE(contains(mock.text, "edge 1 at step -3\n"));
+  TEST_ASSERT_TRUE(contains(mock.text, "[W]"));
+  TEST_ASSERT_TRUE(contains(mock.text, "flags beef BEEF 10 char k\n"));
+  TEST_ASSERT_TRUE(mock.text.find("edge 1") < mock.text.find("flags beef"));
+}
+
+void test_records_below_the_level_are_not_stored() {
+  ardebugSetLevel(ARDEBUG_I);
+  AR_LOGD_ISR("hidden %d", 1);
+  AR_LOGI_ISR("shown %d", 2);
+  ardebugSetLevel(ARDEBUG_V);
+  ardebugHandle();
+  TEST_ASSERT_FALSE(contains(mock.text, "hidden 1"));
+  TEST_ASSERT_TRUE(contains(mock.text, "shown 2\n"));
+}
+
+void test_a_lapped_ring_keeps_the_newest() {
+  for (int i = 0; i < ARDEBUG_ISR_SLOTS + 5; i++) AR_LOGI_ISR("tick %d", i);
+  ardebugHandle();
+  TEST_ASSERT_EQUAL(ARDEBUG_ISR_SLOTS, count(mock.text, "tick "));
+  TEST_ASSERT_FALSE(contains(mock.text, "tick 4\n"));
+  TEST_ASSERT_TRUE(contains(mock.text, "tick 5\n"));
+  char last[16];
+  snprintf(last, sizeof(last), "tick %d\n", ARDEBUG_ISR_SLOTS + 4);
+  TEST_ASSERT_TRUE(contains(mock.text, last));
+  TEST_ASSERT_TRUE(contains(mock.text, "[ardebug] 5 ISR records dropped"));
+}
+
+// a thread stands in for an interrupt that fires while handle() formats
+void test_records_stored_during_handle_arrive_whole() {
+  const int records = 20000;
+  std::atomic<bool> done(false);
+  std::thread handler([&done, records]() {
+    for (int i = 0; i < records; i++) AR_LOGI_ISR("seq %d check %d", i, ~i);
+    done = true;
+  });
+  while (!done.load()) ardebugHandle();
+  handler.join();
+  ardebugHandle();
+
+  int lines = 0;
+  int last = -1;
+  for (size_t pos = mock.text.find("seq "); pos != std::string::npos;
+       pos = mock.text.find("seq ", pos + 1)) {
+    char* end;
+    int seq = strtol(mock.text.c_str() + pos + 4, &end, 10);
+    TEST_ASSERT_EQUAL(0, strncmp(end, " check ", 7));
+    TEST_ASSERT_EQUAL(~seq, atoi(end + 7));
+    TEST_ASSERT_GREATER_THAN(last, seq);
+    last = seq;
+    lines++;
+  }
+  TEST_ASSERT_EQUAL(records - 1, last);
+  int dropped = 0;
+  for (size_t pos = mock.text.find("[ardebug] "); pos != std::string::npos;
+       pos = mock.text.find("[ardebug] ", pos + 1)) {
+    dropped += atoi(mock.text.c_str() + pos + 10);
+  }
+  TEST_ASSERT_EQUAL(records, lines + dropped);
+}
+
+int main() {
+  ardebugBegin(&mock, nullptr, nullptr);
+  ardebugSetLevel(ARDEBUG_V);
+  UNITY_BEGIN();
+  RUN_TEST(test_records_are_formatted_by_handle);
+  RUN_TEST(test_records_below_the_level_are_not_stored);
+  RUN_TEST(test_a_lapped_ring_keeps_the_newest);
+  RUN_TEST(test_records_stored_during_handle_arrive_whole);
+  return UNITY_END();
+}
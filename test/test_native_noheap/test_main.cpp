@@ -0,0 +1,100 @@
+/**
+ * @brief Lines longer than ARDEBUG_LINE_SIZE with ARDEBUG_FLEXBUFFER and
+ * ARDEBUG_NO_HEAP, formatted in the static arena without allocating
+ * (pio test -e native_noheap)
+*/
+
+#include <stdlib.h>
+#include <new>
+#include <string>
+#include <unity.h>
+#include "ardebug.h"
+
+#if !defined(ARDEBUG_FLEXBUFFER) || !defined(ARDEBUG_NO_HEAP)
+#error "test_native_noheap needs ARDEBUG_FLEXBUFFER and ARDEBUG_NO_HEAP, see [env:native_noheap]"
+#endif
+
+static size_t allocations = 0;
+
+void* operator new(size_t size) {
+  allocations++;
+  void* p = malloc(size);
+  if (p == nullptr) throw std::bad_alloc();
+  return p;
+}
+void* operator new[](size_t size) { return operator new(size); }
+void operator delete(void* p) noexcept { free(p); }
+void operator delete[](void* p) noexcept { free(p); }
+
+/** @brief A Stream that keeps what is written to it, in room reserved up front */
+class MockStream : public Stream {
+  public:
+    std::string text;
+
+    size_t write(uint8_t c) override {
+      text += (char)c;
+      return 1;
+    }
+    size_t write(const uint8_t* buffer, size_t size) override {
+      text.append((const char*)buffer, size);
+      return size;
+    }
+    using Print::write;
+    int availableForWrite() override { return 1 << 16; }
+    int available() override { return 0; }
+    int read() override { return -1; }
+    int peek() override { return -1; }
+};
+
+static MockStream mock;
+static char message[ARDEBUG_FLEXBUFFER_ARENA + 64];
+
+static void setMessage(size_t len) {
+  for (size_t i = 0; i < len; i++) message[i] = 'a' + i % 26;
+  message[len] = 0;
+}
+
+void setUp() {
+  ardebugHandle();
+  mock.text.clear();  // keeps the room reserved by main()
+}
+
+void tearDown() {}
+
+void test_a_long_line_is_whole_without_allocating() {
+  setMessage(ARDEBUG_LINE_SIZE * 3);
+  size_t allocated = allocations;
+  AR_LOGI("long %s end", message);
+  TEST_ASSERT_EQUAL(0, allocations - allocated);
+  std::string line = std::string("long ") + message + " end\n";
+  TEST_ASSERT_TRUE(mock.text.find(line) != std::string::npos);
+  TEST_ASSERT_TRUE(mock.text.find("[I]") < mock.text.find("long "));
+}
+
+void test_a_long_ardprintf_is_whole_without_allocating() {
+  setMessage(ARDEBUG_LINE_SIZE * 2);
+  size_t allocated = allocations;
+  ardprintf("%s\n", message);
+  TEST_ASSERT_EQUAL(0, allocations - allocated);
+  TEST_ASSERT_EQUAL_STRING((std::string(message) + "\n").c_str(), mock.text.c_str());
+}
+
+void test_a_line_beyond_the_arena_is_truncated() {
+  setMessage(ARDEBUG_FLEXBUFFER_ARENA + 32);
+  size_t allocated = allocations;
+  AR_LOGI("%s", message);
+  TEST_ASSERT_EQUAL(0, allocations - allocated);
+  TEST_ASSERT_LESS_OR_EQUAL(ARDEBUG_FLEXBUFFER_ARENA, mock.text.size());
+  TEST_ASSERT_GREATER_THAN(ARDEBUG_LINE_SIZE, mock.text.size());
+  TEST_ASSERT_TRUE(mock.text.find(std::string(message, 64)) != std::string::npos);
+}
+
+int main() {
+  mock.text.reserve(4 * ARDEBUG_FLEXBUFFER_ARENA);
+  ardebugBegin(&mock, nullptr, nullptr);
+  UNITY_BEGIN();
+  RUN_TEST(test_a_long_line_is_whole_without_allocating);
+  RUN_TEST(test_a_long_ardprintf_is_whole_without_allocating);
+  RUN_TEST(test_a_line_beyond_the_arena_is_truncated);
+  return UNITY_END();
+}
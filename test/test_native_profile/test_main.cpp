@@ -0,0 +1,128 @@
+/**
+ * @brief ProfileHistogram percentiles, AR_PROFILE_SCOPE() timing and the
+ * report written to the sinks
+*/
+
+#include <stdlib.h>
+#include <string>
+#include <unity.h>
+#include "ardebug.h"
+
+using ardebug::ProfileHistogram;
+
+/** @brief A Stream that keeps what is written to it */
+class MockStream : public Stream {
+  public:
+    std::string text;
+
+    size_t write(uint8_t c) override {
+      text += (char)c;
+      return 1;
+    }
+    size_t write(const uint8_t* buffer, size_t size) override {
+      text.append((const char*)buffer, size);
+      return size;
+    }
+    using Print::write;
+    int availableForWrite() override { return 1 << 16; }
+    int available() override { return 0; }
+    int read() override { return -1; }
+    int peek() override { return -1; }
+};
+
+static MockStream mock;
+
+static int count(const std::string& text, const char* part) {
+  int n = 0;
+  for (size_t pos = text.find(part); pos != std::string::npos; pos = text.find(part, pos + 1)) n++;
+  return n;
+}
+
+// the number after `field` in the report line of `scope`, -1 if there is none
+static long reportField(const char* scope, const char* field) {
+  std::string line = std::string("[ardebug] profile ") + scope + ": ";
+  size_t pos = mock.text.find(line);
+  if (pos == std::string::npos) return -1;
+  size_t end = mock.text.find('\n', pos);
+  pos = mock.text.find(field, pos);
+  if (pos == std::string::npos || pos > end) return -1;
+  return atol(mock.text.c_str() + pos + strlen(field));
+}
+
+static void sleepScope(uint32_t ms) {
+  AR_PROFILE_SCOPE("sleep");
+  delay(ms);
+}
+
+void setUp() {
+  ardebugHandle();
+  mock.text.clear();
+}
+
+void tearDown() {}
+
+void test_histogram_percentiles() {
+  static ProfileHistogram profile;
+  for (uint32_t us = 1; us <= 100; us++) profile.record(us);
+  TEST_ASSERT_EQUAL(100, profile.count());
+  TEST_ASSERT_EQUAL(1, profile.min());
+  TEST_ASSERT_EQUAL(100, profile.max());
+  TEST_ASSERT_EQUAL(50, profile.percentile(500));  // interpolated in the 32..63 bucket
+  TEST_ASSERT_EQUAL(100, profile.percentile(990));  // held to the maximum
+  TEST_ASSERT_LESS_OR_EQUAL(profile.percentile(990), profile.percentile(500));
+
+  profile.reset();
+  TEST_ASSERT_EQUAL(0, profile.count());
+  TEST_ASSERT_EQUAL(0, profile.min());
+  TEST_ASSERT_EQUAL(0, profile.max());
+  TEST_ASSERT_EQUAL(0, profile.percentile(500));
+}
+
+void test_one_duration_is_every_percentile() {
+  static ProfileHistogram profile;
+  profile.record(700);
+  TEST_ASSERT_EQUAL(700, profile.min());
+  TEST_ASSERT_EQUAL(700, profile.percentile(500));
+  TEST_ASSERT_EQUAL(700, profile.percentile(990));
+}
+
+void test_scopes_are_timed_and_reported() {
+  for (int i = 0; i < 3; i++) sleepScope(2);
+  ardebugProfileReport();
+  TEST_ASSERT_EQUAL(3, reportField("sleep", "n="));
+  TEST_ASSERT_GREATER_OR_EQUAL(2000, reportField("sleep", "min="));
+  TEST_ASSERT_LESS_THAN(200000, reportField("sleep", "max="));
+  TEST_ASSERT_TRUE(reportField("sleep", "p50=") >= reportField("sleep", "min="));
+  TEST_ASSERT_TRUE(mock.text.find(" us\n") != std::string::npos);
+
+  mock.text.clear();
+  ardebugProfileReset();
+  ardebugProfileReport();
+  TEST_ASSERT_EQUAL(0, reportField("sleep", "n="));
+}
+
+// fills the table, so it runs last
+void test_scopes_beyond_the_table_are_not_recorded() {
+  static char names[ARDEBUG_PROFILE_SCOPES + 1][12];
+  uint8_t id = 0;
+  for (int i = 0; i <= ARDEBUG_PROFILE_SCOPES; i++) {
+    snprintf(names[i], sizeof(names[i]), "scope%d", i);
+    id = ardebug::profileScope(names[i]);
+  }
+  TEST_ASSERT_EQUAL(ARDEBUG_PROFILE_SCOPES, id);
+  ardebug::profileRecord(id, 5);  // ignored
+  ardebugProfileReport();
+  TEST_ASSERT_EQUAL(ARDEBUG_PROFILE_SCOPES, count(mock.text, "[ardebug] profile "));
+  TEST_ASSERT_EQUAL(0, reportField("scope0", "n="));
+  TEST_ASSERT_TRUE(mock.text.find(names[ARDEBUG_PROFILE_SCOPES]) == std::string::npos);
+}
+
+int main() {
+  ardebugBegin(&mock, nullptr, nullptr);
+  UNITY_BEGIN();
+  RUN_TEST(test_histogram_percentiles);
+  RUN_TEST(test_one_duration_is_every_percentile);
+  RUN_TEST(test_scopes_are_timed_and_reported);
+  RUN_TEST(test_scopes_beyond_the_table_are_not_recorded);
+  return UNITY_END();
+}
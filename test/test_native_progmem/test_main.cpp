@@ -0,0 +1,95 @@
+/**
+ * @brief Call sites and format strings kept in flash with ARDEBUG_PROGMEM
+ * (pio test -e native_progmem, where PROGMEM is plain memory)
+*/
+
+#include <string>
+#include <unity.h>
+#include "ardebug.h"
+
+#if !defined(ARDEBUG_PROGMEM)
+#error "test_native_progmem needs BOARD_PROGMEM, see [env:native_progmem]"
+#endif
+
+using ardebug::DebugContext;
+
+static_assert(ardebug::fileBasenameOffset("src/dir/file.cpp") == 8, "after the last /");
+static_assert(ardebug::fileBasenameOffset("src\\file.cpp") == 4, "after the last \\");
+static_assert(ardebug::fileBasenameOffset("file.cpp") == 0, "a name without a path");
+
+/** @brief A Stream that keeps what is written to it */
+class MockStream : public Stream {
+  public:
+    std::string text;
+
+    size_t write(uint8_t c) override {
+      text += (char)c;
+      return 1;
+    }
+    size_t write(const uint8_t* buffer, size_t size) override {
+      text.append((const char*)buffer, size);
+      return size;
+    }
+    using Print::write;
+    int availableForWrite() override { return 1 << 16; }
+    int available() override { return 0; }
+    int read() override { return -1; }
+    int peek() override { return -1; }
+};
+
+static MockStream mock;
+
+static bool contains(const std::string& text, const char* part) {
+  return text.find(part) != std::string::npos;
+}
+
+void setUp() {
+  ardebugSetLevel(ARDEBUG_V);
+  ardebugHandle();
+  mock.text.clear();
+}
+
+void tearDown() {}
+
+void test_a_flash_site_is_formatted() {
+  int line = __LINE__ + 1;
+  AR_LOGI("flash %d %s", 42, "args");
+  TEST_ASSERT_TRUE(contains(mock.text, "[I]"));
+  TEST_ASSERT_TRUE(contains(mock.text, "flash 42 args\n"));
+  char where[32];
+  snprintf(where, sizeof(where), "[test_main.cpp:%d]: ", line);
+  TEST_ASSERT_TRUE(contains(mock.text, where));
+  TEST_ASSERT_FALSE(contains(mock.text, "()"));  // __func__ is left out of flash sites
+}
+
+void test_a_flash_site_below_the_level_is_skipped() {
+  ardebugSetLevel(ARDEBUG_W);
+  AR_LOGI("hidden %d", 1);
+  AR_LOGW("shown %d", 2);
+  TEST_ASSERT_FALSE(contains(mock.text, "hidden 1"));
+  TEST_ASSERT_TRUE(contains(mock.text, "shown 2\n"));
+}
+
+void test_a_tagged_flash_site_is_formatted() {
+  TEST_ASSERT_TRUE(ardebugTagLevel("flash", ARDEBUG_W));
+  AR_LOGI_TAG("flash", "quieted %d", 1);
+  AR_LOGW_TAG("flash", "tagged %d", 2);
+  TEST_ASSERT_FALSE(contains(mock.text, "quieted 1"));
+  TEST_ASSERT_TRUE(contains(mock.text, "[W][flash]"));
+  TEST_ASSERT_TRUE(contains(mock.text, "tagged 2\n"));
+}
+
+void test_ardprintf_takes_a_flash_format() {
+  ardprintf("plain %u of %s\n", 3u, "F()");
+  TEST_ASSERT_EQUAL_STRING("plain 3 of F()\n", mock.text.c_str());
+}
+
+int main() {
+  ardebugBegin(&mock, nullptr, nullptr);
+  UNITY_BEGIN();
+  RUN_TEST(test_a_flash_site_is_formatted);
+  RUN_TEST(test_a_flash_site_below_the_level_is_skipped);
+  RUN_TEST(test_a_tagged_flash_site_is_formatted);
+  RUN_TEST(test_ardprintf_takes_a_flash_format);
+  return UNITY_END();
+}
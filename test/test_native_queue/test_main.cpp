@@ -0,0 +1,162 @@
+/**
+ * @brief OutputQueue drop policies and the note of lost lines, against a
+ * Print whose free space the test sets
+*/
+
+#include <stdlib.h>
+#include <string>
+#include <unity.h>
+#include "ardebug.h"
+
+using ardebug::OutputQueue;
+
+/** @brief A sink with `room` bytes of buffer free, used up by each write */
+class MockPrint : public Stream {
+  public:
+    std::string text;
+    int room = 1 << 16;
+
+    size_t write(uint8_t c) override { return write(&c, 1); }
+    size_t write(const uint8_t* buffer, size_t size) override {
+      if ((int)size > room) size = room > 0 ? room : 0;
+      text.append((const char*)buffer, size);
+      room -= size;
+      return size;
+    }
+    using Print::write;
+    int availableForWrite() override { return room; }
+    int available() override { return 0; }
+    int read() override { return -1; }
+    int peek() override { return -1; }
+};
+
+static int space(Print& out) {
+  return out.availableForWrite();
+}
+
+static void writeLine(OutputQueue& queue, MockPrint& out, int n, uint8_t policy) {
+  char line[16];
+  int len = snprintf(line, sizeof(line), "line %03d\n", n);
+  queue.write(out, space, (const uint8_t*)line, len, policy, 0);
+}
+
+// the numbers of the "line NNN" lines in `text`, -1 where any other text was
+static std::string lineNumbers(const std::string& text) {
+  std::string numbers;
+  size_t pos = 0;
+  while (pos < text.size()) {
+    size_t end = text.find('\n', pos);
+    if (end == std::string::npos) end = text.size();
+    std::string line = text.substr(pos, end - pos);
+    numbers += line.compare(0, 5, "line ") == 0 ? std::to_string(atoi(line.c_str() + 5)) : "-1";
+    numbers += ' ';
+    pos = end + 1;
+  }
+  return numbers;
+}
+
+void setUp() {}
+void tearDown() {}
+
+void test_writes_straight_through_with_room() {
+  static OutputQueue queue;
+  MockPrint out;
+  for (int i = 0; i < 3; i++) writeLine(queue, out, i, ARDEBUG_DROP_OLDEST);
+  TEST_ASSERT_EQUAL_STRING("line 000\nline 001\nline 002\n", out.text.c_str());
+  TEST_ASSERT_EQUAL(0, queue.size());
+  TEST_ASSERT_TRUE(queue.idle());
+}
+
+void test_a_partly_written_line_is_finished_later() {
+  static OutputQueue queue;
+  MockPrint out;
+  writeLine(queue, out, 0, ARDEBUG_DROP_OLDEST);  // reports room once
+  out.room = 4;
+  writeLine(queue, out, 1, ARDEBUG_DROP_OLDEST);
+  TEST_ASSERT_EQUAL_STRING("line 000\nline", out.text.c_str());
+  out.room = 0;
+  writeLine(queue, out, 2, ARDEBUG_DROP_OLDEST);
+  out.room = 100;
+  queue.pump(out, space);
+  TEST_ASSERT_EQUAL_STRING("line 000\nline 001\nline 002\n", out.text.c_str());
+  TEST_ASSERT_EQUAL(0, queue.dropped());
+}
+
+void test_drop_oldest_keeps_the_newest_lines() {
+  static OutputQueue queue;
+  MockPrint out;
+  writeLine(queue, out, 0, ARDEBUG_DROP_OLDEST);
+  out.text.clear();
+  out.room = 0;
+  for (int i = 1; i <= 200; i++) writeLine(queue, out, i, ARDEBUG_DROP_OLDEST);
+  TEST_ASSERT_TRUE(out.text.empty());
+  TEST_ASSERT_GREATER_THAN(0, queue.dropped());
+
+  out.room = 1 << 16;
+  queue.pump(out, space);
+  char note[48];
+  snprintf(note, sizeof(note), "[ardebug] %u lines dropped\n", (unsigned)queue.dropped());
+  // the note stands where the lines went missing, ahead of the newest ones
+  TEST_ASSERT_EQUAL(0, out.text.find(note));
+  std::string kept;
+  for (uint32_t i = queue.dropped() + 1; i <= 200; i++) {
+    kept += std::to_string(i) + ' ';
+  }
+  TEST_ASSERT_EQUAL_STRING(("-1 " + kept).c_str(), lineNumbers(out.text).c_str());
+  TEST_ASSERT_TRUE(queue.idle());
+}
+
+void test_drop_newest_keeps_the_oldest_lines() {
+  static OutputQueue queue;
+  MockPrint out;
+  writeLine(queue, out, 0, ARDEBUG_DROP_NEWEST);
+  out.text.clear();
+  out.room = 0;
+  for (int i = 1; i <= 200; i++) writeLine(queue, out, i, ARDEBUG_DROP_NEWEST);
+  uint32_t dropped = queue.dropped();
+  TEST_ASSERT_GREATER_THAN(0, dropped);
+
+  out.room = 1 << 16;
+  writeLine(queue, out, 201, ARDEBUG_DROP_NEWEST);
+  // the queued lines, then the note of the lost ones, then the next line
+  std::string expected;
+  for (uint32_t i = 1; i <= 200 - dropped; i++) expected += std::to_string(i) + ' ';
+  expected += "-1 201 ";
+  TEST_ASSERT_EQUAL_STRING(expected.c_str(), lineNumbers(out.text).c_str());
+  char note[48];
+  snprintf(note, sizeof(note), "\n[ardebug] %u lines dropped\n", (unsigned)dropped);
+  TEST_ASSERT_TRUE(out.text.find(note) != std::string::npos);
+  TEST_ASSERT_TRUE(queue.idle());
+}
+
+void test_serial_drops_are_counted() {
+  static MockPrint serial;
+  ardebug::DebugContext& ctx = ardebug::DebugContext::get();
+  ardebugBegin(&serial, nullptr, nullptr);
+  ardebugQueuePolicy(ARDEBUG_DROP_OLDEST);
+  AR_LOGI("first");
+  serial.room = 0;
+  for (int i = 0; i < 200; i++) AR_LOGI("burst %03d", i);
+  ardebugHandle();
+  uint32_t dropped = ctx.droppedLines();
+  TEST_ASSERT_GREATER_THAN(0, dropped);
+
+  serial.room = 1 << 16;
+  ardebugHandle();
+  char note[48];
+  snprintf(note, sizeof(note), "[ardebug] %u lines dropped\n", (unsigned)dropped);
+  TEST_ASSERT_TRUE(serial.text.find(note) != std::string::npos);
+  TEST_ASSERT_TRUE(serial.text.find("burst 199\n") != std::string::npos);
+  TEST_ASSERT_TRUE(serial.text.find("burst 000\n") == std::string::npos);
+  ctx.stop();
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_writes_straight_through_with_room);
+  RUN_TEST(test_a_partly_written_line_is_finished_later);
+  RUN_TEST(test_drop_oldest_keeps_the_newest_lines);
+  RUN_TEST(test_drop_newest_keeps_the_oldest_lines);
+  RUN_TEST(test_serial_drops_are_counted);
+  return UNITY_END();
+}
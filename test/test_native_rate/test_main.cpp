@@ -0,0 +1,126 @@
+/**
+ * @brief Flood control: per call site rate limits with their suppressed
+ * counts, and collapsing of repeated lines
+*/
+
+#include <string>
+#include <unity.h>
+#include "ardebug.h"
+
+using ardebug::DebugContext;
+
+/** @brief A Stream that keeps what is written to it */
+class MockStream : public Stream {
+  public:
+    std::string text;
+
+    size_t write(uint8_t c) override {
+      text += (char)c;
+      return 1;
+    }
+    size_t write(const uint8_t* buffer, size_t size) override {
+      text.append((const char*)buffer, size);
+      return size;
+    }
+    using Print::write;
+    int availableForWrite() override { return 1 << 16; }
+    int available() override { return 0; }
+    int read() override { return -1; }
+    int peek() override { return -1; }
+};
+
+static MockStream mock;
+
+static int count(const std::string& text, const char* part) {
+  int n = 0;
+  for (size_t pos = text.find(part); pos != std::string::npos; pos = text.find(part, pos + 1)) n++;
+  return n;
+}
+
+static bool contains(const std::string& text, const char* part) {
+  return text.find(part) != std::string::npos;
+}
+
+// past ARDEBUG_RATE_REPORT_MS, so the counts are written
+static void handleAfterReport() {
+  delay(ARDEBUG_RATE_REPORT_MS + 10);
+  ardebugHandle();
+}
+
+void setUp() {
+  handleAfterReport();
+  mock.text.clear();
+}
+
+void tearDown() {
+  ardebugRateLimit(0, ARDEBUG_RATE_BURST);
+  for (uint8_t level = ARDEBUG_E; level <= ARDEBUG_V; level++) {
+    ardebugLevelRateLimit(level, 0, ARDEBUG_RATE_BURST);
+  }
+  ardebugCollapseRepeats(false);
+}
+
+void test_a_rate_limit_suppresses_and_counts() {
+  uint32_t suppressed = DebugContext::get().suppressedLines();
+  ardebugRateLimit(5, 10);
+  for (int i = 0; i < 100; i++) AR_LOGI("flood %d", i);
+  int written = count(mock.text, "flood ");
+  TEST_ASSERT_TRUE(written >= 10 && written <= 11);  // the burst, and a refill at most
+  TEST_ASSERT_TRUE(contains(mock.text, "flood 0\n"));
+  TEST_ASSERT_FALSE(contains(mock.text, "flood 99\n"));
+  uint32_t dropped = DebugContext::get().suppressedLines() - suppressed;
+  TEST_ASSERT_EQUAL(100 - written, dropped);
+
+  handleAfterReport();
+  char note[64];
+  snprintf(note, sizeof(note), "[ardebug] %u lines suppressed at test_main.cpp:",
+           (unsigned)dropped);
+  TEST_ASSERT_TRUE(contains(mock.text, note));
+  TEST_ASSERT_EQUAL(1, count(mock.text, "suppressed"));
+
+  mock.text.clear();
+  handleAfterReport();  // counted once
+  TEST_ASSERT_FALSE(contains(mock.text, "suppressed"));
+}
+
+void test_a_level_rate_limit_leaves_other_levels() {
+  ardebugLevelRateLimit(ARDEBUG_W, 1, 2);
+  for (int i = 0; i < 20; i++) {
+    AR_LOGW("warning %d", i);
+    AR_LOGI("info %d", i);
+  }
+  TEST_ASSERT_TRUE(count(mock.text, "warning ") <= 3);
+  TEST_ASSERT_EQUAL(20, count(mock.text, "info "));
+}
+
+void test_repeats_collapse_until_the_text_changes() {
+  ardebugCollapseRepeats(true);
+  for (int i = 0; i < 7; i++) AR_LOGI("value %d", i < 5 ? 1 : 2);
+  TEST_ASSERT_EQUAL(1, count(mock.text, "value 1\n"));
+  TEST_ASSERT_EQUAL(1, count(mock.text, "value 2\n"));  // a new run
+  size_t note = mock.text.find("[ardebug] last message repeated 4 times\n");
+  TEST_ASSERT_TRUE(note != std::string::npos);
+  TEST_ASSERT_TRUE(mock.text.find("value 1\n") < note);
+  TEST_ASSERT_TRUE(note < mock.text.find("value 2\n"));
+
+  handleAfterReport();  // the second run, counted after the report interval
+  TEST_ASSERT_TRUE(contains(mock.text, "[ardebug] last message repeated 1 times\n"));
+}
+
+void test_other_call_sites_end_a_run() {
+  ardebugCollapseRepeats(true);
+  for (int i = 0; i < 3; i++) AR_LOGI("same");
+  AR_LOGI("same");  // identical text, another call site
+  TEST_ASSERT_EQUAL(2, count(mock.text, "same\n"));
+  TEST_ASSERT_TRUE(contains(mock.text, "last message repeated 2 times"));
+}
+
+int main() {
+  ardebugBegin(&mock, nullptr, nullptr);
+  UNITY_BEGIN();
+  RUN_TEST(test_a_rate_limit_suppresses_and_counts);
+  RUN_TEST(test_a_level_rate_limit_leaves_other_levels);
+  RUN_TEST(test_repeats_collapse_until_the_text_changes);
+  RUN_TEST(test_other_call_sites_end_a_run);
+  return UNITY_END();
+}
@@ -0,0 +1,108 @@
+/**
+ * @brief Hot path sampling: AR_LOGx_SAMPLED() every n-th call and
+ * AR_LOGx_EVERY_MS() with its count of skipped calls
+*/
+
+#include <string>
+#include <unity.h>
+#include "ardebug.h"
+
+/** @brief A Stream that keeps what is written to it */
+class MockStream : public Stream {
+  public:
+    std::string text;
+
+    size_t write(uint8_t c) override {
+      text += (char)c;
+      return 1;
+    }
+    size_t write(const uint8_t* buffer, size_t size) override {
+      text.append((const char*)buffer, size);
+      return size;
+    }
+    using Print::write;
+    int availableForWrite() override { return 1 << 16; }
+    int available() override { return 0; }
+    int read() override { return -1; }
+    int peek() override { return -1; }
+};
+
+static MockStream mock;
+
+static int count(const std::string& text, const char* part) {
+  int n = 0;
+  for (size_t pos = text.find(part); pos != std::string::npos; pos = text.find(part, pos + 1)) n++;
+  return n;
+}
+
+static bool contains(const std::string& text, const char* part) {
+  return text.find(part) != std::string::npos;
+}
+
+static int evaluated = 0;
+
+static int argument(int i) {
+  evaluated++;
+  return i;
+}
+
+// one call site, sampled at two levels of the output
+static void sampledDebug(int i) {
+  AR_LOGD_SAMPLED(3, "debug %d", i);
+}
+
+static void everyMs(int i) {
+  AR_LOGI_EVERY_MS(50, "every %d", i);
+}
+
+void setUp() {
+  ardebugSetLevel(ARDEBUG_I);
+  ardebugHandle();
+  evaluated = 0;
+  mock.text.clear();
+}
+
+void tearDown() {}
+
+void test_every_nth_call_is_logged() {
+  for (int i = 0; i < 100; i++) AR_LOGI_SAMPLED(10, "sample %d", argument(i));
+  TEST_ASSERT_EQUAL(10, count(mock.text, "sample "));
+  TEST_ASSERT_EQUAL(10, evaluated);  // skipped calls are not formatted
+  TEST_ASSERT_FALSE(contains(mock.text, "sample 0\n"));
+  TEST_ASSERT_TRUE(contains(mock.text, "sample 9\n"));
+  TEST_ASSERT_TRUE(contains(mock.text, "sample 99\n"));
+}
+
+void test_calls_below_the_level_are_not_counted() {
+  for (int i = 0; i < 5; i++) sampledDebug(i);
+  TEST_ASSERT_FALSE(contains(mock.text, "debug "));
+  ardebugSetLevel(ARDEBUG_D);
+  for (int i = 10; i < 13; i++) sampledDebug(i);
+  TEST_ASSERT_EQUAL(1, count(mock.text, "debug "));
+  TEST_ASSERT_TRUE(contains(mock.text, "debug 12\n"));
+}
+
+void test_one_call_per_interval_with_the_skipped_count() {
+  everyMs(0);
+  for (int i = 1; i <= 20; i++) everyMs(i);
+  TEST_ASSERT_EQUAL(1, count(mock.text, "every "));
+  TEST_ASSERT_TRUE(contains(mock.text, "every 0\n"));  // the first call, nothing skipped
+
+  delay(60);
+  everyMs(21);
+  TEST_ASSERT_EQUAL(2, count(mock.text, "every "));
+  TEST_ASSERT_TRUE(contains(mock.text, "every 21 (20 skipped)\n"));
+
+  delay(60);
+  everyMs(22);
+  TEST_ASSERT_TRUE(contains(mock.text, "every 22\n"));
+}
+
+int main() {
+  ardebugBegin(&mock, nullptr, nullptr);
+  UNITY_BEGIN();
+  RUN_TEST(test_every_nth_call_is_logged);
+  RUN_TEST(test_calls_below_the_level_are_not_counted);
+  RUN_TEST(test_one_call_per_interval_with_the_skipped_count);
+  return UNITY_END();
+}
@@ -0,0 +1,137 @@
+/**
+ * @brief Runtime statistics: lines and bytes per level, per sink counts,
+ * truncations, the log call durations and resetStats()
+*/
+
+#include <string>
+#include <unity.h>
+#include "ardebug.h"
+
+using ardebug::DebugContext;
+using ardebug::DebugStats;
+using ardebug::LogRecord;
+
+/** @brief A Stream that keeps what is written to it */
+class MockStream : public Stream {
+  public:
+    std::string text;
+
+    size_t write(uint8_t c) override {
+      text += (char)c;
+      return 1;
+    }
+    size_t write(const uint8_t* buffer, size_t size) override {
+      text.append((const char*)buffer, size);
+      return size;
+    }
+    using Print::write;
+    int availableForWrite() override { return 1 << 16; }
+    int available() override { return 0; }
+    int read() override { return -1; }
+    int peek() override { return -1; }
+};
+
+/** @brief A sink of warnings and errors that adds up what it was given */
+class CountingSink : public ardebug::Sink {
+  public:
+    uint32_t written = 0;
+    uint32_t written_bytes = 0;
+
+    CountingSink() { level_ = ARDEBUG_W; }
+    void write(const LogRecord& record) override {
+      written++;
+      written_bytes += record.length();
+    }
+};
+
+static MockStream mock;
+static CountingSink counting;
+
+void setUp() {
+  ardebugHandle();
+  DebugContext::get().resetStats();
+  counting.written = 0;
+  counting.written_bytes = 0;
+  mock.text.clear();
+}
+
+void tearDown() {}
+
+void test_lines_and_bytes_are_counted_per_level() {
+  AR_LOGE("error %d", 1);
+  AR_LOGW("warning %d", 2);
+  AR_LOGI("info %d", 3);
+  AR_LOGI("info %d", 4);
+  AR_LOGD("debug %d", 5);  // below every output, never formatted
+  ardprintf("raw %d\n", 6);
+  DebugStats stats;
+  DebugContext::get().stats(stats);
+  TEST_ASSERT_EQUAL(1, stats.lines[ARDEBUG_E]);
+  TEST_ASSERT_EQUAL(1, stats.lines[ARDEBUG_W]);
+  TEST_ASSERT_EQUAL(2, stats.lines[ARDEBUG_I]);
+  TEST_ASSERT_EQUAL(0, stats.lines[ARDEBUG_D]);
+  TEST_ASSERT_EQUAL(0, stats.lines[ARDEBUG_V]);
+  TEST_ASSERT_EQUAL(1, stats.lines[ARDEBUG_V + 1]);  // ardprintf()
+  uint32_t bytes = 0;
+  for (int i = 0; i < ARDEBUG_STATS_LEVELS; i++) bytes += stats.bytes[i];
+  TEST_ASSERT_EQUAL(mock.text.size(), bytes);  // Serial wrote every line, without colors
+  TEST_ASSERT_EQUAL(strlen("raw 6\n"), stats.bytes[ARDEBUG_V + 1]);
+  TEST_ASSERT_EQUAL(0, stats.truncated);
+  TEST_ASSERT_EQUAL(0, stats.dropped);
+}
+
+void test_each_sink_counts_what_it_was_offered() {
+  AR_LOGE("error %d", 1);
+  AR_LOGW("warning %d", 2);
+  AR_LOGI("info %d", 3);
+  TEST_ASSERT_EQUAL(2, counting.offeredLines());
+  TEST_ASSERT_EQUAL(counting.written_bytes, counting.offeredBytes());
+  TEST_ASSERT_EQUAL(2, counting.written);
+  DebugStats stats;
+  DebugContext::get().stats(stats);
+  TEST_ASSERT_EQUAL(stats.bytes[ARDEBUG_E] + stats.bytes[ARDEBUG_W], counting.offeredBytes());
+}
+
+void test_lines_cut_at_the_buffer_are_counted() {
+  char message[ARDEBUG_BUFFER_SIZE * 2];
+  memset(message, 'x', sizeof(message) - 1);
+  message[sizeof(message) - 1] = 0;
+  AR_LOGI("%s", message);
+  AR_LOGI("short");
+  DebugStats stats;
+  DebugContext::get().stats(stats);
+#if defined(ARDEBUG_FLEXBUFFER)
+  TEST_ASSERT_EQUAL(0, stats.truncated);  // formatted again in a larger buffer
+#else
+  TEST_ASSERT_EQUAL(1, stats.truncated);
+#endif
+  TEST_ASSERT_EQUAL(2, stats.lines[ARDEBUG_I]);
+}
+
+void test_log_calls_are_timed_and_reset() {
+  for (int i = 0; i < 10; i++) AR_LOGI("timed %d", i);
+  const ardebug::ProfileHistogram& latency = DebugContext::get().callLatency();
+  TEST_ASSERT_EQUAL(10, latency.count());
+  TEST_ASSERT_LESS_OR_EQUAL(latency.max(), latency.percentile(500));
+  TEST_ASSERT_LESS_THAN(100000, latency.max());  // us
+
+  DebugContext::get().resetStats();
+  DebugStats stats;
+  DebugContext::get().stats(stats);
+  TEST_ASSERT_EQUAL(0, latency.count());
+  TEST_ASSERT_EQUAL(0, stats.lines[ARDEBUG_I]);
+  TEST_ASSERT_EQUAL(0, stats.bytes[ARDEBUG_I]);
+  TEST_ASSERT_EQUAL(0, counting.offeredLines());
+}
+
+int main() {
+  ardebugBegin(&mock, nullptr, nullptr);
+  ardebugSetLevel(ARDEBUG_I);
+  ardebugAddSink(&counting);
+  UNITY_BEGIN();
+  RUN_TEST(test_lines_and_bytes_are_counted_per_level);
+  RUN_TEST(test_each_sink_counts_what_it_was_offered);
+  RUN_TEST(test_lines_cut_at_the_buffer_are_counted);
+  RUN_TEST(test_log_calls_are_timed_and_reset);
+  return UNITY_END();
+}
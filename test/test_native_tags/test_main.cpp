@@ -0,0 +1,131 @@
+/**
+ * @brief Per-tag levels: the gate of tagged call sites, clearing a tag's
+ * level and the shared slot of tags beyond the table
+*/
+
+#include <string>
+#include <unity.h>
+#include "ardebug.h"
+
+using ardebug::DebugContext;
+
+/** @brief A Stream that keeps what is written to it */
+class MockStream : public Stream {
+  public:
+    std::string text;
+
+    size_t write(uint8_t c) override {
+      text += (char)c;
+      return 1;
+    }
+    size_t write(const uint8_t* buffer, size_t size) override {
+      text.append((const char*)buffer, size);
+      return size;
+    }
+    using Print::write;
+    int availableForWrite() override { return 1 << 16; }
+    int available() override { return 0; }
+    int read() override { return -1; }
+    int peek() override { return -1; }
+};
+
+static MockStream mock;
+
+static bool contains(const std::string& text, const char* part) {
+  return text.find(part) != std::string::npos;
+}
+
+// the gate a new call site of `tag` would see
+static bool gateOpen(uint8_t level, const char* tag) {
+  uint8_t id = ARDEBUG_TAG_NEW;
+  return DebugContext::tagEnabled(level, id, tag);
+}
+
+void setUp() {
+  ardebugSetLevel(ARDEBUG_I);
+  ardebugHandle();
+  mock.text.clear();
+}
+
+void tearDown() {}
+
+void test_a_tag_level_gates_its_lines() {
+  TEST_ASSERT_TRUE(ardebugTagLevel("noisy", ARDEBUG_W));
+  TEST_ASSERT_EQUAL(ARDEBUG_W, DebugContext::get().tagLevel("noisy"));
+  AR_LOGI_TAG("noisy", "quieted %d", 1);
+  AR_LOGW_TAG("noisy", "warned %d", 2);
+  AR_LOGI_TAG("other", "other %d", 3);
+  AR_LOGI("untagged %d", 4);
+  ardebugHandle();
+  TEST_ASSERT_FALSE(contains(mock.text, "quieted 1"));
+  TEST_ASSERT_TRUE(contains(mock.text, "[W][noisy]"));
+  TEST_ASSERT_TRUE(contains(mock.text, "warned 2"));
+  TEST_ASSERT_TRUE(contains(mock.text, "[I][other]"));
+  TEST_ASSERT_TRUE(contains(mock.text, "other 3"));
+  TEST_ASSERT_TRUE(contains(mock.text, "untagged 4"));
+}
+
+void test_outputs_still_apply_their_own_level() {
+  TEST_ASSERT_TRUE(ardebugTagLevel("chatty", ARDEBUG_V));
+  TEST_ASSERT_TRUE(gateOpen(ARDEBUG_D, "chatty"));  // the tag's gate lets it through
+  TEST_ASSERT_FALSE(gateOpen(ARDEBUG_D, "other"));
+  AR_LOGD_TAG("chatty", "debug %d", 1);
+  ardebugHandle();
+  TEST_ASSERT_FALSE(contains(mock.text, "debug 1"));  // Serial is at INFO
+
+  ardebugSetLevel(ARDEBUG_V);
+  AR_LOGD_TAG("chatty", "debug %d", 2);
+  ardebugHandle();
+  TEST_ASSERT_TRUE(contains(mock.text, "[D][chatty]"));
+}
+
+void test_clearing_a_tag_level_follows_the_others_again() {
+  TEST_ASSERT_TRUE(ardebugTagLevel("noisy", ARDEBUG_W));
+  TEST_ASSERT_TRUE(ardebugTagLevel("noisy", -1));
+  TEST_ASSERT_EQUAL(-1, DebugContext::get().tagLevel("noisy"));
+  AR_LOGI_TAG("noisy", "heard %d", 1);
+  ardebugHandle();
+  TEST_ASSERT_TRUE(contains(mock.text, "[I][noisy]"));
+
+  ardebugSetLevel(ARDEBUG_W);
+  TEST_ASSERT_FALSE(gateOpen(ARDEBUG_I, "noisy"));
+  ardebugSetLevel(ARDEBUG_V);
+  TEST_ASSERT_TRUE(gateOpen(ARDEBUG_V, "noisy"));
+  TEST_ASSERT_FALSE(ardebugTagLevel("noisy", ARDEBUG_V + 1));
+}
+
+// fills the table, so it runs last
+void test_tags_beyond_the_table_share_slot_0() {
+  char name[ARDEBUG_TAG_SIZE];
+  for (int i = 0; i < ARDEBUG_MAX_TAGS; i++) {
+    snprintf(name, sizeof(name), "fill%d", i);
+    DebugContext::internTag(name);
+  }
+  TEST_ASSERT_EQUAL(0, DebugContext::internTag("overflow"));
+  TEST_ASSERT_TRUE(DebugContext::get().tagName(0) == nullptr);
+  TEST_ASSERT_FALSE(ardebugTagLevel("overflow", ARDEBUG_V));  // no slot of its own
+  TEST_ASSERT_EQUAL(-1, DebugContext::get().tagLevel("overflow"));
+
+  // slot 0 follows the global level
+  ardebugSetLevel(ARDEBUG_W);
+  TEST_ASSERT_FALSE(gateOpen(ARDEBUG_I, "overflow"));
+  TEST_ASSERT_TRUE(gateOpen(ARDEBUG_W, "overflow"));
+  ardebugSetLevel(ARDEBUG_D);
+  TEST_ASSERT_TRUE(gateOpen(ARDEBUG_D, "overflow"));
+  TEST_ASSERT_FALSE(gateOpen(ARDEBUG_V, "overflow"));
+
+  AR_LOGI_TAG("overflow", "shared %d", 1);
+  ardebugHandle();
+  TEST_ASSERT_TRUE(contains(mock.text, "shared 1"));
+  TEST_ASSERT_FALSE(contains(mock.text, "[overflow]"));  // no name in the prefix
+}
+
+int main() {
+  ardebugBegin(&mock, nullptr, nullptr);
+  UNITY_BEGIN();
+  RUN_TEST(test_a_tag_level_gates_its_lines);
+  RUN_TEST(test_outputs_still_apply_their_own_level);
+  RUN_TEST(test_clearing_a_tag_level_follows_the_others_again);
+  RUN_TEST(test_tags_beyond_the_table_share_slot_0);
+  return UNITY_END();
+}
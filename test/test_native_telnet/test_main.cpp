@@ -0,0 +1,225 @@
+/**
+ * @brief Telnet sessions over the loopback WiFi stand-in in native/: levels
+ * and colors per session, the client limit, a client that stops reading and
+ * the backlog replayed to a late client
+*/
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string>
+#include <unity.h>
+#include "ardebug.h"
+
+static int connectClient(int receive_buffer = 0) {
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  if (receive_buffer > 0) {
+    setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &receive_buffer, sizeof(receive_buffer));
+  }
+  struct sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(ARDEBUG_TELNET_PORT);
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  if (connect(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+    close(fd);
+    return -1;
+  }
+  fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+  return fd;
+}
+
+// ardebugHandle() as a sketch's loop() calls it
+static void handleFor(uint32_t ms) {
+  uint32_t start = millis();
+  do {
+    ardebugHandle();
+    delay(1);
+  } while (millis() - start < ms);
+}
+
+// what the client has received so far; `closed` is set at the end of the stream
+static std::string receive(int fd, bool* closed = nullptr) {
+  std::string text;
+  char buffer[4096];
+  ssize_t n;
+  while ((n = recv(fd, buffer, sizeof(buffer), 0)) > 0) text.append(buffer, n);
+  if (closed != nullptr) *closed = n == 0;
+  return text;
+}
+
+static void command(int fd, const char* cmd) {
+  TEST_ASSERT_EQUAL(strlen(cmd), send(fd, cmd, strlen(cmd), 0));
+}
+
+static bool contains(const std::string& text, const char* part) {
+  return text.find(part) != std::string::npos;
+}
+
+static int count(const std::string& text, const char* part) {
+  int n = 0;
+  for (size_t pos = text.find(part); pos != std::string::npos; pos = text.find(part, pos + 1)) n++;
+  return n;
+}
+
+// closes the clients and lets the sessions see it
+static void disconnect(const int* fds, size_t n) {
+  for (size_t i = 0; i < n; i++) {
+    if (fds[i] >= 0) close(fds[i]);
+  }
+  handleFor(50);
+}
+
+void setUp() {}
+void tearDown() {}
+
+void test_level_and_color_per_session() {
+  int fds[2] = {connectClient(), connectClient()};
+  TEST_ASSERT_TRUE(fds[0] >= 0 && fds[1] >= 0);
+  handleFor(50);
+  TEST_ASSERT_TRUE(contains(receive(fds[0]), "*****"));  // the help text
+  TEST_ASSERT_TRUE(contains(receive(fds[1]), "*****"));
+  command(fds[0], "v\r");
+  command(fds[1], "c\r");
+  handleFor(50);
+  receive(fds[0]);
+  receive(fds[1]);
+
+  AR_LOGV("verbose %d", 1);
+  AR_LOGI("info %d", 2);
+  ardprintf("raw %d\n", 3);
+  handleFor(ARDEBUG_COALESCE_MS * 3);
+  std::string a = receive(fds[0]);
+  std::string b = receive(fds[1]);
+  TEST_ASSERT_TRUE(contains(a, "verbose 1"));
+  TEST_ASSERT_TRUE(contains(a, "info 2"));
+  TEST_ASSERT_TRUE(contains(a, "raw 3"));
+  TEST_ASSERT_TRUE(contains(a, ARD_COLOR_I));
+  TEST_ASSERT_FALSE(contains(b, "verbose 1"));
+  TEST_ASSERT_TRUE(contains(b, "info 2"));
+  TEST_ASSERT_TRUE(contains(b, "raw 3"));
+  TEST_ASSERT_FALSE(contains(b, "\x1b["));
+  disconnect(fds, 2);
+}
+
+void test_clients_beyond_the_limit_are_refused() {
+  int fds[ARDEBUG_TELNET_CLIENTS + 1];
+  for (int& fd : fds) {
+    fd = connectClient();
+    TEST_ASSERT_TRUE(fd >= 0);
+    handleFor(20);
+  }
+  handleFor(50);
+  bool closed = false;
+  for (int i = 0; i < ARDEBUG_TELNET_CLIENTS; i++) {
+    TEST_ASSERT_TRUE(contains(receive(fds[i], &closed), "*****"));
+    TEST_ASSERT_FALSE(closed);
+  }
+  std::string refused = receive(fds[ARDEBUG_TELNET_CLIENTS], &closed);
+  TEST_ASSERT_EQUAL_STRING("Too many telnet clients.\n", refused.c_str());
+  TEST_ASSERT_TRUE(closed);
+
+  AR_LOGI("after %d", 1);  // the sessions that got in still work
+  handleFor(ARDEBUG_COALESCE_MS * 3);
+  for (int i = 0; i < ARDEBUG_TELNET_CLIENTS; i++) {
+    TEST_ASSERT_TRUE(contains(receive(fds[i]), "after 1"));
+  }
+  disconnect(fds, ARDEBUG_TELNET_CLIENTS + 1);
+
+  int again = connectClient();  // a freed session takes a new client
+  handleFor(50);
+  TEST_ASSERT_TRUE(contains(receive(again), "*****"));
+  disconnect(&again, 1);
+}
+
+void test_a_stalled_session_does_not_hold_up_the_others() {
+  int stalled = connectClient(4096);  // connected, but never read
+  int reader = connectClient();
+  handleFor(50);
+  receive(reader);
+  uint32_t dropped = ardebug::DebugContext::get().droppedLines();
+
+  const int lines = 20000;
+  std::string text;
+  uint32_t slowest = 0;
+  uint32_t start = millis();
+  for (int i = 0; i < lines; i++) {
+    uint32_t call = micros();
+    AR_LOGI("line %05d of a burst that the stalled client never reads", i);
+    if (i % 20 == 19) {
+      ardebugHandle();
+      text += receive(reader);
+    }
+    if (micros() - call > slowest) slowest = micros() - call;
+  }
+  handleFor(ARDEBUG_COALESCE_MS * 3);
+  text += receive(reader);
+  uint32_t elapsed = millis() - start;
+
+  TEST_ASSERT_EQUAL(lines, count(text, " of a burst "));
+  TEST_ASSERT_TRUE(contains(text, "line 00000 "));
+  TEST_ASSERT_TRUE(contains(text, "line 19999 "));
+  TEST_ASSERT_TRUE(text.find("line 19999 ") > text.find("line 10000 "));
+  TEST_ASSERT_FALSE(contains(text, "dropped"));
+  // the stalled session's queue dropped lines, the reader's none
+  TEST_ASSERT_GREATER_THAN(dropped, ardebug::DebugContext::get().droppedLines());
+  TEST_ASSERT_LESS_THAN(100000, slowest);  // us, no call waited for the stalled client
+  TEST_ASSERT_LESS_THAN(10000, elapsed);
+
+  // once it reads again it gets the newest lines and a note of the lost ones
+  std::string late;
+  for (int i = 0; i < 50; i++) {
+    handleFor(10);
+    late += receive(stalled);
+  }
+  TEST_ASSERT_TRUE(contains(late, "lines dropped"));
+  TEST_ASSERT_TRUE(contains(late, "line 19999 "));
+  int fds[2] = {stalled, reader};
+  disconnect(fds, 2);
+}
+
+void test_a_late_client_gets_the_backlog() {
+  const int lines = 100;  // several times ARDEBUG_BACKLOG_SIZE, so it has wrapped
+  for (int i = 0; i < lines; i++) {
+    AR_LOGI("backlog %03d kept for clients that connect later", i);
+  }
+  int fd = connectClient();
+  TEST_ASSERT_TRUE(fd >= 0);
+  handleFor(20);
+  AR_LOGI("live %d", 1);  // while replaying, held behind the backlog
+  std::string text;
+  for (int i = 0; i < 20; i++) {
+    handleFor(10);
+    text += receive(fd);
+  }
+  size_t help = text.rfind("*****");
+  size_t first = text.find("backlog ");
+  TEST_ASSERT_TRUE(help != std::string::npos);
+  TEST_ASSERT_TRUE(first != std::string::npos && first > help);
+
+  // the oldest record kept is a whole line, and the rest follow it in order
+  size_t start = text.rfind('\n', first) + 1;
+  std::string prefix = text.substr(start, first - start);
+  TEST_ASSERT_TRUE(contains(prefix, "[I][test_main.cpp:"));
+  TEST_ASSERT_TRUE(contains(prefix, "test_a_late_client_gets_the_backlog(): "));
+  int seq = atoi(text.c_str() + first + 8);
+  TEST_ASSERT_GREATER_THAN(0, seq);
+  TEST_ASSERT_EQUAL(lines - seq, count(text, " kept for clients that connect later\n"));
+  TEST_ASSERT_EQUAL(lines - seq, count(text, "backlog "));
+  TEST_ASSERT_TRUE(text.find("backlog 099 ") > first);
+  TEST_ASSERT_TRUE(text.find("live 1\n") > text.find("backlog 099 "));
+  disconnect(&fd, 1);
+}
+
+int main() {
+  ardebugBegin(nullptr, "host", nullptr);
+  handleFor(20);  // starts listening
+  UNITY_BEGIN();
+  RUN_TEST(test_level_and_color_per_session);
+  RUN_TEST(test_clients_beyond_the_limit_are_refused);
+  RUN_TEST(test_a_stalled_session_does_not_hold_up_the_others);
+  RUN_TEST(test_a_late_client_gets_the_backlog);
+  return UNITY_END();
+}
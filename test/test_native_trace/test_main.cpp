@@ -0,0 +1,134 @@
+/**
+ * @brief Trace events written as Chrome Trace Event JSON by ardebugTrace()
+ * (pio test -e native_trace)
+*/
+
+#include <stdlib.h>
+#include <string>
+#include <vector>
+#include <unity.h>
+#include "ardebug.h"
+
+/** @brief A Print that keeps what is written to it */
+class MockPrint : public Print {
+  public:
+    std::string text;
+
+    size_t write(uint8_t c) override {
+      text += (char)c;
+      return 1;
+    }
+    size_t write(const uint8_t* buffer, size_t size) override {
+      text.append((const char*)buffer, size);
+      return size;
+    }
+    using Print::write;
+};
+
+static int count(const std::string& text, const char* part) {
+  int n = 0;
+  for (size_t pos = text.find(part); pos != std::string::npos; pos = text.find(part, pos + 1)) n++;
+  return n;
+}
+
+// the events of the array, without the track names, one per line
+static std::string events(const std::string& text) {
+  std::string out;
+  size_t pos = 0;
+  while ((pos = text.find(",{\"name\":\"", pos)) != std::string::npos) {
+    size_t end = text.find('\n', pos);
+    std::string line = text.substr(pos, end - pos);
+    if (line.find("\"ph\":\"M\"") == std::string::npos) out += line + "\n";
+    pos = end;
+  }
+  return out;
+}
+
+// "ts" of each event line, in order
+static std::vector<uint64_t> stamps(const std::string& lines) {
+  std::vector<uint64_t> ts;
+  for (size_t pos = lines.find("\"ts\":"); pos != std::string::npos;
+       pos = lines.find("\"ts\":", pos + 1)) {
+    ts.push_back(strtoull(lines.c_str() + pos + 5, nullptr, 10));
+  }
+  return ts;
+}
+
+void setUp() {
+  MockPrint discard;
+  ardebugTrace(&discard);
+}
+
+void tearDown() {}
+
+void test_events_are_written_as_a_json_array() {
+  AR_TRACE_BEGIN("work");
+  AR_TRACE_COUNTER("depth", -5);
+  AR_TRACE_COUNTER("queue", 12);
+  AR_TRACE_INSTANT("tick");
+  AR_TRACE_END("work");
+  MockPrint out;
+  TEST_ASSERT_EQUAL(5, ardebugTrace(&out));
+  TEST_ASSERT_EQUAL(0, out.text.find("[\n{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":0"));
+  TEST_ASSERT_EQUAL(out.text.size() - 2, out.text.rfind("]\n"));
+  TEST_ASSERT_EQUAL(BOARD_CORES, count(out.text, "\"name\":\"thread_name\""));
+
+  std::string lines = events(out.text);
+  TEST_ASSERT_EQUAL(5, count(lines, "\n"));
+  TEST_ASSERT_EQUAL(0, lines.find(",{\"name\":\"work\",\"ph\":\"B\",\"ts\":"));
+  TEST_ASSERT_TRUE(lines.find("\"name\":\"depth\",\"ph\":\"C\"") != std::string::npos);
+  TEST_ASSERT_TRUE(lines.find("\"args\":{\"value\":-5}") != std::string::npos);
+  TEST_ASSERT_TRUE(lines.find("\"args\":{\"value\":12}") != std::string::npos);
+  TEST_ASSERT_TRUE(lines.find("\"name\":\"tick\",\"ph\":\"i\"") != std::string::npos);
+  TEST_ASSERT_TRUE(lines.find(",\"s\":\"t\"}") != std::string::npos);
+  TEST_ASSERT_TRUE(lines.find(",{\"name\":\"work\",\"ph\":\"E\"") > lines.find("\"tick\""));
+
+  std::vector<uint64_t> ts = stamps(lines);
+  TEST_ASSERT_EQUAL(5, ts.size());
+  for (size_t i = 1; i < ts.size(); i++) TEST_ASSERT_TRUE(ts[i] >= ts[i - 1]);
+}
+
+void test_each_event_is_written_once() {
+  AR_TRACE_INSTANT("once");
+  MockPrint first;
+  TEST_ASSERT_EQUAL(1, ardebugTrace(&first));
+  MockPrint second;
+  TEST_ASSERT_EQUAL(0, ardebugTrace(&second));
+  TEST_ASSERT_EQUAL(0, count(second.text, "\"once\""));
+}
+
+void test_a_scope_begins_and_ends() {
+  {
+    AR_TRACE_SCOPE("scope");
+    delay(2);
+  }
+  MockPrint out;
+  TEST_ASSERT_EQUAL(2, ardebugTrace(&out));
+  std::string lines = events(out.text);
+  TEST_ASSERT_EQUAL(0, lines.find(",{\"name\":\"scope\",\"ph\":\"B\""));
+  TEST_ASSERT_TRUE(lines.find(",{\"name\":\"scope\",\"ph\":\"E\"") != std::string::npos);
+  std::vector<uint64_t> ts = stamps(lines);
+  TEST_ASSERT_GREATER_OR_EQUAL(2000, (uint32_t)(ts[1] - ts[0]));
+}
+
+void test_a_full_ring_keeps_the_newest_events() {
+  for (int i = 0; i < ARDEBUG_TRACE_SLOTS + 10; i++) {
+    AR_TRACE_COUNTER("n", i);
+  }
+  MockPrint out;
+  TEST_ASSERT_EQUAL(ARDEBUG_TRACE_SLOTS, ardebugTrace(&out));
+  TEST_ASSERT_EQUAL(0, count(out.text, "\"value\":9}"));
+  TEST_ASSERT_EQUAL(1, count(out.text, "\"value\":10}"));
+  char last[32];
+  snprintf(last, sizeof(last), "\"value\":%d}", ARDEBUG_TRACE_SLOTS + 9);
+  TEST_ASSERT_EQUAL(1, count(out.text, last));
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_events_are_written_as_a_json_array);
+  RUN_TEST(test_each_event_is_written_once);
+  RUN_TEST(test_a_scope_begins_and_ends);
+  RUN_TEST(test_a_full_ring_keeps_the_newest_events);
+  return UNITY_END();
+}
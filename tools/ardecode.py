@@ -0,0 +1,164 @@
+#!/usr/bin/env python3
+"""Decode ardebug binary output (ARDEBUG_DEFERRED with ardebugBinary(true)).
+
+Frames are `0x1E <type> <len16 LE> <payload>`. A `S` frame describes a call
+site (id, level, line, file, function, format) and precedes the first `R`
+record of that site; `R` frames carry the id, millis, core and the packed
+arguments. Anything outside a frame (help text, ardprintf output) is passed
+through unchanged.
+
+Usage:
+    ardecode.py [file|-]                  read a capture or stdin
+    ardecode.py --tcp <host>[:<port>]     connect to the telnet server
+    ardecode.py --serial <dev> [--baud n] read a serial port (needs pyserial)
+"""
+
+import argparse
+import re
+import socket
+import struct
+import sys
+
+FRAME_START = 0x1E
+LEVELS = 'EWIDV'
+SPEC = re.compile(r'%([-+ #0]*)(\*|\d+)?(?:\.(\*|\d+))?(hh|h|ll|l|L|q|j|z|t)?([diouxXeEfFgGaAcspn%])')
+
+
+def unpack_args(data):
+    args = []
+    pos = 0
+    while pos < len(data):
+        tag = chr(data[pos])
+        pos += 1
+        if tag == 'i':
+            args.append(struct.unpack_from('<i', data, pos)[0])
+            pos += 4
+        elif tag in 'lp':
+            args.append(struct.unpack_from('<q', data, pos)[0])
+            pos += 8
+        elif tag == 'f':
+            args.append(struct.unpack_from('<d', data, pos)[0])
+            pos += 8
+        elif tag == 's':
+            n = data[pos]
+            args.append(data[pos + 1:pos + 1 + n].decode('utf-8', 'replace'))
+            pos += 1 + n
+        else:
+            break
+    return args
+
+
+def format_message(fmt, args):
+    args = list(args)
+
+    def convert(m):
+        flags, width, precision, _, conv = m.groups()
+        if conv == '%':
+            return '%'
+        if width == '*':
+            width = str(args.pop(0)) if args else ''
+        if precision == '*':
+            precision = str(args.pop(0)) if args else ''
+        if not args:
+            return '<?>'
+        value = args.pop(0)
+        spec = '%' + flags + (width or '') + ('.' + precision if precision else '')
+        if conv in 'ouxX' and isinstance(value, int) and value < 0:
+            value &= 0xFFFFFFFF
+        if conv == 'p':
+            return '0x%x' % value
+        conv = {'i': 'd', 'u': 'd', 'F': 'f', 'a': 'e', 'A': 'E'}.get(conv, conv)
+        try:
+            return (spec + conv) % value
+        except (TypeError, ValueError):
+            return str(value)
+
+    return SPEC.sub(convert, fmt)
+
+
+class Decoder:
+    def __init__(self, out):
+        self.out = out
+        self.sites = {}
+        self.buffer = bytearray()
+
+    def feed(self, data):
+        self.buffer.extend(data)
+        while self.buffer:
+            start = self.buffer.find(FRAME_START)
+            if start < 0:
+                self.text(self.buffer)
+                self.buffer.clear()
+                return
+            if start > 0:
+                self.text(self.buffer[:start])
+                del self.buffer[:start]
+            if len(self.buffer) < 4:
+                return
+            kind = chr(self.buffer[1])
+            length = self.buffer[2] | (self.buffer[3] << 8)
+            if kind not in 'SR':
+                self.text(self.buffer[:1])
+                del self.buffer[:1]
+                continue
+            if len(self.buffer) < 4 + length:
+                return
+            payload = bytes(self.buffer[4:4 + length])
+            del self.buffer[:4 + length]
+            if kind == 'S':
+                self.site(payload)
+            else:
+                self.record(payload)
+
+    def text(self, data):
+        self.out.write(data.decode('utf-8', 'replace'))
+
+    def site(self, payload):
+        site_id, level, line = struct.unpack_from('<IBH', payload)
+        file, func, fmt = payload[7:].split(b'\0')[:3]
+        self.sites[site_id] = (level, line, file.decode(), func.decode(), fmt.decode())
+
+    def record(self, payload):
+        site_id, ms, core = struct.unpack_from('<IIB', payload)
+        site = self.sites.get(site_id)
+        if site is None:
+            self.out.write('[%6d][?] <unknown call site 0x%08x>\n' % (ms, site_id))
+            return
+        level, line, file, func, fmt = site
+        label = LEVELS[level] if level < len(LEVELS) else 'V'
+        message = format_message(fmt, unpack_args(payload[9:]))
+        self.out.write('[%6d][%s][%s:%d][C%d] %s(): %s' % (ms, label, file, line, core, func, message))
+        self.out.flush()
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument('input', nargs='?', default='-', help='capture file or - for stdin')
+    parser.add_argument('--tcp', help='telnet server <host>[:<port>]')
+    parser.add_argument('--serial', help='serial device')
+    parser.add_argument('--baud', type=int, default=115200)
+    args = parser.parse_args()
+    decoder = Decoder(sys.stdout)
+    if args.tcp:
+        host, _, port = args.tcp.partition(':')
+        conn = socket.create_connection((host, int(port or 23)))
+        read = lambda: conn.recv(4096)
+    elif args.serial:
+        import serial
+        port = serial.Serial(args.serial, args.baud, timeout=0.1)
+        read = lambda: port.read(4096)
+    else:
+        stream = sys.stdin.buffer if args.input == '-' else open(args.input, 'rb')
+        read = lambda: stream.read(4096)
+    try:
+        while True:
+            data = read()
+            if not data and not args.serial:
+                break
+            decoder.feed(data)
+    except KeyboardInterrupt:
+        pass
+
+
+if __name__ == '__main__':
+    main()